@@ -0,0 +1,131 @@
+/* Spawn rate token bucket and pressure stall thresholds. */
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <time.h>
+
+#include "admit.h"
+
+#define PRESSURE_RETRY 1.0 /* seconds between checks while under pressure (avg10 moves every 2 s) */
+
+static const char *reason_names[ADMIT_REASONS] = {"none", "rate", "cpu", "memory", "io", "queue"};
+static const char *pressure_files[3] = {"/proc/pressure/cpu", "/proc/pressure/memory", "/proc/pressure/io"};
+static int pressure_fds[3] = {-2, -2, -2}; // -2 until opened, -1 if not available
+
+static double tokens = -1; // -1 until the bucket is first used, then full
+static struct timespec last_refill;
+static AdmitStats counts;
+
+static double seconds_between(const struct timespec *a, const struct timespec *b)
+{
+    return (b->tv_sec - a->tv_sec) + (b->tv_nsec - a->tv_nsec) / 1e9;
+}
+
+double admit_tokens(long rate, long burst)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    if (tokens < 0)
+    {
+        tokens = burst;
+    }
+    else
+    {
+        tokens += seconds_between(&last_refill, &now) * rate;
+    }
+    if (tokens > burst)
+    {
+        tokens = burst; // also after the burst setting was lowered
+    }
+    last_refill = now;
+    return tokens;
+}
+
+void admit_pressure(double pressure[3])
+{
+    char buffer[256];
+
+    for (int i = 0; i < 3; i++)
+    {
+        pressure[i] = -1;
+        if (pressure_fds[i] == -2)
+        { // kept open: rereading from offset 0 gives fresh values
+            pressure_fds[i] = open(pressure_files[i], O_RDONLY | O_CLOEXEC);
+        }
+        if (pressure_fds[i] == -1)
+        {
+            continue;
+        }
+        ssize_t n = pread(pressure_fds[i], buffer, sizeof(buffer) - 1, 0);
+        if (n <= 0)
+        {
+            continue;
+        }
+        buffer[n] = '\0';
+        char *avg = strstr(buffer, "some avg10=");
+        if (avg)
+        {
+            pressure[i] = strtod(avg + strlen("some avg10="), NULL);
+        }
+    }
+}
+
+int admit_check(long rate, long burst, const long thresholds[3], double *retry)
+{
+    if (thresholds[0] > 0 || thresholds[1] > 0 || thresholds[2] > 0)
+    {
+        double pressure[3];
+        admit_pressure(pressure);
+        for (int i = 0; i < 3; i++)
+        {
+            if (thresholds[i] > 0 && pressure[i] > thresholds[i])
+            {
+                *retry = PRESSURE_RETRY;
+                return ADMIT_CPU + i;
+            }
+        }
+    }
+    if (rate > 0)
+    {
+        double available = admit_tokens(rate, burst);
+        if (available < 1)
+        {
+            *retry = (1 - available) / rate;
+            return ADMIT_RATE;
+        }
+        tokens -= 1;
+    }
+    return ADMIT_OK;
+}
+
+void admit_count(int reason)
+{
+    if (reason == ADMIT_OK)
+    {
+        counts.admitted++;
+    }
+    else
+    {
+        counts.deferred[reason]++;
+    }
+}
+
+void admit_released(void)
+{
+    counts.released++;
+}
+
+void admit_stats(AdmitStats *stats)
+{
+    *stats = counts;
+}
+
+const char *admit_reason_name(int reason)
+{
+    return (reason >= 0 && reason < ADMIT_REASONS) ? reason_names[reason] : "unknown";
+}
@@ -0,0 +1,56 @@
+#ifndef ADMIT_H
+#define ADMIT_H
+
+/* Admission control for background launches: a token bucket limiting the
+ * spawn rate, and thresholds on the kernel's pressure stall information
+ * (/proc/pressure), so that launches wait while the machine is saturated. */
+
+/* Why a launch was held back (ADMIT_OK if it was not) */
+#define ADMIT_OK      0
+#define ADMIT_RATE    1 /* no token left in the bucket */
+#define ADMIT_CPU     2 /* CPU pressure above its threshold */
+#define ADMIT_MEMORY  3 /* memory pressure above its threshold */
+#define ADMIT_IO      4 /* IO pressure above its threshold */
+#define ADMIT_QUEUE   5 /* earlier launches are still waiting */
+#define ADMIT_REASONS 6
+
+/* The resources of /proc/pressure, indexes of pressure arrays */
+#define ADMIT_PSI_CPU    0
+#define ADMIT_PSI_MEMORY 1
+#define ADMIT_PSI_IO     2
+
+/* Counts since the start. */
+typedef struct AdmitStats
+{
+    unsigned long admitted;                // launches let through at once
+    unsigned long deferred[ADMIT_REASONS]; // launches held back, by reason
+    unsigned long released;                // held back launches let through later
+} AdmitStats;
+
+/* Decides whether a launch may happen now, given rate launches per second
+ * (0 for no limit) with bursts of up to burst, and thresholds on the "some
+ * avg10" pressure of each resource in percent (0 for none). Takes a token
+ * and returns ADMIT_OK if so; otherwise returns the reason and sets *retry to
+ * the seconds after which asking again makes sense. */
+int admit_check(long rate, long burst, const long thresholds[3], double *retry);
+
+/* Reads the current "some avg10" pressure of each resource, -1 where the
+ * kernel does not report it. */
+void admit_pressure(double pressure[3]);
+
+/* Returns the tokens in the bucket, refilled up to now. */
+double admit_tokens(long rate, long burst);
+
+/* Counts a launch held back for reason, or one let through (ADMIT_OK) at once. */
+void admit_count(int reason);
+
+/* Counts a held back launch let through. */
+void admit_released(void);
+
+/* Fills in the counts. */
+void admit_stats(AdmitStats *stats);
+
+/* Returns a short name for a reason. */
+const char *admit_reason_name(int reason);
+
+#endif /*ADMIT_H*/
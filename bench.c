@@ -0,0 +1,219 @@
+/* Repeated-run benchmarking: runs a command many times, a few at a time, and
+ * summarizes the wall time distribution and resource usage. */
+
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <math.h>
+#include <time.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+
+#include "bench.h"
+#include "reaper.h"
+
+typedef struct
+{
+    pid_t pid;             // running copy, 0 if the slot is free
+    EvWatch watch;         // event loop registration of its pidfd (EV_BENCH)
+    int measured;          // 0 for warmup runs
+    struct timespec start; // time of the fork
+    int exited;            // 1 once the event loop reported the exit
+    double elapsed;        // wall time up to then, in ms
+} BenchSlot;
+
+static double ms_since(struct timespec *start)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (now.tv_sec - start->tv_sec) * 1e3 + (now.tv_nsec - start->tv_nsec) / 1e6;
+}
+
+static int compare_doubles(const void *a, const void *b)
+{
+    double x = *(const double *)a;
+    double y = *(const double *)b;
+    return (x > y) - (x < y);
+}
+
+/*
+ * Nearest-rank percentile of sorted values.
+ */
+static double percentile(double *sorted, int count, double pct)
+{
+    int rank = (int)ceil(pct / 100.0 * count);
+    if (rank < 1)
+    {
+        rank = 1;
+    }
+    return sorted[rank - 1];
+}
+
+static void summarize(double *wall, int count, BenchStats *stats)
+{
+    double sum = 0, sq = 0;
+
+    qsort(wall, count, sizeof(double), compare_doubles);
+    for (int i = 0; i < count; i++)
+    {
+        sum += wall[i];
+    }
+    stats->mean = sum / count;
+    for (int i = 0; i < count; i++)
+    {
+        sq += (wall[i] - stats->mean) * (wall[i] - stats->mean);
+    }
+    stats->stddev = (count > 1) ? sqrt(sq / (count - 1)) : 0;
+    stats->min = wall[0];
+    stats->max = wall[count - 1];
+    stats->p50 = percentile(wall, count, 50);
+    stats->p90 = percentile(wall, count, 90);
+    stats->p99 = percentile(wall, count, 99);
+
+    /* Tukey's fences around the interquartile range */
+    double q1 = percentile(wall, count, 25);
+    double q3 = percentile(wall, count, 75);
+    double iqr = q3 - q1;
+    for (int i = 0; i < count; i++)
+    {
+        if (wall[i] < q1 - 3 * iqr || wall[i] > q3 + 3 * iqr)
+        {
+            stats->far_outliers++;
+        }
+        else if (wall[i] < q1 - 1.5 * iqr || wall[i] > q3 + 1.5 * iqr)
+        {
+            stats->mild_outliers++;
+        }
+    }
+}
+
+/*
+ * Starts the next copy in a free slot.
+ */
+static int launch(BenchSlot *slot, int measured, BenchSpawn spawn, void *ctx)
+{
+    clock_gettime(CLOCK_MONOTONIC, &slot->start);
+    slot->pid = spawn(ctx);
+    if (slot->pid <= 0)
+    {
+        slot->pid = 0;
+        return -1;
+    }
+    reaper_claim(slot->pid);
+    slot->measured = measured;
+    slot->exited = 0;
+    int pidfd = pidfd_open_pid(slot->pid);
+    if (pidfd == -1 || ev_add(&slot->watch, pidfd, EV_BENCH, slot) == -1)
+    {
+        wait4(slot->pid, NULL, 0, NULL); // cannot watch it, so wait for it right here
+        reaper_unclaim(slot->pid);
+        if (pidfd != -1)
+        {
+            close(pidfd);
+        }
+        slot->pid = 0;
+        return -1;
+    }
+    return 0;
+}
+
+void bench_event(EvWatch *watch)
+{
+    BenchSlot *slot = (BenchSlot *)watch->owner;
+    if (!slot->exited)
+    {
+        slot->elapsed = ms_since(&slot->start);
+        slot->exited = 1;
+    }
+}
+
+int bench_run(int runs, int warmup, int parallel, BenchSpawn spawn, BenchWait pump_events, void *ctx,
+              volatile sig_atomic_t *stop, BenchStats *stats)
+{
+    int total = warmup + runs;
+    int started = 0, running = 0, measured = 0;
+    double user = 0, sys = 0;
+
+    memset(stats, 0, sizeof(BenchStats));
+    if (runs < 1 || parallel < 1)
+    {
+        return -1;
+    }
+    double *wall = calloc(runs, sizeof(double));
+    BenchSlot *slots = calloc(parallel, sizeof(BenchSlot));
+    if (!wall || !slots)
+    {
+        free(wall);
+        free(slots);
+        return -1;
+    }
+
+    while (started < total || running > 0)
+    {
+        /* keep every slot busy while there is work left */
+        for (int i = 0; i < parallel && started < total && !*stop; i++)
+        {
+            if (slots[i].pid == 0)
+            {
+                if (launch(&slots[i], started >= warmup, spawn, ctx) == 0)
+                {
+                    running++;
+                }
+                started++;
+            }
+        }
+        if (*stop)
+        {
+            total = started; // control-c: let the running copies finish, start no more
+        }
+        if (running == 0)
+        {
+            continue;
+        }
+
+        pump_events(); // the rest of taskman carries on meanwhile
+        for (int i = 0; i < parallel; i++)
+        {
+            BenchSlot *slot = &slots[i];
+            struct rusage usage;
+            int status = 0;
+
+            if (slot->pid == 0 || !slot->exited || wait4(slot->pid, &status, WNOHANG, &usage) <= 0)
+            {
+                continue;
+            }
+            int pidfd = slot->watch.fd;
+            ev_del(&slot->watch);
+            close(pidfd);
+            reaper_unclaim(slot->pid);
+            slot->pid = 0;
+            running--;
+            if (!slot->measured || measured >= runs)
+            {
+                continue;
+            }
+            wall[measured++] = slot->elapsed;
+            user += usage.ru_utime.tv_sec * 1e3 + usage.ru_utime.tv_usec / 1e3;
+            sys += usage.ru_stime.tv_sec * 1e3 + usage.ru_stime.tv_usec / 1e3;
+            if (usage.ru_maxrss > stats->max_rss_kb)
+            {
+                stats->max_rss_kb = usage.ru_maxrss;
+            }
+            if (!WIFEXITED(status) || WEXITSTATUS(status) != 0)
+            {
+                stats->failed++;
+            }
+        }
+    }
+
+    free(slots);
+    stats->runs = measured;
+    if (measured > 0)
+    {
+        stats->user_ms = user / measured;
+        stats->sys_ms = sys / measured;
+        summarize(wall, measured, stats);
+    }
+    free(wall);
+    return (measured > 0) ? 0 : -1;
+}
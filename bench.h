@@ -0,0 +1,46 @@
+#ifndef BENCH_H
+#define BENCH_H
+
+#include <signal.h>
+#include <sys/types.h>
+
+#include "events.h"
+
+/* Summary of a benchmark: wall times in milliseconds over the measured runs. */
+typedef struct BenchStats
+{
+    int runs;          // measured runs (warmup runs excluded)
+    int failed;        // runs that exited non-zero or were killed
+    double min;        // fastest run
+    double mean;       // average run
+    double p50;        // median
+    double p90;        // 90th percentile
+    double p99;        // 99th percentile
+    double max;        // slowest run
+    double stddev;     // standard deviation
+    double user_ms;    // mean user CPU time per run
+    double sys_ms;     // mean system CPU time per run
+    long max_rss_kb;   // largest resident set size of any run
+    int mild_outliers; // runs outside Q1 - 1.5 IQR .. Q3 + 1.5 IQR
+    int far_outliers;  // runs outside Q1 - 3 IQR .. Q3 + 3 IQR
+} BenchStats;
+
+/* Starts one run and returns its pid (or -1). The run must be a child of the caller. */
+typedef pid_t (*BenchSpawn)(void *ctx);
+
+/* Waits for and handles the next events of the event loop, returning early
+ * when interrupted by a signal. */
+typedef void (*BenchWait)(void);
+
+/* Runs warmup + runs copies through spawn, at most parallel at a time, and fills
+ * in stats for the last runs. The copies are watched by the caller's event loop
+ * (EV_BENCH), which pump_events drives and which must pass their events to
+ * bench_event(). Stops early when *stop becomes non-zero.
+ * Returns 0 on success, -1 if nothing could be measured. */
+int bench_run(int runs, int warmup, int parallel, BenchSpawn spawn, BenchWait pump_events, void *ctx,
+              volatile sig_atomic_t *stop, BenchStats *stats);
+
+/* Notes the exit of the copy behind an EV_BENCH watch. */
+void bench_event(EvWatch *watch);
+
+#endif /*BENCH_H*/
@@ -0,0 +1,226 @@
+/* Fan-out of one input file to many pipes with splice() and tee(). */
+
+#define _GNU_SOURCE
+
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <signal.h>
+#include <pthread.h>
+
+#include "broadcast.h"
+
+#define STAGE_SIZE (1024 * 1024) /* staging pipe size asked for */
+#define COPY_SIZE 65536          /* buffer for copies that cannot be spliced */
+
+typedef struct Broadcast
+{
+    int in_fd;    // file being copied
+    int count;    // number of outputs
+    int live;     // outputs still being written
+    int fds[];    // output pipes, -1 once dropped
+} Broadcast;
+
+static void drop(Broadcast *b, int i)
+{
+    close(b->fds[i]);
+    b->fds[i] = -1;
+    b->live--;
+}
+
+/* Writes len bytes of the input from offset to one output with pread and write.
+ * Returns 0 on success, -1 if the output is gone. */
+static int copy_range(Broadcast *b, int fd, off_t offset, size_t len)
+{
+    char buffer[COPY_SIZE];
+
+    while (len > 0)
+    {
+        ssize_t n = pread(b->in_fd, buffer, (len < sizeof(buffer)) ? len : sizeof(buffer), offset);
+        if (n == -1 && errno == EINTR)
+        {
+            continue;
+        }
+        if (n <= 0)
+        {
+            return -1;
+        }
+        for (ssize_t done = 0; done < n;)
+        {
+            ssize_t w = write(fd, buffer + done, n - done);
+            if (w == -1 && errno == EINTR)
+            {
+                continue;
+            }
+            if (w == -1)
+            {
+                return -1;
+            }
+            done += w;
+        }
+        offset += n;
+        len -= n;
+    }
+    return 0;
+}
+
+/* Empties len bytes out of the staging pipe. */
+static void discard(int stage_fd, int null_fd, size_t len)
+{
+    char buffer[COPY_SIZE];
+
+    while (len > 0)
+    {
+        ssize_t n = splice(stage_fd, NULL, null_fd, NULL, len, 0);
+        if (n == -1 && errno == EINTR)
+        {
+            continue;
+        }
+        if (n <= 0)
+        {
+            n = read(stage_fd, buffer, (len < sizeof(buffer)) ? len : sizeof(buffer));
+            if (n <= 0)
+            {
+                return;
+            }
+        }
+        len -= n;
+    }
+}
+
+/* Copies the input in chunks of the staging pipe's size: one splice() in, one
+ * tee() per output, and pread()/write() for whatever a tee() left out. */
+static void run_spliced(Broadcast *b, int stage[2], int null_fd)
+{
+    loff_t offset = 0;
+    int chunk = fcntl(stage[1], F_GETPIPE_SZ);
+
+    /* a tee() into a pipe with less room than the chunk comes up short, so the
+       outputs are sized like the staging pipe and the chunk capped at the smallest */
+    if (chunk <= 0)
+    {
+        chunk = COPY_SIZE;
+    }
+    for (int i = 0; i < b->count; i++)
+    {
+        fcntl(b->fds[i], F_SETPIPE_SZ, chunk); // may be refused past the per-user pipe limit
+        int size = fcntl(b->fds[i], F_GETPIPE_SZ);
+        if (size > 0 && size < chunk)
+        {
+            chunk = size;
+        }
+    }
+    while (b->live > 0)
+    {
+        loff_t start = offset;
+        ssize_t n = splice(b->in_fd, &offset, stage[1], NULL, chunk, SPLICE_F_MOVE);
+        if (n == -1 && errno == EINTR)
+        {
+            continue;
+        }
+        if (n == -1 && errno == EINVAL && start == 0)
+        { // the file system cannot splice
+            while (b->live > 0)
+            {
+                char buffer[COPY_SIZE];
+                ssize_t r = pread(b->in_fd, buffer, sizeof(buffer), offset);
+                if (r <= 0)
+                {
+                    return;
+                }
+                for (int i = 0; i < b->count; i++)
+                {
+                    if (b->fds[i] != -1 && copy_range(b, b->fds[i], offset, r) == -1)
+                    {
+                        drop(b, i);
+                    }
+                }
+                offset += r;
+            }
+            return;
+        }
+        if (n <= 0)
+        {
+            return; // end of file
+        }
+        for (int i = 0; i < b->count; i++)
+        {
+            if (b->fds[i] == -1)
+            {
+                continue;
+            }
+            ssize_t t;
+            do
+            {
+                t = tee(stage[0], b->fds[i], n, 0); // blocks while the output is full
+            } while (t == -1 && errno == EINTR);
+            if (t == -1 || (t < n && copy_range(b, b->fds[i], start + t, n - t) == -1))
+            {
+                drop(b, i);
+            }
+        }
+        discard(stage[0], null_fd, n);
+    }
+}
+
+static void *broadcast_thread(void *arg)
+{
+    Broadcast *b = (Broadcast *)arg;
+    int stage[2];
+    int null_fd = open("/dev/null", O_WRONLY | O_CLOEXEC);
+
+    if (pipe2(stage, O_CLOEXEC) == 0)
+    {
+        fcntl(stage[1], F_SETPIPE_SZ, STAGE_SIZE); // may be refused above /proc/sys/fs/pipe-max-size
+        run_spliced(b, stage, null_fd);
+        close(stage[0]);
+        close(stage[1]);
+    }
+    for (int i = 0; i < b->count; i++)
+    {
+        if (b->fds[i] != -1)
+        {
+            close(b->fds[i]); // end of input for the task
+        }
+    }
+    if (null_fd != -1)
+    {
+        close(null_fd);
+    }
+    close(b->in_fd);
+    free(b);
+    return NULL;
+}
+
+int broadcast_start(int in_fd, const int *out_fds, int count)
+{
+    pthread_t thread;
+    pthread_attr_t attr;
+    sigset_t all, old;
+
+    Broadcast *b = (Broadcast *)malloc(sizeof(Broadcast) + count * sizeof(int));
+    if (!b)
+    {
+        return -1;
+    }
+    b->in_fd = in_fd;
+    b->count = b->live = count;
+    memcpy(b->fds, out_fds, count * sizeof(int));
+
+    /* with every signal blocked, a reader that exits gives EPIPE instead of SIGPIPE */
+    sigfillset(&all);
+    pthread_sigmask(SIG_SETMASK, &all, &old);
+    pthread_attr_init(&attr);
+    pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+    int rc = pthread_create(&thread, &attr, broadcast_thread, b);
+    pthread_attr_destroy(&attr);
+    pthread_sigmask(SIG_SETMASK, &old, NULL);
+    if (rc != 0)
+    {
+        free(b);
+        return -1;
+    }
+    return 0;
+}
@@ -0,0 +1,16 @@
+#ifndef BROADCAST_H
+#define BROADCAST_H
+
+/* Copies one input file to many pipes from a background thread, reading it
+ * only once. The data is moved with splice() into a staging pipe and
+ * duplicated to each output pipe with tee(), so it is not copied through user
+ * space. Writes block on the fullest output pipe, so the slowest reader paces
+ * the copy and memory use stays bounded by the pipe buffers. A reader that goes
+ * away is dropped without stopping the others. */
+
+/* Starts copying the regular file open at in_fd to the count pipes in out_fds.
+ * The thread closes them and in_fd when it is done. Returns 0 on success, or -1
+ * if the thread could not be started (nothing is closed then). */
+int broadcast_start(int in_fd, const int *out_fds, int count);
+
+#endif /*BROADCAST_H*/
@@ -0,0 +1,379 @@
+/* On-disk result cache with least recently used eviction. */
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <dirent.h>
+#include <time.h>
+#include <sys/stat.h>
+
+#include "cache.h"
+
+#define HEADER "taskman-cache 2 " /* then the exit code and the size of stderr */
+
+typedef struct Entry
+{
+    char key[CACHE_KEY_LEN];
+    unsigned long long size; // size of the file, header included
+    long long used;          // last use in ns (the file's mtime, so it survives restarts)
+} Entry;
+
+static Entry *entries = NULL;
+static size_t num_entries = 0, cap_entries = 0;
+static int loaded = 0;
+static CacheStats counts;
+
+/* Two FNV-1a streams with different offsets, for a 128-bit key. */
+typedef struct Hash
+{
+    unsigned long long a, b;
+} Hash;
+
+static void hash_bytes(Hash *h, const void *data, size_t len)
+{
+    const unsigned char *p = (const unsigned char *)data;
+    for (size_t i = 0; i < len; i++)
+    {
+        h->a = (h->a ^ p[i]) * 0x100000001b3ULL;
+        h->b = (h->b ^ p[i]) * 0x100000001b3ULL;
+    }
+}
+
+/* Hashes what identifies the current contents of a file. */
+static int hash_file(Hash *h, const char *path)
+{
+    struct stat st;
+    if (stat(path, &st) == -1)
+    {
+        return -1;
+    }
+    long long id[5] = {(long long)st.st_dev, (long long)st.st_ino, (long long)st.st_size,
+                       (long long)st.st_mtim.tv_sec, (long long)st.st_mtim.tv_nsec};
+    hash_bytes(h, id, sizeof(id));
+    return 0;
+}
+
+int cache_key(const char *executable, char *const argv[], const char *input_file, char key[CACHE_KEY_LEN])
+{
+    Hash h = {0xcbf29ce484222325ULL, 0x84222325cbf29ce4ULL};
+
+    hash_bytes(&h, executable, strlen(executable) + 1);
+    if (hash_file(&h, executable) == -1)
+    {
+        return -1;
+    }
+    for (int i = 0; argv[i]; i++)
+    {
+        hash_bytes(&h, argv[i], strlen(argv[i]) + 1);
+    }
+    hash_bytes(&h, "", 1); // the end of argv, so that no input cannot pass for an argument
+    if (input_file && hash_file(&h, input_file) == -1)
+    {
+        return -1;
+    }
+    snprintf(key, CACHE_KEY_LEN, "%016llx%016llx", h.a, h.b);
+    return 0;
+}
+
+static void entry_path(const char *key, const char *suffix, char *path, size_t size)
+{
+    snprintf(path, size, "%s/%s%s", CACHE_DIR, key, suffix);
+}
+
+static Entry *find(const char *key)
+{
+    for (size_t i = 0; i < num_entries; i++)
+    {
+        if (strcmp(entries[i].key, key) == 0)
+        {
+            return &entries[i];
+        }
+    }
+    return NULL;
+}
+
+static void add(const char *key, unsigned long long size, long long used)
+{
+    Entry *entry = find(key);
+    if (!entry)
+    {
+        if (num_entries == cap_entries)
+        {
+            size_t cap = cap_entries ? cap_entries * 2 : 64;
+            Entry *grown = (Entry *)realloc(entries, cap * sizeof(Entry));
+            if (!grown)
+            {
+                return; // not tracked: it is never evicted, but still found
+            }
+            entries = grown;
+            cap_entries = cap;
+        }
+        entry = &entries[num_entries++];
+        snprintf(entry->key, CACHE_KEY_LEN, "%s", key);
+        counts.entries++;
+    }
+    else
+    {
+        counts.bytes -= entry->size;
+    }
+    entry->size = size;
+    entry->used = used;
+    counts.bytes += size;
+}
+
+static void remove_entry(Entry *entry)
+{
+    char path[256];
+    entry_path(entry->key, "", path, sizeof(path));
+    unlink(path);
+    counts.entries--;
+    counts.bytes -= entry->size;
+    *entry = entries[--num_entries];
+}
+
+/* Reads the entries left by earlier sessions the first time the cache is used. */
+static void load(void)
+{
+    DIR *dir;
+    struct dirent *ent;
+
+    if (loaded)
+    {
+        return;
+    }
+    loaded = 1;
+    if (!(dir = opendir(CACHE_DIR)))
+    {
+        return;
+    }
+    while ((ent = readdir(dir)))
+    {
+        struct stat st;
+        char path[256];
+        if (strlen(ent->d_name) != CACHE_KEY_LEN - 1 || strspn(ent->d_name, "0123456789abcdef") != CACHE_KEY_LEN - 1)
+        {
+            continue; // ., .. and files being written
+        }
+        entry_path(ent->d_name, "", path, sizeof(path));
+        if (stat(path, &st) == 0)
+        {
+            add(ent->d_name, st.st_size, st.st_mtim.tv_sec * 1000000000LL + st.st_mtim.tv_nsec);
+        }
+    }
+    closedir(dir);
+}
+
+static long long now_ns(void)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_REALTIME, &now);
+    return now.tv_sec * 1000000000LL + now.tv_nsec;
+}
+
+int cache_lookup(const char *key, char **data, size_t *out_len, size_t *err_len, int *code)
+{
+    char path[256];
+    char header[64] = {0};
+    struct stat st;
+
+    load();
+    entry_path(key, "", path, sizeof(path));
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd == -1 || fstat(fd, &st) == -1)
+    {
+        if (fd != -1)
+        {
+            close(fd);
+        }
+        counts.misses++;
+        return -1;
+    }
+
+    /* header line, then stdout and stderr as they were captured */
+    ssize_t n = pread(fd, header, sizeof(header) - 1, 0);
+    char *nl = (n > 0) ? memchr(header, '\n', n) : NULL;
+    char *buffer = NULL;
+    size_t start = nl ? (size_t)(nl + 1 - header) : 0;
+    size_t len = st.st_size - start;
+    unsigned long long errors = 0;
+    if (nl && sscanf(header, HEADER "%d %llu", code, &errors) == 2 && errors <= len &&
+        (buffer = (char *)malloc(len + 1)))
+    {
+        size_t done = 0;
+        while (done < len && (n = pread(fd, buffer + done, len - done, start + done)) > 0)
+        {
+            done += n;
+        }
+        if (done == len)
+        {
+            futimens(fd, NULL); // most recently used, also for later sessions
+            close(fd);
+            add(key, st.st_size, now_ns());
+            *data = buffer;
+            *out_len = len - errors;
+            *err_len = errors;
+            counts.hits++;
+            return 0;
+        }
+    }
+    free(buffer);
+    close(fd);
+    Entry *entry = find(key);
+    if (entry)
+    {
+        remove_entry(entry); // unreadable: drop it
+    }
+    counts.misses++;
+    return -1;
+}
+
+void cache_run_init(CacheRun *run)
+{
+    run->key[0] = '\0';
+    for (int i = 0; i < 2; i++)
+    {
+        run->data[i] = NULL;
+        run->len[i] = run->cap[i] = 0;
+    }
+    run->limit = 0;
+}
+
+void cache_begin(CacheRun *run, const char *key, size_t limit)
+{
+    cache_abandon(run);
+    snprintf(run->key, CACHE_KEY_LEN, "%s", key);
+    run->limit = limit;
+}
+
+int cache_collecting(const CacheRun *run)
+{
+    return run->key[0] != '\0';
+}
+
+void cache_collect(CacheRun *run, int stream, const char *buf, size_t len)
+{
+    if (!run->key[0])
+    {
+        return;
+    }
+    if (run->len[CACHE_STDOUT] + run->len[CACHE_STDERR] + len > run->limit)
+    {
+        cache_abandon(run); // would not fit in the cache anyway
+        return;
+    }
+    if (run->len[stream] + len > run->cap[stream])
+    {
+        size_t cap = run->cap[stream] ? run->cap[stream] * 2 : 65536;
+        while (cap < run->len[stream] + len)
+        {
+            cap *= 2;
+        }
+        char *grown = (char *)realloc(run->data[stream], cap);
+        if (!grown)
+        {
+            cache_abandon(run);
+            return;
+        }
+        run->data[stream] = grown;
+        run->cap[stream] = cap;
+    }
+    memcpy(run->data[stream] + run->len[stream], buf, len);
+    run->len[stream] += len;
+}
+
+void cache_commit(CacheRun *run, int code, unsigned long long cap)
+{
+    char path[256], tmp_path[256], header[64];
+
+    if (!run->key[0])
+    {
+        return;
+    }
+    load();
+    mkdir(CACHE_DIR, 0755);
+    entry_path(run->key, "", path, sizeof(path));
+    entry_path(run->key, ".tmp", tmp_path, sizeof(tmp_path));
+    int header_len = snprintf(header, sizeof(header), HEADER "%d %llu\n", code,
+                              (unsigned long long)run->len[CACHE_STDERR]);
+
+    /* written aside and renamed, so a lookup never sees half an entry */
+    int fd = open(tmp_path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    int ok = (fd != -1 && write(fd, header, header_len) == header_len);
+    for (int stream = CACHE_STDOUT; stream <= CACHE_STDERR; stream++)
+    {
+        for (size_t done = 0; ok && done < run->len[stream];)
+        {
+            ssize_t n = write(fd, run->data[stream] + done, run->len[stream] - done);
+            if (n == -1 && errno == EINTR)
+            {
+                continue;
+            }
+            ok = (n > 0);
+            done += (n > 0) ? n : 0;
+        }
+    }
+    if (fd != -1)
+    {
+        close(fd);
+    }
+    if (ok && rename(tmp_path, path) == 0)
+    {
+        add(run->key, header_len + run->len[CACHE_STDOUT] + run->len[CACHE_STDERR], now_ns());
+        counts.stores++;
+    }
+    else
+    {
+        unlink(tmp_path);
+    }
+    cache_abandon(run);
+    cache_trim(cap);
+}
+
+void cache_abandon(CacheRun *run)
+{
+    for (int i = 0; i < 2; i++)
+    {
+        free(run->data[i]);
+        run->data[i] = NULL;
+        run->len[i] = run->cap[i] = 0;
+    }
+    run->key[0] = '\0';
+}
+
+void cache_trim(unsigned long long cap)
+{
+    load();
+    while (num_entries > 0 && counts.bytes > cap)
+    {
+        Entry *oldest = &entries[0];
+        for (size_t i = 1; i < num_entries; i++)
+        {
+            if (entries[i].used < oldest->used)
+            {
+                oldest = &entries[i];
+            }
+        }
+        remove_entry(oldest);
+        counts.evictions++;
+    }
+}
+
+void cache_clear(void)
+{
+    load();
+    while (num_entries > 0)
+    {
+        remove_entry(&entries[0]);
+    }
+}
+
+void cache_stats(CacheStats *stats)
+{
+    load();
+    *stats = counts;
+}
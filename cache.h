@@ -0,0 +1,79 @@
+#ifndef CACHE_H
+#define CACHE_H
+
+#include <stddef.h>
+
+/* Content-addressed results of earlier runs, kept on disk in CACHE_DIR: the
+ * captured stdout and stderr and exit code of a command, under a key naming the
+ * executable, the arguments and the input file. Entries beyond the size cap
+ * are evicted least recently used first. The two streams are kept apart, so
+ * how their writes interleaved is not kept. */
+
+#define CACHE_DIR ".taskman-cache"
+#define CACHE_KEY_LEN 33 /* 32 hex digits and the terminator */
+
+/* Streams of a collection. */
+#define CACHE_STDOUT 0
+#define CACHE_STDERR 1
+
+/* Output being collected for an entry while a task runs. */
+typedef struct CacheRun
+{
+    char key[CACHE_KEY_LEN]; // entry the output goes to, "" when not collecting
+    char *data[2];           // output so far, by stream
+    size_t len[2], cap[2];
+    size_t limit;            // collecting is given up past this many bytes of both streams
+} CacheRun;
+
+/* Counters since the start, and what is on disk. */
+typedef struct CacheStats
+{
+    unsigned long hits;
+    unsigned long misses;
+    unsigned long stores;
+    unsigned long evictions;
+    size_t entries;
+    unsigned long long bytes;
+} CacheStats;
+
+/* Prepares a collection, none under way. */
+void cache_run_init(CacheRun *run);
+
+/* Computes the key of running executable (a path) with argv and stdin from
+ * input_file (NULL for none). Files are identified by device, inode, size and
+ * modification time. Returns 0, or -1 if a file cannot be found. */
+int cache_key(const char *executable, char *const argv[], const char *input_file, char key[CACHE_KEY_LEN]);
+
+/* Looks an entry up and counts a hit or a miss. On a hit returns 0 and sets
+ * *data (to be freed by the caller) to *out_len bytes of stdout followed by
+ * *err_len bytes of stderr, and *code; the entry becomes the most recently
+ * used. Returns -1 on a miss. */
+int cache_lookup(const char *key, char **data, size_t *out_len, size_t *err_len, int *code);
+
+/* Starts collecting output for key, up to limit bytes. */
+void cache_begin(CacheRun *run, const char *key, size_t limit);
+
+/* Returns 1 if a collection is under way. */
+int cache_collecting(const CacheRun *run);
+
+/* Adds output of a stream (CACHE_STDOUT or CACHE_STDERR) to a collection; does
+ * nothing if none is under way. */
+void cache_collect(CacheRun *run, int stream, const char *buf, size_t len);
+
+/* Stores the collected output with its exit code, then evicts entries until
+ * all fit in cap bytes. Ends the collection. */
+void cache_commit(CacheRun *run, int code, unsigned long long cap);
+
+/* Ends a collection without storing anything. */
+void cache_abandon(CacheRun *run);
+
+/* Evicts least recently used entries until all fit in cap bytes. */
+void cache_trim(unsigned long long cap);
+
+/* Removes every entry. */
+void cache_clear(void);
+
+/* Fills in the counters. */
+void cache_stats(CacheStats *stats);
+
+#endif /*CACHE_H*/
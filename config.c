@@ -0,0 +1,68 @@
+/* Runtime settings, changed with the set built-in. */
+
+#include <string.h>
+
+#include "config.h"
+
+typedef struct
+{
+    const char *name; // name used by set
+    long value;       // current value
+    long min;         // smallest value accepted
+    long max;         // largest value accepted
+    const char *help; // shown when listing settings
+} ConfigKnob;
+
+static ConfigKnob knobs[CFG_COUNT] = {
+    {"ring_kb", 64, 1, 1024 * 1024, "output kept in memory per task (KiB)"},
+    {"pool_mb", 64, 1, 1024 * 1024, "memory cap for all kept output (MiB)"},
+    {"echo", 1, 0, 1, "copy background output to the terminal (0/1)"},
+    {"log_mb", 64, 0, 1024 * 1024, "rotate a task's log at this size (MiB, 0 = never)"},
+    {"log_keep", 4, 0, 1000, "rotated log segments kept per task"},
+    {"logs_mb", 1024, 0, 1024 * 1024, "cap on all task logs together (MiB, 0 = none)"},
+    {"log_gzip", 1, 0, 1, "compress rotated log segments (0/1)"},
+    {"keep_done", 0, 0, 1000000000, "finished tasks kept in the task list (0 = all)"},
+    {"keep_secs", 0, 0, 1000000000, "seconds a finished task is kept (0 = forever)"},
+    {"cache_mb", 0, 0, 1024 * 1024, "reuse results of identical runs, cache size (MiB, 0 = off)"},
+    {"spawn_rate", 0, 0, 1000000, "bg/log launches per second (0 = unlimited)"},
+    {"spawn_burst", 10, 1, 1000000, "launches allowed in a burst above spawn_rate"},
+    {"psi_cpu", 0, 0, 100, "hold launches above this CPU pressure (avg10 %, 0 = off)"},
+    {"psi_memory", 0, 0, 100, "hold launches above this memory pressure (avg10 %, 0 = off)"},
+    {"psi_io", 0, 0, 100, "hold launches above this IO pressure (avg10 %, 0 = off)"},
+    {"subreaper", 0, 0, 1, "adopt orphaned descendants, tasks end with their whole tree (0/1)"},
+    {"shed_psi", 0, 0, 100, "suspend bg tasks above this memory pressure (avg10 %, 0 = off)"},
+    {"shed_avail_mb", 0, 0, 1024 * 1024, "suspend bg tasks below this available memory (MiB, 0 = off)"},
+    {"shed_secs", 10, 1, 3600, "seconds between automatic suspends or resumes"},
+};
+
+long config_get(int key)
+{
+    return knobs[key].value;
+}
+
+int config_set(const char *name, long value)
+{
+    for (int i = 0; i < CFG_COUNT; i++)
+    {
+        if (strcmp(name, knobs[i].name) == 0)
+        {
+            if (value < knobs[i].min || value > knobs[i].max)
+            {
+                return -1;
+            }
+            knobs[i].value = value;
+            return i;
+        }
+    }
+    return -1;
+}
+
+const char *config_name(int key)
+{
+    return knobs[key].name;
+}
+
+const char *config_help(int key)
+{
+    return knobs[key].help;
+}
@@ -0,0 +1,38 @@
+#ifndef CONFIG_H
+#define CONFIG_H
+
+/* Runtime settings, changed with the set built-in. */
+#define CFG_RING_KB  0 /* output kept in memory per task, in KiB */
+#define CFG_POOL_MB  1 /* memory cap shared by all output buffers, in MiB */
+#define CFG_ECHO     2 /* 1 to also copy background output to the terminal */
+#define CFG_LOG_MB   3 /* size at which a task's log is rotated, in MiB (0 for no limit) */
+#define CFG_LOG_KEEP 4 /* rotated segments kept per task */
+#define CFG_LOGS_MB  5 /* cap on all task logs together, in MiB (0 for no limit) */
+#define CFG_LOG_GZIP 6 /* 1 to compress rotated segments in the background */
+#define CFG_KEEP_DONE 7 /* finished tasks kept in the task list (0 for all) */
+#define CFG_KEEP_SECS 8 /* seconds a finished task is kept (0 for no limit) */
+#define CFG_CACHE_MB 9 /* size of the result cache, in MiB (0 to turn it off) */
+#define CFG_SPAWN_RATE  10 /* bg and log launches per second (0 for no limit) */
+#define CFG_SPAWN_BURST 11 /* launches allowed in a burst above that rate */
+#define CFG_PSI_CPU     12 /* CPU pressure (some avg10, %) above which launches wait (0 for none) */
+#define CFG_PSI_MEMORY  13 /* same for memory pressure */
+#define CFG_PSI_IO      14 /* same for IO pressure */
+#define CFG_SUBREAPER   15 /* 1 to adopt orphaned descendants of tasks (PR_SET_CHILD_SUBREAPER) */
+#define CFG_SHED_PSI    16 /* memory pressure (some avg10, %) above which background tasks are suspended (0 for none) */
+#define CFG_SHED_AVAIL_MB 17 /* available memory (MiB) below which they are suspended (0 for none) */
+#define CFG_SHED_SECS   18 /* seconds between two automatic suspends or resumes */
+#define CFG_COUNT    19
+
+/* Returns the current value of a setting. */
+long config_get(int key);
+
+/* Changes the setting with the given name. Returns its key, or -1 if the name or value is invalid. */
+int config_set(const char *name, long value);
+
+/* Returns the name of a setting. */
+const char *config_name(int key);
+
+/* Returns a one line description of a setting. */
+const char *config_help(int key);
+
+#endif /*CONFIG_H*/
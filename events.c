@@ -0,0 +1,157 @@
+/* The event loop: an epoll instance watching the command line, a pidfd for every
+ * child process and a signalfd for SIGCHLD.
+ *
+ * Exits are read from each child's own pidfd, so a task's state never depends on
+ * SIGCHLD delivery (which coalesces) or on mapping a possibly recycled pid back to
+ * a task. SIGCHLD is only used as a hint that a child has stopped or continued. */
+
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <signal.h>
+#include <sys/epoll.h>
+#include <sys/signalfd.h>
+#include <sys/syscall.h>
+#include <sys/wait.h>
+
+#include "events.h"
+
+#ifndef P_PIDFD
+#define P_PIDFD 3
+#endif
+
+#ifndef PIDFD_SIGNAL_PROCESS_GROUP
+#define PIDFD_SIGNAL_PROCESS_GROUP (1UL << 2)
+#endif
+
+static int epoll_fd = -1;
+static sigset_t saved_mask;
+
+int ev_init(void)
+{
+    epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    return (epoll_fd == -1) ? -1 : 0;
+}
+
+static int add(EvWatch *watch, int fd, int kind, void *owner, unsigned int events)
+{
+    struct epoll_event event;
+    memset(&event, 0, sizeof(event));
+    event.events = events;
+    event.data.ptr = watch;
+
+    watch->fd = fd;
+    watch->kind = kind;
+    watch->owner = owner;
+    if (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, fd, &event) == -1)
+    {
+        watch->fd = -1;
+        return -1;
+    }
+    return 0;
+}
+
+int ev_add(EvWatch *watch, int fd, int kind, void *owner)
+{
+    return add(watch, fd, kind, owner, EPOLLIN);
+}
+
+int ev_add_writable(EvWatch *watch, int fd, int kind, void *owner)
+{
+    return add(watch, fd, kind, owner, EPOLLOUT);
+}
+
+void ev_del(EvWatch *watch)
+{
+    if (watch->fd == -1)
+    {
+        return;
+    }
+    epoll_ctl(epoll_fd, EPOLL_CTL_DEL, watch->fd, NULL);
+    watch->fd = -1;
+}
+
+void ev_enable(EvWatch *watch, int enable)
+{
+    struct epoll_event event;
+    memset(&event, 0, sizeof(event));
+    event.events = enable ? EPOLLIN : 0;
+    event.data.ptr = watch;
+    if (watch->fd != -1)
+    {
+        epoll_ctl(epoll_fd, EPOLL_CTL_MOD, watch->fd, &event);
+    }
+}
+
+int ev_wait(EvWatch **ready, int max, int timeout_ms)
+{
+    struct epoll_event events[64];
+    if (max > 64)
+    {
+        max = 64;
+    }
+    int count = epoll_wait(epoll_fd, events, max, timeout_ms);
+    if (count == -1)
+    {
+        return 0; // EINTR: control-c and control-z are still handled by sigaction
+    }
+    for (int i = 0; i < count; i++)
+    {
+        ready[i] = events[i].data.ptr;
+    }
+    return count;
+}
+
+int ev_sigchld_fd(void)
+{
+    sigset_t mask;
+    sigemptyset(&mask);
+    sigaddset(&mask, SIGCHLD);
+    if (sigprocmask(SIG_BLOCK, &mask, &saved_mask) == -1)
+    {
+        return -1;
+    }
+    return signalfd(-1, &mask, SFD_NONBLOCK | SFD_CLOEXEC);
+}
+
+void ev_child_reset(void)
+{
+    sigprocmask(SIG_SETMASK, &saved_mask, NULL);
+}
+
+int pidfd_open_pid(pid_t pid)
+{
+    return (int)syscall(SYS_pidfd_open, pid, 0); // pidfds are always close-on-exec
+}
+
+int pidfd_signal_group(int pidfd, pid_t pgid, int sig)
+{
+    static int group_flag_supported = 1;
+    if (group_flag_supported)
+    {
+        if (syscall(SYS_pidfd_send_signal, pidfd, sig, NULL, PIDFD_SIGNAL_PROCESS_GROUP) == 0)
+        {
+            return 0;
+        }
+        if (errno != EINVAL)
+        {
+            return -1;
+        }
+        group_flag_supported = 0; // before Linux 6.9
+    }
+    return killpg(pgid, sig);
+}
+
+int pidfd_wait(int pidfd, siginfo_t *info, int options)
+{
+    memset(info, 0, sizeof(siginfo_t));
+    return waitid((idtype_t)P_PIDFD, pidfd, info, options | WNOHANG);
+}
+
+int pidfd_reap(int pidfd, siginfo_t *info, struct rusage *usage)
+{
+    memset(info, 0, sizeof(siginfo_t));
+    memset(usage, 0, sizeof(struct rusage));
+    return (int)syscall(SYS_waitid, P_PIDFD, pidfd, info, WEXITED | WNOHANG, usage);
+}
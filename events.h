@@ -0,0 +1,69 @@
+#ifndef EVENTS_H
+#define EVENTS_H
+
+#include <signal.h>
+#include <sys/types.h>
+#include <sys/resource.h>
+
+/* Kinds of file descriptors watched by the event loop */
+#define EV_STDIN   0 /* the command line */
+#define EV_TASK    1 /* pidfd of a task's process */
+#define EV_HELPER  2 /* pidfd of a helper process that only needs to be reaped */
+#define EV_SIGCHLD 3 /* signalfd receiving SIGCHLD (stops and continues) */
+#define EV_OUTPUT  4 /* pipe carrying a background task's stdout and stderr */
+#define EV_WATCH   5 /* inotify descriptor reporting changes to files of watched tasks */
+#define EV_DEBOUNCE 6 /* timerfd ending a burst of such changes */
+#define EV_ADMIT   7 /* timerfd for retrying launches held back by admission control */
+#define EV_BENCH   8 /* pidfd of a run started by bench */
+#define EV_MAP     9 /* pipe or pidfd of an instance started by map */
+
+/* One watched file descriptor. The watch is handed back by ev_wait(), so it is
+ * usually embedded in the structure it belongs to (owner). */
+typedef struct EvWatch
+{
+    int fd;      // watched file descriptor, -1 if not registered
+    int kind;    // EV_* kind, used to dispatch the event
+    void *owner; // structure the fd belongs to (e.g. a task)
+} EvWatch;
+
+/* Creates the epoll instance. Returns 0 on success, -1 on failure. */
+int ev_init(void);
+
+/* Starts watching fd for input. Returns 0 on success, -1 on failure. */
+int ev_add(EvWatch *watch, int fd, int kind, void *owner);
+
+/* Starts watching fd for room to write. Returns 0 on success, -1 on failure. */
+int ev_add_writable(EvWatch *watch, int fd, int kind, void *owner);
+
+/* Stops watching (the fd itself is left open). */
+void ev_del(EvWatch *watch);
+
+/* Turns reporting of a registered watch off or on without removing it. */
+void ev_enable(EvWatch *watch, int enable);
+
+/* Waits up to timeout_ms (-1 for ever) and stores up to max ready watches.
+ * Returns the number stored; 0 on timeout or when interrupted by a signal. */
+int ev_wait(EvWatch **ready, int max, int timeout_ms);
+
+/* Blocks SIGCHLD and returns a signalfd that receives it instead, or -1. */
+int ev_sigchld_fd(void);
+
+/* Restores the signal mask in a forked child before exec. */
+void ev_child_reset(void);
+
+/* Returns a pidfd for a child that has not been reaped yet, or -1. */
+int pidfd_open_pid(pid_t pid);
+
+/* Sends sig to the process group led by the pidfd's process.
+ * pgid is only used on kernels that cannot signal a group through a pidfd;
+ * it is safe there because the leader cannot be reaped while its pidfd is unwaited. */
+int pidfd_signal_group(int pidfd, pid_t pgid, int sig);
+
+/* waitid() on a pidfd. Returns 0 with info->si_pid set if the child changed state. */
+int pidfd_wait(int pidfd, siginfo_t *info, int options);
+
+/* Reaps an exited child through its pidfd, like pidfd_wait(..., WEXITED), and
+ * also fills in its resource usage (the raw waitid system call reports it). */
+int pidfd_reap(int pidfd, siginfo_t *info, struct rusage *usage);
+
+#endif /*EVENTS_H*/
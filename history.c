@@ -0,0 +1,71 @@
+/* Fixed-size per-task run history. */
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#include "history.h"
+
+static int64_t now_ms(void)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_REALTIME, &now);
+    return (int64_t)now.tv_sec * 1000 + now.tv_nsec / 1000000;
+}
+
+void history_init(RunHistory *h)
+{
+    memset(h, 0, sizeof(RunHistory));
+}
+
+void history_begin(RunHistory *h, pid_t pid, int mode)
+{
+    if (h->total > 0 && h->runs[(h->total - 1) % HISTORY_RUNS].kind == HISTORY_RUNNING)
+    {
+        history_end(h, HISTORY_ABANDONED, 0, 0, 0, 0);
+    }
+    RunRecord *run = &h->runs[h->total % HISTORY_RUNS];
+    memset(run, 0, sizeof(RunRecord));
+    run->start_ms = now_ms();
+    run->pid = pid;
+    run->kind = HISTORY_RUNNING;
+    run->mode = (uint8_t)mode;
+    h->total++;
+}
+
+void history_end(RunHistory *h, int kind, int code, unsigned long cpu_ms, unsigned long max_rss_kb,
+                 unsigned long adopted)
+{
+    if (h->total == 0)
+    {
+        return;
+    }
+    RunRecord *run = &h->runs[(h->total - 1) % HISTORY_RUNS];
+    int64_t duration = now_ms() - run->start_ms;
+    run->duration_ms = (duration < 0) ? 0 : (duration > UINT32_MAX) ? UINT32_MAX : (uint32_t)duration;
+    run->cpu_ms = (cpu_ms > UINT32_MAX) ? UINT32_MAX : (uint32_t)cpu_ms;
+    run->max_rss_kb = (max_rss_kb > UINT32_MAX) ? UINT32_MAX : (uint32_t)max_rss_kb;
+    run->adopted = (adopted > UINT16_MAX) ? UINT16_MAX : (uint16_t)adopted;
+    run->code = (int16_t)code;
+    run->kind = (uint8_t)kind;
+}
+
+const RunRecord *history_run(const RunHistory *h, unsigned long n)
+{
+    if (n >= h->total || h->total - n > HISTORY_RUNS)
+    {
+        return NULL;
+    }
+    return &h->runs[n % HISTORY_RUNS];
+}
+
+void history_format_time(int64_t ms, char *buffer, size_t size)
+{
+    struct tm local;
+    time_t seconds = (time_t)(ms / 1000);
+    localtime_r(&seconds, &local);
+    size_t len = strftime(buffer, size, "%Y-%m-%d %H:%M:%S", &local);
+    snprintf(buffer + len, size - len, ".%03d", (int)(ms % 1000));
+}
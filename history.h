@@ -0,0 +1,62 @@
+#ifndef HISTORY_H
+#define HISTORY_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+/* Outcomes of the last HISTORY_RUNS runs of a task, oldest overwritten first.
+ * The records are fixed-size and live in the task itself, so the cost is
+ * sizeof(RunHistory) per task whatever it runs. */
+
+#define HISTORY_RUNS 8
+
+/* How a run ended (RunRecord.kind) */
+#define HISTORY_RUNNING   0 /* not reaped yet */
+#define HISTORY_EXITED    1 /* code is the exit code */
+#define HISTORY_SIGNALED  2 /* code is the signal */
+#define HISTORY_CACHED    3 /* answered from the result cache; code is the exit code */
+#define HISTORY_ABANDONED 4 /* restarted before the previous process was reaped */
+
+/* How a run was started (RunRecord.mode) */
+#define HISTORY_FG  0 /* run */
+#define HISTORY_BG  1 /* bg */
+#define HISTORY_LOG 2 /* log */
+
+typedef struct RunRecord
+{
+    int64_t start_ms;     // wall clock time of the start, in ms since the epoch
+    uint32_t duration_ms; // wall time of the run (saturates at about 49 days)
+    int32_t pid;          // process of the run, 0 if none was started
+    uint32_t cpu_ms;      // user and system CPU time of the process and its reaped children
+    uint32_t max_rss_kb;  // largest resident set of any one of those processes, in KiB
+    int16_t code;         // exit code or signal, see kind
+    uint8_t kind;         // HISTORY_* outcome
+    uint8_t mode;         // HISTORY_FG, HISTORY_BG or HISTORY_LOG
+    uint16_t adopted;     // orphaned descendants reaped in subreaper mode, counted in cpu_ms and max_rss_kb
+} RunRecord;
+
+typedef struct RunHistory
+{
+    RunRecord runs[HISTORY_RUNS]; // run number n is in runs[n % HISTORY_RUNS]
+    uint32_t total;               // runs recorded so far
+} RunHistory;
+
+/* Initializes an empty history. */
+void history_init(RunHistory *h);
+
+/* Records the start of a run. A run still open is marked abandoned. */
+void history_begin(RunHistory *h, pid_t pid, int mode);
+
+/* Records the end of the latest run: kind HISTORY_EXITED, HISTORY_SIGNALED or
+ * HISTORY_CACHED (a run that started and ended at once). */
+void history_end(RunHistory *h, int kind, int code, unsigned long cpu_ms, unsigned long max_rss_kb,
+                 unsigned long adopted);
+
+/* Returns run number n (0 is the first), or NULL if it was never recorded or has been overwritten. */
+const RunRecord *history_run(const RunHistory *h, unsigned long n);
+
+/* Formats a start time as local "YYYY-MM-DD HH:MM:SS.mmm". */
+void history_format_time(int64_t ms, char *buffer, size_t size);
+
+#endif /*HISTORY_H*/
@@ -0,0 +1,132 @@
+/* Refcounted string interning table (chained hashing). */
+
+#include <stdlib.h>
+#include <string.h>
+#include <stddef.h>
+
+#include "intern.h"
+
+typedef struct Interned
+{
+    struct Interned *next; // next entry in the same bucket
+    size_t refs;           // references handed out
+    size_t len;            // length without the terminator
+    unsigned int hash;     // hash of the string
+    char text[];           // the string itself
+} Interned;
+
+static Interned **buckets = NULL;
+static size_t num_buckets = 0;
+static InternStats counts;
+
+static unsigned int hash_string(const char *s, size_t len)
+{
+    unsigned int hash = 2166136261u; // FNV-1a
+    for (size_t i = 0; i < len; i++)
+    {
+        hash = (hash ^ (unsigned char)s[i]) * 16777619u;
+    }
+    return hash;
+}
+
+static Interned *entry_of(const char *s)
+{
+    return (Interned *)(s - offsetof(Interned, text));
+}
+
+/* Doubles the number of buckets once there are more strings than buckets. */
+static void grow(void)
+{
+    size_t size = num_buckets ? num_buckets * 2 : 256;
+    Interned **grown = (Interned **)calloc(size, sizeof(Interned *));
+    if (!grown)
+    {
+        return; // keep the longer chains
+    }
+    for (size_t i = 0; i < num_buckets; i++)
+    {
+        Interned *entry = buckets[i];
+        while (entry)
+        {
+            Interned *next = entry->next;
+            entry->next = grown[entry->hash & (size - 1)];
+            grown[entry->hash & (size - 1)] = entry;
+            entry = next;
+        }
+    }
+    free(buckets);
+    buckets = grown;
+    num_buckets = size;
+}
+
+char *intern(const char *s)
+{
+    size_t len = strlen(s);
+    unsigned int hash = hash_string(s, len);
+
+    if (counts.strings >= num_buckets)
+    {
+        grow();
+        if (!buckets)
+        {
+            return NULL;
+        }
+    }
+    Interned **bucket = &buckets[hash & (num_buckets - 1)];
+    for (Interned *entry = *bucket; entry; entry = entry->next)
+    {
+        if (entry->hash == hash && entry->len == len && memcmp(entry->text, s, len) == 0)
+        {
+            entry->refs++;
+            counts.references++;
+            counts.bytes_shared += len + 1;
+            return entry->text;
+        }
+    }
+
+    Interned *entry = (Interned *)malloc(sizeof(Interned) + len + 1);
+    if (!entry)
+    {
+        return NULL;
+    }
+    memcpy(entry->text, s, len + 1);
+    entry->len = len;
+    entry->hash = hash;
+    entry->refs = 1;
+    entry->next = *bucket;
+    *bucket = entry;
+    counts.strings++;
+    counts.references++;
+    counts.bytes_stored += len + 1;
+    counts.bytes_shared += len + 1;
+    return entry->text;
+}
+
+void intern_release(const char *s)
+{
+    if (!s)
+    {
+        return;
+    }
+    Interned *entry = entry_of(s);
+    counts.references--;
+    counts.bytes_shared -= entry->len + 1;
+    if (--entry->refs > 0)
+    {
+        return;
+    }
+    Interned **link = &buckets[entry->hash & (num_buckets - 1)];
+    while (*link != entry)
+    {
+        link = &(*link)->next;
+    }
+    *link = entry->next;
+    counts.strings--;
+    counts.bytes_stored -= entry->len + 1;
+    free(entry);
+}
+
+void intern_stats(InternStats *stats)
+{
+    *stats = counts;
+}
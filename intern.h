@@ -0,0 +1,26 @@
+#ifndef INTERN_H
+#define INTERN_H
+
+#include <stddef.h>
+
+/* Interned strings: identical strings are stored once and shared, with a
+ * reference count. They must never be modified. */
+
+typedef struct InternStats
+{
+    size_t strings;       // distinct strings stored
+    size_t references;    // references handed out and not released
+    size_t bytes_stored;  // bytes of the distinct strings (with their terminators)
+    size_t bytes_shared;  // bytes that one copy per reference would take
+} InternStats;
+
+/* Returns the shared copy of s, adding a reference to it. NULL if out of memory. */
+char *intern(const char *s);
+
+/* Drops a reference taken with intern(); the string is freed with its last one. NULL is ignored. */
+void intern_release(const char *s);
+
+/* Fills in the current counts. */
+void intern_stats(InternStats *stats);
+
+#endif /*INTERN_H*/
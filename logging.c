@@ -14,7 +14,7 @@
 #define textproc_write(s) char output[BUFSIZE] = {0}; snprintf(output,BUFSIZE-1,"\033[1;31m%s%s\033[0m", log_head, s); write(STDERR_FILENO, output, strlen(output));
 
 static const char *log_head = "[AALOG] ";
-static const char *task_state[] = { "Standby", "Working", "Suspended", "Complete", "Killed", NULL };
+static const char *task_state[] = { "Standby", "Working", "Suspended", "Complete", "Killed", "Pending", NULL };
 
 /* Outputs an Introductory message at the start of the program */
 void log_intro() { 
@@ -28,11 +28,24 @@ void log_help() {
   textproc_log("    <COMMAND> [<ARGS>...],\n");
   textproc_log("    help, quit, tasks, delete <TASK>,\n");
   textproc_log("    run <TASK> [<FILE>],\n");
-  textproc_log("    bg <TASK> [<FILE>], cancel <TASK>\n");
-  textproc_log("    log <TASK> [<FILE>], output <TASK>\n");
-  textproc_log("    suspend <TASK>, resume <TASK>\n");
+  textproc_log("    bg <TASK> [<FILE>], cancel <TASKS>\n");
+  textproc_log("    log <TASK> [<FILE>],\n");
+  textproc_log("    output <TASK> [--lines <FIRST>:<LAST> | --tail <N>]\n");
+  textproc_log("    suspend <TASKS>, resume <TASKS>\n");
+  textproc_log("    renice <TASK> <interactive|normal|batch|idle>\n");
+  textproc_log("    tag <NAME> <TASKS>, untag <NAME> <TASKS>\n");
+  textproc_log("    top [<SECONDS>] [<COUNT>], set [<NAME> <VALUE>]\n");
+  textproc_log("    bench <TASK> <N> [--warmup <K>] [--parallel <P>]\n");
+  textproc_log("    search <PATTERN>, follow <TASK>, mem\n");
+  textproc_log("    broadcast <FILE> <TASKS>, map <TASK> <FILE> [--jobs <N>] [--chunk <SIZE>]\n");
+  textproc_log("    metrics [<PORT> | <PATH> | off], trace [on | off | dump <FILE>]\n");
+  textproc_log("    cache [clear], watch <TASK> [<FILE>], unwatch <TASK>\n");
+  textproc_log("    wait <TASKS>, waitany, waitall [--timeout <SECONDS>], history <TASK>\n");
+  textproc_log("    admission\n");
   textproc_log("\n");
   textproc_log("Brackets denote optional arguments\n");
+  textproc_log("<TASKS> is any mix of IDs (3), ranges (1-5), lists (1,4,7),\n");
+  textproc_log("    states (working, suspended, pending, ...), tags (@NAME) and all\n");
 }
 
 /* Outputs the message after running quit */
@@ -90,6 +103,20 @@ void log_run_error(const char *line) {
   textproc_log(buffer);
 }
 
+/* Output when the process of a task cannot be started or tracked */
+void log_launch_error(int task_id, const char *cmd, const char *reason) {
+  char buffer[BUFSIZE] = {0};
+  snprintf(buffer, BUFSIZE, "Error: Cannot launch Task ID #%d: %s (%s)\n", task_id, cmd, reason);
+  textproc_log(buffer);
+}
+
+/* Output when a task cannot be deleted because its run is still winding down */
+void log_delete_error(int task_id) {
+  char buffer[BUFSIZE] = {0};
+  snprintf(buffer, BUFSIZE, "Error: Cannot delete Task ID #%d while its process or output is still open\n", task_id);
+  textproc_log(buffer);
+}
+
 /* Output when activating a new task */
 void log_task_init(int task_id, const char *cmd) {
   char buffer[BUFSIZE] = {0};
@@ -148,21 +175,431 @@ void log_num_tasks(int num_tasks){
   textproc_log(buffer);
 }
 
+/* Output a summary of the finished tasks removed by the retention policy */
+void log_evicted(long evicted, long complete, long failed, long killed) {
+  char buffer[BUFSIZE] = {0};
+  snprintf(buffer, BUFSIZE, "%ld finished task(s) removed: %ld complete, %ld with errors, %ld killed\n",
+           evicted, complete, failed, killed);
+  textproc_log(buffer);
+}
+
+/* Output the memory report of the mem built-in */
+void log_mem_report(int tasks, size_t task_bytes, size_t strings, size_t references,
+                    size_t stored, size_t shared, size_t output_bytes) {
+  char buffer[BUFSIZE] = {0};
+  snprintf(buffer, BUFSIZE, "Tasks: %d using %zu bytes of task records\n", tasks, task_bytes);
+  textproc_log(buffer);
+  snprintf(buffer, BUFSIZE, "Strings: %zu distinct for %zu uses, %zu bytes stored instead of %zu (dedup ratio %.2fx)\n",
+           strings, references, stored, shared, stored ? (double)shared / stored : 1.0);
+  textproc_log(buffer);
+  snprintf(buffer, BUFSIZE, "Captured output: %zu bytes\n", output_bytes);
+  textproc_log(buffer);
+}
+
+/* Output when broadcast starts tasks on a file (count -1 on error, file NULL for a usage error) */
+void log_broadcast(const char *file, int count) {
+  char buffer[BUFSIZE] = {0};
+  if (!file)
+  { snprintf(buffer, BUFSIZE, "Usage: broadcast <FILE> <TASKS>\n"); }
+  else if (count < 0)
+  { snprintf(buffer, BUFSIZE, "Error: Cannot broadcast %s\n", file); }
+  else
+  { snprintf(buffer, BUFSIZE, "Broadcasting %s to %d task(s)\n", file, count); }
+  textproc_log(buffer);
+}
+
+/* Output when map cannot run (file NULL for a usage error) */
+void log_map_error(int task_id, const char *file) {
+  char buffer[BUFSIZE] = {0};
+  if (!file)
+  { snprintf(buffer, BUFSIZE, "Usage: map <TASK> <FILE> [--jobs <N>] [--chunk <SIZE>[K|M|G]]\n"); }
+  else
+  { snprintf(buffer, BUFSIZE, "Error: Cannot map Task ID #%d over %s\n", task_id, file); }
+  textproc_log(buffer);
+}
+
+/* Output for each task a wait built-in saw finish */
+void log_wait_result(int task_id, const char *cmd, int status, int exit_code, int signal) {
+  char buffer[BUFSIZE] = {0};
+  if (status == LOG_STATE_COMPLETE)
+  { snprintf(buffer, BUFSIZE, "Task %d (%s): Complete, exit code %d\n", task_id, cmd, exit_code); }
+  else if (status == LOG_STATE_KILLED && signal)
+  { snprintf(buffer, BUFSIZE, "Task %d (%s): Killed by signal %d\n", task_id, cmd, signal); }
+  else
+  { snprintf(buffer, BUFSIZE, "Task %d (%s): %s\n", task_id, cmd, task_state[status]); }
+  textproc_log(buffer);
+}
+
+/* Output at the end of a wait built-in (reason: 0 done, else the timeout or control-c status) */
+void log_wait_done(int finished, int remaining, int status, int reason) {
+  char buffer[BUFSIZE] = {0};
+  snprintf(buffer, BUFSIZE, "Wait %s: %d finished, %d still running; status %d\n",
+           reason == 124 ? "timed out" : (reason ? "interrupted" : "done"), finished, remaining, status);
+  textproc_log(buffer);
+}
+
+/* Output when a wait built-in is used wrongly */
+void log_wait_usage() {
+  textproc_log("Usage: wait <TASKS> | waitany | waitall, with optional --timeout <SECONDS>\n");
+}
+
+/* Output before the runs listed by history */
+void log_history_header(int task_id, const char *cmd, unsigned long total, unsigned long shown) {
+  char buffer[BUFSIZE] = {0};
+  snprintf(buffer, BUFSIZE, "History of Task %d (%s): %lu run(s), last %lu shown\n", task_id, cmd, total, shown);
+  textproc_log(buffer);
+}
+
+/* Output for one run listed by history (duration_ms -1 while it runs) */
+void log_history_run(unsigned long number, const char *start, long duration_ms, const char *mode, int pid,
+                     const char *outcome, unsigned long cpu_ms, unsigned long max_rss_kb, unsigned adopted) {
+  char buffer[BUFSIZE] = {0};
+  char duration[32] = "-";
+  char tree[32] = "";
+  if (duration_ms >= 0)
+  { snprintf(duration, sizeof(duration), "%.3fs", duration_ms / 1000.0); }
+  if (adopted > 0)
+  { snprintf(tree, sizeof(tree), "  (tree of %u)", adopted + 1); }
+  snprintf(buffer, BUFSIZE, "  #%-4lu %s  %9s  %-3s  PID %-7d %-20s cpu %.3fs  rss %.1fM%s\n",
+           number, start, duration, mode, pid, outcome, cpu_ms / 1000.0, max_rss_kb / 1024.0, tree);
+  textproc_log(buffer);
+}
+
+/* Output when history is used wrongly */
+void log_history_usage() {
+  textproc_log("Usage: history <TASK>\n");
+}
+
+/* Output when a bg or log launch is held back by admission control */
+void log_pending(int task_id, const char *cmd, const char *reason) {
+  char buffer[BUFSIZE] = {0};
+  snprintf(buffer, BUFSIZE, "Task %d (%s) is Pending (held back by %s)\n", task_id, cmd, reason);
+  textproc_log(buffer);
+}
+
+/* Output when a Pending task is cancelled before it started */
+void log_pending_cancel(int task_id, const char *cmd) {
+  char buffer[BUFSIZE] = {0};
+  snprintf(buffer, BUFSIZE, "Task %d (%s) cancelled before it started\n", task_id, cmd);
+  textproc_log(buffer);
+}
+
+/* Output of the admission built-in: limits and current load (pressure -1 where unknown) */
+void log_admission(long rate, long burst, double tokens, const double pressure[3], const long thresholds[3], int pending) {
+  static const char *names[3] = {"cpu", "memory", "io"};
+  char buffer[BUFSIZE] = {0};
+  if (rate > 0)
+  { snprintf(buffer, BUFSIZE, "Spawn rate: %ld/s, burst %ld, %.1f token(s) left; %d task(s) pending\n", rate, burst, tokens, pending); }
+  else
+  { snprintf(buffer, BUFSIZE, "Spawn rate: unlimited; %d task(s) pending\n", pending); }
+  textproc_log(buffer);
+  for (int i = 0; i < 3; i++) {
+    char now[16] = "n/a", limit[16] = "off";
+    if (pressure[i] >= 0)
+    { snprintf(now, sizeof(now), "%.2f%%", pressure[i]); }
+    if (thresholds[i] > 0)
+    { snprintf(limit, sizeof(limit), "%ld%%", thresholds[i]); }
+    snprintf(buffer, BUFSIZE, "Pressure %-6s %8s (threshold %s)\n", names[i], now, limit);
+    textproc_log(buffer);
+  }
+}
+
+/* Output of the admission built-in: how launches were admitted */
+void log_admission_counts(unsigned long admitted, unsigned long released, const unsigned long deferred[],
+                          const char *const names[], int count) {
+  char buffer[BUFSIZE] = {0};
+  int len = snprintf(buffer, BUFSIZE, "Launches: %lu at once, %lu after waiting; deferred:", admitted, released);
+  for (int i = 1; i < count && len < BUFSIZE; i++)
+  { len += snprintf(buffer + len, BUFSIZE - len, " %s %lu%s", names[i], deferred[i], i + 1 < count ? "," : "\n"); }
+  textproc_log(buffer);
+}
+
+/* Output when a background task is suspended or resumed automatically by memory pressure load shedding */
+void log_shed(int task_id, const char *cmd, int suspended, double pressure, long avail_mb) {
+  char buffer[BUFSIZE] = {0};
+  char now[16] = "n/a", avail[24] = "n/a";
+  if (pressure >= 0)
+  { snprintf(now, sizeof(now), "%.2f%%", pressure); }
+  if (avail_mb >= 0)
+  { snprintf(avail, sizeof(avail), "%ld MiB", avail_mb); }
+  snprintf(buffer, BUFSIZE, "Task %d (%s) %s (memory pressure %s, %s available)\n", task_id, cmd,
+           suspended ? "suspended under memory pressure" : "resumed as memory pressure subsided", now, avail);
+  textproc_log(buffer);
+}
+
+/* Output of the admission built-in: memory pressure load shedding */
+void log_shed_status(long psi_limit, long avail_floor_mb, long avail_mb, int suspended) {
+  char buffer[BUFSIZE] = {0};
+  char limit[16] = "off", floor[24] = "off", avail[24] = "n/a";
+  if (psi_limit > 0)
+  { snprintf(limit, sizeof(limit), "%ld%%", psi_limit); }
+  if (avail_floor_mb > 0)
+  { snprintf(floor, sizeof(floor), "%ld MiB", avail_floor_mb); }
+  if (avail_mb >= 0)
+  { snprintf(avail, sizeof(avail), "%ld MiB", avail_mb); }
+  snprintf(buffer, BUFSIZE, "Shedding: memory pressure above %s or available memory below %s (now %s); %d task(s) suspended\n",
+           limit, floor, avail, suspended);
+  textproc_log(buffer);
+}
+
+/* Output when watch starts or stops following a task's files */
+void log_watch(int task_id, const char *file, int start) {
+  char buffer[BUFSIZE] = {0};
+  if (!start)
+  { snprintf(buffer, BUFSIZE, "Stopped watching Task ID #%d\n", task_id); }
+  else if (file)
+  { snprintf(buffer, BUFSIZE, "Watching Task ID #%d: restarted when its executable or %s changes\n", task_id, file); }
+  else
+  { snprintf(buffer, BUFSIZE, "Watching Task ID #%d: restarted when its executable changes\n", task_id); }
+  textproc_log(buffer);
+}
+
+/* Output when watch is used wrongly */
+void log_watch_usage() {
+  textproc_log("Usage: watch <TASK> [<FILE>], unwatch <TASK>\n");
+}
+
+/* Output when a task's files cannot be watched */
+void log_watch_error(int task_id) {
+  char buffer[BUFSIZE] = {0};
+  snprintf(buffer, BUFSIZE, "Error: Cannot watch the files of Task ID #%d\n", task_id);
+  textproc_log(buffer);
+}
+
+/* Output when a watched task is restarted after its files changed */
+void log_watch_change(int task_id, const char *cmd) {
+  char buffer[BUFSIZE] = {0};
+  snprintf(buffer, BUFSIZE, "Files of Task %d (%s) changed, restarting it\n", task_id, cmd);
+  textproc_log(buffer);
+}
+
+/* Output when a run is answered from the result cache instead of being started */
+void log_cache_hit(int task_id, const char *cmd, int exit_code, size_t bytes) {
+  char buffer[BUFSIZE] = {0};
+  snprintf(buffer, BUFSIZE, "Task %d (%s) taken from the cache: exit code %d, %zu bytes of output\n", task_id, cmd, exit_code, bytes);
+  textproc_log(buffer);
+}
+
+/* Output of the cache built-in (cap_mb -1 for a usage error) */
+void log_cache_stats(unsigned long hits, unsigned long misses, unsigned long stores, unsigned long evictions,
+                     size_t entries, unsigned long long bytes, long cap_mb) {
+  char buffer[BUFSIZE] = {0};
+  if (cap_mb < 0)
+  { textproc_log("Usage: cache [clear]\n"); return; }
+  if (cap_mb)
+  { snprintf(buffer, BUFSIZE, "Result cache: %zu entries, %llu of %ld MiB\n", entries, bytes, cap_mb); }
+  else
+  { snprintf(buffer, BUFSIZE, "Result cache: off (set cache_mb), %zu entries, %llu bytes\n", entries, bytes); }
+  textproc_log(buffer);
+  snprintf(buffer, BUFSIZE, "Hits: %lu, misses: %lu, stored: %lu, evicted: %lu\n", hits, misses, stores, evictions);
+  textproc_log(buffer);
+}
+
+/* Output for a map chunk whose instance failed */
+void log_map_chunk(int chunk, size_t start, size_t end, int code, int signaled) {
+  char buffer[BUFSIZE] = {0};
+  snprintf(buffer, BUFSIZE, "Chunk %d (bytes %zu-%zu) %s %d\n", chunk, start, end,
+           signaled ? "killed by signal" : "exited with code", code);
+  textproc_log(buffer);
+}
+
+/* Output at the end of a map */
+void log_map_summary(int task_id, int chunks, int finished, int failed, int jobs, size_t bytes_out) {
+  char buffer[BUFSIZE] = {0};
+  snprintf(buffer, BUFSIZE, "Map of Task ID #%d: %d/%d chunk(s) done, %d failed, %d job(s), %zu bytes of output\n",
+           task_id, finished, chunks, failed, jobs, bytes_out);
+  textproc_log(buffer);
+}
+
 /* Output info about a single task */
-void log_task_info(int task_id, int status, int exit_code, int pid, const char *cmd){
+void log_task_info(int task_id, int status, int exit_code, int pid, const char *cmd, const char *prio){
   char buffer[BUFSIZE] = {0};
-  if (status < 0 || status >= 5) {
+  if (status < 0 || status > LOG_STATE_PENDING) {
           textproc_write("Invalid input to log_task_info\n");
           return;
   }
   if (!cmd) 
-  { sprintf(buffer, "Task %d: (%s)\n", task_id, task_state[status]); }
-  else if (!pid) 
-  { sprintf(buffer, "Task %d: %s (%s)\n", task_id, cmd, task_state[status]); }
+  { sprintf(buffer, "Task %d: (%s; %s)\n", task_id, task_state[status], prio); }
+  else if (!pid || status == LOG_STATE_PENDING) 
+  { sprintf(buffer, "Task %d: %s (%s; %s)\n", task_id, cmd, task_state[status], prio); }
   else if (status != LOG_STATE_COMPLETE && status != LOG_STATE_KILLED) 
-  { sprintf(buffer, "Task %d: %s (PID %d; %s)\n", task_id, cmd, pid, task_state[status]); }
+  { sprintf(buffer, "Task %d: %s (PID %d; %s; %s)\n", task_id, cmd, pid, task_state[status], prio); }
+  else
+  { sprintf(buffer, "Task %d: %s (PID %d; %s; %s; exit code %d)\n", task_id, cmd, pid, task_state[status], prio, exit_code); }
+
+  textproc_log(buffer);
+}
+
+/* Output when a task's priority class is changed */
+void log_renice(int task_id, int pid, const char *prio) {
+  char buffer[BUFSIZE] = {0};
+  if (!pid)
+  { sprintf(buffer, "Task ID #%d set to %s priority\n", task_id, prio); }
+  else
+  { sprintf(buffer, "Task ID #%d (PID %d) set to %s priority\n", task_id, pid, prio); }
+  textproc_log(buffer);
+}
+
+/* Output when a priority class name is not recognized or cannot be applied */
+void log_prio_error(int task_id, const char *prio) {
+  char buffer[BUFSIZE] = {0};
+  sprintf(buffer, "Error: Cannot set Task ID #%d to priority %s\n", task_id, prio);
+  textproc_log(buffer);
+}
+
+/* Output when a task selection word is not understood */
+void log_selector_error(const char *word) {
+  char buffer[BUFSIZE] = {0};
+  sprintf(buffer, "Error: Invalid task selection %s\n", word);
+  textproc_log(buffer);
+}
+
+/* Output when a tag is added to or removed from tasks */
+void log_tag_change(const char *tag, int count, int added) {
+  char buffer[BUFSIZE] = {0};
+  sprintf(buffer, "Tag %s %s %d task(s)\n", tag, added ? "added to" : "removed from", count);
+  textproc_log(buffer);
+}
+
+/* Output the column titles of the top view */
+void log_top_header() {
+  char buffer[BUFSIZE] = {0};
+  sprintf(buffer, "%6s %8s %6s %10s %4s %12s %12s  %s\n", "TASK", "PID", "CPU%", "RSS(KiB)", "THR", "READ", "WRITE", "COMMAND");
+  textproc_log(buffer);
+}
+
+/* Output one running task in the top view */
+void log_top_row(int task_id, int pid, double cpu, long rss_kb, int threads,
+                 unsigned long long read_bytes, unsigned long long write_bytes, const char *cmd) {
+  char buffer[BUFSIZE] = {0};
+  snprintf(buffer, BUFSIZE, "%6d %8d %6.1f %10ld %4d %12llu %12llu  %s\n", task_id, pid, cpu, rss_kb, threads, read_bytes, write_bytes, cmd);
+  textproc_log(buffer);
+}
+
+/* Output when only the most recent part of a task's output is still kept */
+void log_output_truncated(int task_id, unsigned long bytes) {
+  char buffer[BUFSIZE] = {0};
+  sprintf(buffer, "Earlier output of Task ID #%d dropped, showing the last %lu bytes\n", task_id, bytes);
+  textproc_log(buffer);
+}
+
+/* Output the value of a setting */
+void log_setting(const char *name, long value, const char *help) {
+  char buffer[BUFSIZE] = {0};
+  snprintf(buffer, BUFSIZE, "%-14s %10ld   %s\n", name, value, help);
+  textproc_log(buffer);
+}
+
+/* Output when a setting name or value is not accepted */
+void log_setting_error(const char *name) {
+  char buffer[BUFSIZE] = {0};
+  snprintf(buffer, BUFSIZE, "Error: Invalid setting or value for %s\n", name);
+  textproc_log(buffer);
+}
+
+/* Output when a benchmark cannot be started */
+void log_bench_error(int task_id) {
+  char buffer[BUFSIZE] = {0};
+  sprintf(buffer, "Error: Cannot benchmark Task ID #%d (bench <TASK> <N> [--warmup <K>] [--parallel <P>])\n", task_id);
+  textproc_log(buffer);
+}
+
+/* Output the first line of a benchmark report */
+void log_bench_summary(int task_id, int runs, int warmup, int parallel, int failed) {
+  char buffer[BUFSIZE] = {0};
+  sprintf(buffer, "Bench of Task ID #%d: %d run(s), %d warmup, %d parallel, %d failed\n", task_id, runs, warmup, parallel, failed);
+  textproc_log(buffer);
+}
+
+/* Output the wall time distribution of a benchmark */
+void log_bench_times(double min, double mean, double p50, double p90, double p99, double max, double stddev) {
+  char buffer[BUFSIZE] = {0};
+  snprintf(buffer, BUFSIZE, "    wall ms: min %.3f mean %.3f p50 %.3f p90 %.3f p99 %.3f max %.3f (sd %.3f)\n",
+           min, mean, p50, p90, p99, max, stddev);
+  textproc_log(buffer);
+}
+
+/* Output the resource usage and outliers of a benchmark */
+void log_bench_usage(double user_ms, double sys_ms, long max_rss_kb, int mild, int far) {
+  char buffer[BUFSIZE] = {0};
+  snprintf(buffer, BUFSIZE, "    cpu ms/run: user %.3f sys %.3f, max rss %ld KiB, outliers: %d mild %d severe\n",
+           user_ms, sys_ms, max_rss_kb, mild, far);
+  textproc_log(buffer);
+}
+
+/* Output when the line range given to output is not valid */
+void log_output_slice_error() {
+  textproc_log("Usage: output <TASK> [--lines <FIRST>:<LAST> | --tail <N>], lines counted from 1\n");
+}
+
+/* Output when follow starts or stops streaming a task's output */
+void log_follow(int task_id, int start) {
+  char buffer[BUFSIZE] = {0};
+  if (start)
+  { sprintf(buffer, "Following Task ID #%d, control-c to stop\n", task_id); }
   else
-  { sprintf(buffer, "Task %d: %s (PID %d; %s; exit code %d)\n", task_id, cmd, pid, task_state[status], exit_code); }
+  { sprintf(buffer, "Stopped following Task ID #%d\n", task_id); }
+  textproc_log(buffer);
+}
+
+/* Output when follow is not given a task */
+void log_follow_usage() {
+  textproc_log("Usage: follow <TASK>\n");
+}
 
+/* Output when metrics start or stop being served (where is NULL when stopping or on a usage error,
+ * error is an errno value when serving on where failed) */
+void log_metrics(const char *where, int error) {
+  char buffer[BUFSIZE] = {0};
+  if (!where && error == 0)
+  { snprintf(buffer, BUFSIZE, "Metrics no longer served\n"); }
+  else if (!where)
+  { snprintf(buffer, BUFSIZE, "Usage: metrics [<PORT> | <PATH> | off]\n"); }
+  else if (error == 0)
+  { snprintf(buffer, BUFSIZE, "Serving metrics on %s\n", where); }
+  else
+  { snprintf(buffer, BUFSIZE, "Error: Cannot serve metrics on %s (%s)\n", where, strerror(error)); }
+  textproc_log(buffer);
+}
+
+/* Output whether tracing is on and how much it holds */
+void log_trace_status(int on, unsigned long records) {
+  char buffer[BUFSIZE] = {0};
+  snprintf(buffer, BUFSIZE, "Tracing is %s, %lu record(s) held\n", on ? "on" : "off", records);
+  textproc_log(buffer);
+}
+
+/* Output when a trace has been written */
+void log_trace_dump(const char *file, long events) {
+  char buffer[BUFSIZE] = {0};
+  snprintf(buffer, BUFSIZE, "Wrote %ld trace event(s) to %s\n", events, file);
+  textproc_log(buffer);
+}
+
+/* Output when tracing fails (file is NULL for a usage error) */
+void log_trace_error(const char *file) {
+  char buffer[BUFSIZE] = {0};
+  if (file)
+  { snprintf(buffer, BUFSIZE, "Error: Cannot write trace to %s\n", file); }
+  else
+  { snprintf(buffer, BUFSIZE, "Usage: trace [on | off | dump <FILE>]\n"); }
+  textproc_log(buffer);
+}
+
+/* Output one line of saved task output that matched a search */
+void log_search_match(int task_id, unsigned long line, const char *text, size_t len) {
+  char buffer[BUFSIZE] = {0};
+  int shown = (len > 160) ? 160 : (int)len;
+  snprintf(buffer, BUFSIZE, "Task %d line %lu: %.*s\n", task_id, line, shown, text);
+  textproc_log(buffer);
+}
+
+/* Output at the end of a search */
+void log_search_done(const char *pattern, long matches, long shown) {
+  char buffer[BUFSIZE] = {0};
+  if (matches < 0)
+  { snprintf(buffer, BUFSIZE, "Error: Cannot search for \"%s\"\n", pattern); }
+  else
+  { snprintf(buffer, BUFSIZE, "%ld matching line(s) for \"%s\" (%ld shown)\n", matches, pattern, shown); }
   textproc_log(buffer);
 }
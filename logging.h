@@ -2,6 +2,8 @@
 #ifndef LOGGING_H
 #define LOGGING_H
 
+#include <stddef.h>
+
 #define LOG_FG      0
 #define LOG_BG      1
 #define LOG_LOG_BG  2
@@ -11,6 +13,7 @@
 #define LOG_STATE_SUSPENDED  2
 #define LOG_STATE_COMPLETE   3
 #define LOG_STATE_KILLED     4
+#define LOG_STATE_PENDING    5
 
 #define LOG_CMD_SUSPEND 0
 #define LOG_CMD_RESUME  1
@@ -27,18 +30,71 @@ void log_prompt();
 void log_help();
 void log_quit();
 void log_num_tasks(int num_tasks);
-void log_task_info(int task_id, int status, int exit_code, int pid, const char *cmd);
+void log_task_info(int task_id, int status, int exit_code, int pid, const char *cmd, const char *prio);
 void log_task_init(int task_id, const char *cmd);
 void log_task_id_error(int task_id);
 void log_delete(int task_id);
 void log_status_error(int task_id, int status);
 void log_status_change(int task_id, int pid, int type, const char *cmd, int transition);
 void log_run_error(const char *line);
+void log_launch_error(int task_id, const char *cmd, const char *reason);
+void log_delete_error(int task_id);
 void log_sig_sent(int sig_type, int task_id, int pid);
 void log_output_begin(int task_id);
 void log_output_unlogged(int task_id);
 void log_file_error(int task_id, const char *file);
 void log_ctrl_c();
 void log_ctrl_z();
+void log_renice(int task_id, int pid, const char *prio);
+void log_prio_error(int task_id, const char *prio);
+void log_selector_error(const char *word);
+void log_tag_change(const char *tag, int count, int added);
+void log_top_header();
+void log_top_row(int task_id, int pid, double cpu, long rss_kb, int threads,
+                 unsigned long long read_bytes, unsigned long long write_bytes, const char *cmd);
+void log_output_truncated(int task_id, unsigned long bytes);
+void log_output_slice_error();
+void log_follow(int task_id, int start);
+void log_follow_usage();
+void log_metrics(const char *where, int error);
+void log_trace_status(int on, unsigned long records);
+void log_trace_dump(const char *file, long events);
+void log_trace_error(const char *file);
+void log_evicted(long evicted, long complete, long failed, long killed);
+void log_broadcast(const char *file, int count);
+void log_map_error(int task_id, const char *file);
+void log_wait_result(int task_id, const char *cmd, int status, int exit_code, int signal);
+void log_wait_done(int finished, int remaining, int status, int reason);
+void log_wait_usage();
+void log_history_header(int task_id, const char *cmd, unsigned long total, unsigned long shown);
+void log_history_run(unsigned long number, const char *start, long duration_ms, const char *mode, int pid,
+                     const char *outcome, unsigned long cpu_ms, unsigned long max_rss_kb, unsigned adopted);
+void log_history_usage();
+void log_pending(int task_id, const char *cmd, const char *reason);
+void log_pending_cancel(int task_id, const char *cmd);
+void log_admission(long rate, long burst, double tokens, const double pressure[3], const long thresholds[3], int pending);
+void log_admission_counts(unsigned long admitted, unsigned long released, const unsigned long deferred[],
+                          const char *const names[], int count);
+void log_shed(int task_id, const char *cmd, int suspended, double pressure, long avail_mb);
+void log_shed_status(long psi_limit, long avail_floor_mb, long avail_mb, int suspended);
+void log_watch(int task_id, const char *file, int start);
+void log_watch_usage();
+void log_watch_error(int task_id);
+void log_watch_change(int task_id, const char *cmd);
+void log_cache_hit(int task_id, const char *cmd, int exit_code, size_t bytes);
+void log_cache_stats(unsigned long hits, unsigned long misses, unsigned long stores, unsigned long evictions,
+                     size_t entries, unsigned long long bytes, long cap_mb);
+void log_map_chunk(int chunk, size_t start, size_t end, int code, int signaled);
+void log_map_summary(int task_id, int chunks, int finished, int failed, int jobs, size_t bytes_out);
+void log_mem_report(int tasks, size_t task_bytes, size_t strings, size_t references,
+                    size_t stored, size_t shared, size_t output_bytes);
+void log_setting(const char *name, long value, const char *help);
+void log_setting_error(const char *name);
+void log_bench_error(int task_id);
+void log_search_match(int task_id, unsigned long line, const char *text, size_t len);
+void log_search_done(const char *pattern, long matches, long shown);
+void log_bench_summary(int task_id, int runs, int warmup, int parallel, int failed);
+void log_bench_times(double min, double mean, double p50, double p90, double p99, double max, double stddev);
+void log_bench_usage(double user_ms, double sys_ms, long max_rss_kb, int mild, int far);
 
 #endif /*LOGGING_H*/
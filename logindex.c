@@ -0,0 +1,190 @@
+/* Sparse line-offset index for task logs, used for random access output slices. */
+
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <sys/stat.h>
+
+#include "logindex.h"
+
+#define READ_SIZE 65536
+
+void logindex_init(LogIndex *idx)
+{
+    memset(idx, 0, sizeof(LogIndex));
+    idx->fd = -1;
+}
+
+static void add_entry(LogIndex *idx, unsigned long long offset, int save)
+{
+    if (idx->count == idx->cap)
+    {
+        size_t cap = idx->cap ? idx->cap * 2 : 64;
+        unsigned long long *grown = realloc(idx->offsets, cap * sizeof(unsigned long long));
+        if (!grown)
+        {
+            return;
+        }
+        idx->offsets = grown;
+        idx->cap = cap;
+    }
+    idx->offsets[idx->count++] = offset;
+    if (save && idx->fd != -1)
+    {
+        write(idx->fd, &offset, sizeof(offset));
+    }
+}
+
+int logindex_create(LogIndex *idx, const char *path)
+{
+    logindex_free(idx);
+    idx->fd = open(path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    add_entry(idx, 0, 1); // line 0 starts at offset 0
+    return (idx->fd == -1) ? -1 : 0;
+}
+
+void logindex_feed(LogIndex *idx, const char *buf, size_t len)
+{
+    const char *p = buf;
+    const char *end = buf + len;
+
+    if (idx->count == 0)
+    {
+        add_entry(idx, 0, 1);
+    }
+    while (p < end && (p = memchr(p, '\n', end - p)))
+    {
+        p++;
+        idx->lines++;
+        if (idx->lines % LOGINDEX_STRIDE == 0)
+        {
+            add_entry(idx, idx->bytes + (p - buf), 1);
+        }
+    }
+    idx->bytes += len;
+    if (len > 0)
+    {
+        idx->partial = (buf[len - 1] != '\n');
+    }
+}
+
+void logindex_close(LogIndex *idx)
+{
+    if (idx->fd != -1)
+    {
+        close(idx->fd);
+        idx->fd = -1;
+    }
+}
+
+void logindex_free(LogIndex *idx)
+{
+    logindex_close(idx);
+    free(idx->offsets);
+    logindex_init(idx);
+}
+
+int logindex_load(LogIndex *idx, const char *path, int log_fd)
+{
+    char buffer[READ_SIZE];
+    struct stat st;
+
+    if (fstat(log_fd, &st) == -1)
+    {
+        return -1;
+    }
+    if (idx->count == 0)
+    { // nothing in memory: start from the saved entries that still fit the log
+        int fd = open(path, O_RDONLY | O_CLOEXEC);
+        unsigned long long offset;
+        while (fd != -1 && read(fd, &offset, sizeof(offset)) == sizeof(offset) &&
+               offset <= (unsigned long long)st.st_size)
+        {
+            add_entry(idx, offset, 0);
+        }
+        if (fd != -1)
+        {
+            close(fd);
+        }
+        if (idx->count == 0)
+        {
+            add_entry(idx, 0, 0);
+        }
+        idx->lines = (unsigned long long)(idx->count - 1) * LOGINDEX_STRIDE;
+        idx->bytes = idx->offsets[idx->count - 1];
+        idx->partial = 0;
+    }
+
+    /* index the part of the log written after the last entry */
+    while (idx->bytes < (unsigned long long)st.st_size)
+    {
+        ssize_t n = pread(log_fd, buffer, sizeof(buffer), idx->bytes);
+        if (n <= 0)
+        {
+            break;
+        }
+        logindex_feed(idx, buffer, n);
+    }
+    return 0;
+}
+
+unsigned long long logindex_lines(LogIndex *idx)
+{
+    return idx->lines + (idx->partial ? 1 : 0);
+}
+
+int logindex_print(LogIndex *idx, int log_fd, unsigned long long first, unsigned long long last, int out_fd)
+{
+    char buffer[READ_SIZE];
+
+    if (first < 1 || first > last || idx->count == 0)
+    {
+        return 0;
+    }
+    size_t entry = (first - 1) / LOGINDEX_STRIDE;
+    if (entry >= idx->count)
+    {
+        entry = idx->count - 1;
+    }
+    unsigned long long offset = idx->offsets[entry];
+    unsigned long long line = (unsigned long long)entry * LOGINDEX_STRIDE + 1; // line starting at offset
+
+    while (line <= last)
+    {
+        ssize_t n = pread(log_fd, buffer, sizeof(buffer), offset);
+        if (n == -1 && errno == EINTR)
+        {
+            continue;
+        }
+        if (n <= 0)
+        {
+            break;
+        }
+        char *p = buffer;
+        char *end = buffer + n;
+        char *start = (line >= first) ? p : NULL; // first byte to print in this buffer
+        while (p < end && line <= last)
+        {
+            char *nl = memchr(p, '\n', end - p);
+            if (!nl)
+            {
+                p = end;
+                break;
+            }
+            p = nl + 1;
+            line++;
+            if (line == first)
+            {
+                start = p;
+            }
+        }
+        if (start && p > start && write(out_fd, start, p - start) == -1)
+        {
+            return -1;
+        }
+        offset += n;
+    }
+    return 0;
+}
@@ -0,0 +1,48 @@
+#ifndef LOGINDEX_H
+#define LOGINDEX_H
+
+#include <stddef.h>
+
+#define LOGINDEX_STRIDE 4096 /* lines between index entries */
+
+/* Sparse line-offset index of a log file: the byte offset of every
+ * LOGINDEX_STRIDE-th line. It is built while output is captured and kept next
+ * to the log as logN.idx, a plain array of 64-bit offsets. */
+typedef struct LogIndex
+{
+    unsigned long long *offsets; // offsets[i] is where line i * LOGINDEX_STRIDE (from 0) starts
+    size_t count;                // entries in offsets
+    size_t cap;                  // room in offsets
+    unsigned long long lines;    // newlines seen so far
+    unsigned long long bytes;    // bytes seen so far
+    int partial;                 // 1 if the last line seen has no newline yet
+    int fd;                      // index file entries are appended to, -1 if none
+} LogIndex;
+
+/* Initializes an empty index that is not backed by a file. */
+void logindex_init(LogIndex *idx);
+
+/* Starts a new index for a log that is being (re)written, saved to path. */
+int logindex_create(LogIndex *idx, const char *path);
+
+/* Accounts for output appended to the log. */
+void logindex_feed(LogIndex *idx, const char *buf, size_t len);
+
+/* Stops saving new entries to the index file (the entries in memory stay). */
+void logindex_close(LogIndex *idx);
+
+/* Frees the index. */
+void logindex_free(LogIndex *idx);
+
+/* Loads a saved index from path (if there is one) and then indexes whatever part
+ * of the log at log_fd it does not cover yet. Returns 0 on success, -1 on failure. */
+int logindex_load(LogIndex *idx, const char *path, int log_fd);
+
+/* Returns the number of lines in the log, counting a last line without newline. */
+unsigned long long logindex_lines(LogIndex *idx);
+
+/* Writes lines first..last (from 1, inclusive) of the log at log_fd to out_fd,
+ * reading only from the closest index entry on. Returns 0 on success, -1 on error. */
+int logindex_print(LogIndex *idx, int log_fd, unsigned long long first, unsigned long long last, int out_fd);
+
+#endif /*LOGINDEX_H*/
@@ -0,0 +1,397 @@
+/* Rotation, background compression and retention of task log segments. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <pthread.h>
+#include <dirent.h>
+#ifdef HAVE_ZLIB
+#include <zlib.h>
+#endif
+
+#include "logrotate.h"
+
+#define READ_SIZE 65536
+
+typedef struct Segment
+{
+    int task_id;                 // task the segment belongs to
+    unsigned int gen;            // G in logN.G.txt
+    unsigned long long first;    // number of its first line in the task's output
+    unsigned long long lines;    // lines in it
+    unsigned long long bytes;    // size before compression
+    struct Segment *next;        // next newer segment of any task
+} Segment;
+
+typedef struct Job
+{
+    int task_id;      // segment to compress
+    unsigned int gen;
+    struct Job *next;
+} Job;
+
+static Segment *oldest = NULL;        // all segments, oldest first
+static unsigned int next_gen = 1;     // G of the next segment
+static unsigned long long live_bytes = 0;    // size of the current logs
+static unsigned long long rotated_bytes = 0; // size of all segments before compression
+
+/* Compression runs on its own thread. The lock keeps it from renaming a
+ * compressed segment into place after the segment has been deleted. */
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t work = PTHREAD_COND_INITIALIZER;
+static Job *jobs = NULL, *last_job = NULL;
+static int worker_started = 0;
+
+static void segment_path(char *buffer, size_t size, int task_id, unsigned int gen, int compressed)
+{
+    snprintf(buffer, size, "log%d.%u.txt%s", task_id, gen, compressed ? ".gz" : "");
+}
+
+static void delete_segment(Segment *seg)
+{
+    char path[100];
+
+    pthread_mutex_lock(&lock);
+    segment_path(path, sizeof(path), seg->task_id, seg->gen, 0);
+    unlink(path);
+    segment_path(path, sizeof(path), seg->task_id, seg->gen, 1);
+    unlink(path);
+    pthread_mutex_unlock(&lock);
+    rotated_bytes -= seg->bytes;
+    free(seg);
+}
+
+int logrotate_can_compress()
+{
+#ifdef HAVE_ZLIB
+    return 1;
+#else
+    return 0;
+#endif
+}
+
+#ifdef HAVE_ZLIB
+/* Compresses logN.G.txt to logN.G.txt.gz and then removes the original. */
+static void compress_segment(int task_id, unsigned int gen)
+{
+    char source[100], target[100], temp[110];
+    char buffer[READ_SIZE];
+
+    segment_path(source, sizeof(source), task_id, gen, 0);
+    segment_path(target, sizeof(target), task_id, gen, 1);
+    snprintf(temp, sizeof(temp), "%s.tmp", target);
+
+    int fd = open(source, O_RDONLY | O_CLOEXEC);
+    if (fd == -1)
+    {
+        return; // deleted already
+    }
+    gzFile gz = gzopen(temp, "wb6");
+    int ok = (gz != NULL);
+    ssize_t n;
+    while (ok && (n = read(fd, buffer, sizeof(buffer))) != 0)
+    {
+        if (n == -1)
+        {
+            ok = (errno == EINTR);
+            continue;
+        }
+        ok = (gzwrite(gz, buffer, (unsigned)n) == n);
+    }
+    close(fd);
+    if (gz && gzclose(gz) != Z_OK)
+    {
+        ok = 0;
+    }
+
+    pthread_mutex_lock(&lock);
+    if (ok && access(source, F_OK) == 0 && rename(temp, target) == 0)
+    {
+        unlink(source);
+    }
+    else
+    {
+        unlink(temp);
+    }
+    pthread_mutex_unlock(&lock);
+}
+
+static void *compress_worker(void *arg)
+{
+    for (;;)
+    {
+        pthread_mutex_lock(&lock);
+        while (!jobs)
+        {
+            pthread_cond_wait(&work, &lock);
+        }
+        Job *job = jobs;
+        jobs = job->next;
+        if (!jobs)
+        {
+            last_job = NULL;
+        }
+        pthread_mutex_unlock(&lock);
+
+        compress_segment(job->task_id, job->gen);
+        free(job);
+    }
+    return NULL;
+}
+#endif
+
+static void queue_compression(int task_id, unsigned int gen)
+{
+#ifdef HAVE_ZLIB
+    Job *job = (Job *)malloc(sizeof(Job));
+    if (!job)
+    {
+        return;
+    }
+    job->task_id = task_id;
+    job->gen = gen;
+    job->next = NULL;
+
+    pthread_mutex_lock(&lock);
+    if (!worker_started)
+    {
+        pthread_t thread;
+        pthread_attr_t attr;
+        pthread_attr_init(&attr);
+        pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+        worker_started = (pthread_create(&thread, &attr, compress_worker, NULL) == 0);
+        pthread_attr_destroy(&attr);
+        if (!worker_started)
+        {
+            pthread_mutex_unlock(&lock);
+            free(job); // the segment simply stays uncompressed
+            return;
+        }
+    }
+    if (last_job)
+    {
+        last_job->next = job;
+    }
+    else
+    {
+        jobs = job;
+    }
+    last_job = job;
+    pthread_cond_signal(&work);
+    pthread_mutex_unlock(&lock);
+#endif
+}
+
+int logrotate_rotate(int task_id, unsigned long long first_line, unsigned long long lines,
+                     unsigned long long bytes, int keep, int compress)
+{
+    char current[100], path[100];
+
+    Segment *seg = (Segment *)malloc(sizeof(Segment));
+    if (!seg)
+    {
+        return -1;
+    }
+    snprintf(current, sizeof(current), "log%d.txt", task_id);
+    segment_path(path, sizeof(path), task_id, next_gen, 0);
+    if (rename(current, path) == -1)
+    {
+        free(seg);
+        return -1;
+    }
+    seg->task_id = task_id;
+    seg->gen = next_gen++;
+    seg->first = first_line;
+    seg->lines = lines;
+    seg->bytes = bytes;
+    seg->next = NULL;
+
+    Segment **link = &oldest;
+    int count = 0;
+    while (*link)
+    {
+        count += ((*link)->task_id == task_id);
+        link = &(*link)->next;
+    }
+    *link = seg;
+    live_bytes -= (bytes < live_bytes) ? bytes : live_bytes;
+    rotated_bytes += bytes;
+
+    /* keep the newest segments of the task */
+    for (link = &oldest; count >= keep && *link;)
+    {
+        Segment *old = *link;
+        if (old->task_id == task_id && old != seg)
+        {
+            *link = old->next;
+            delete_segment(old);
+            count--;
+            continue;
+        }
+        link = &old->next;
+    }
+    if (keep == 0)
+    {
+        for (link = &oldest; *link != seg; link = &(*link)->next)
+            ;
+        *link = NULL;
+        delete_segment(seg);
+        return 0;
+    }
+    if (compress)
+    {
+        queue_compression(task_id, seg->gen);
+    }
+    return 0;
+}
+
+void logrotate_forget(int task_id)
+{
+    /* segments left behind by an earlier session are not listed: find them by name */
+    DIR *dir = opendir(".");
+    struct dirent *entry;
+    while (dir && (entry = readdir(dir)))
+    {
+        int id, end = 0;
+        unsigned int gen;
+        if (sscanf(entry->d_name, "log%d.%u.txt%n", &id, &gen, &end) == 2 && end > 0 && id == task_id &&
+            (entry->d_name[end] == '\0' || strcmp(entry->d_name + end, ".gz") == 0))
+        {
+            pthread_mutex_lock(&lock);
+            unlink(entry->d_name);
+            pthread_mutex_unlock(&lock);
+        }
+    }
+    if (dir)
+    {
+        closedir(dir);
+    }
+
+    Segment **link = &oldest;
+    while (*link)
+    {
+        Segment *seg = *link;
+        if (seg->task_id == task_id)
+        {
+            *link = seg->next;
+            delete_segment(seg);
+            continue;
+        }
+        link = &seg->next;
+    }
+}
+
+void logrotate_written(long long bytes)
+{
+    if (bytes < 0 && (unsigned long long)-bytes > live_bytes)
+    {
+        live_bytes = 0;
+        return;
+    }
+    live_bytes += bytes;
+}
+
+void logrotate_enforce(unsigned long long cap)
+{
+    while (cap && oldest && live_bytes + rotated_bytes > cap)
+    {
+        Segment *seg = oldest;
+        oldest = seg->next;
+        delete_segment(seg);
+    }
+}
+
+/* Writes the part of buf that holds lines first..last; *line is the number of the line buf starts in. */
+static int write_lines(int fd, const char *buf, size_t len, unsigned long long *line,
+                       unsigned long long first, unsigned long long last)
+{
+    const char *p = buf;
+    const char *end = buf + len;
+    const char *start = (*line >= first) ? buf : NULL;
+
+    while (p < end && *line <= last)
+    {
+        const char *nl = memchr(p, '\n', end - p);
+        if (!nl)
+        {
+            p = end;
+            break;
+        }
+        p = nl + 1;
+        (*line)++;
+        if (*line == first)
+        {
+            start = p;
+        }
+    }
+    if (start && p > start && write(fd, start, p - start) == -1)
+    {
+        return -1;
+    }
+    return 0;
+}
+
+/* Writes the wanted lines of one segment, compressed or not. */
+static int dump_segment(Segment *seg, int fd, unsigned long long first, unsigned long long last)
+{
+    char path[100];
+    char buffer[READ_SIZE];
+    unsigned long long line = seg->first;
+    int rc = 0;
+
+    segment_path(path, sizeof(path), seg->task_id, seg->gen, 0);
+    int in = open(path, O_RDONLY | O_CLOEXEC);
+    if (in != -1)
+    {
+        ssize_t n;
+        while (rc == 0 && line <= last && (n = read(in, buffer, sizeof(buffer))) != 0)
+        {
+            if (n == -1)
+            {
+                rc = (errno == EINTR) ? 0 : -1;
+                continue;
+            }
+            rc = write_lines(fd, buffer, n, &line, first, last);
+        }
+        close(in);
+        return rc;
+    }
+#ifdef HAVE_ZLIB
+    segment_path(path, sizeof(path), seg->task_id, seg->gen, 1);
+    gzFile gz = gzopen(path, "rb");
+    if (!gz)
+    {
+        return -1;
+    }
+    int n;
+    while (rc == 0 && line <= last && (n = gzread(gz, buffer, sizeof(buffer))) > 0)
+    {
+        rc = write_lines(fd, buffer, n, &line, first, last);
+    }
+    gzclose(gz);
+    return rc;
+#else
+    return -1;
+#endif
+}
+
+int logrotate_dump(int task_id, int fd, unsigned long long first, unsigned long long last)
+{
+    int rc = 0;
+
+    for (Segment *seg = oldest; seg; seg = seg->next)
+    {
+        if (seg->task_id != task_id || seg->first + seg->lines <= first || seg->first > last)
+        {
+            continue;
+        }
+        if (dump_segment(seg, fd, first, last) == -1)
+        {
+            rc = -1;
+        }
+    }
+    return rc;
+}
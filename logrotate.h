@@ -0,0 +1,31 @@
+#ifndef LOGROTATE_H
+#define LOGROTATE_H
+
+/* Rotated segments of task logs. When logN.txt reaches its size cap it is
+ * renamed to logN.G.txt, where G grows with every rotation, and a new logN.txt
+ * is started. Segments may then be compressed to logN.G.txt.gz by a background
+ * thread (when built with zlib). The oldest segments are deleted first. */
+
+/* Rotates logN.txt of a task. lines is the number of lines in it and first_line
+ * the number of its first line in the whole output. Keeps at most keep segments
+ * of the task. Returns 0 on success, -1 if the log could not be renamed. */
+int logrotate_rotate(int task_id, unsigned long long first_line, unsigned long long lines,
+                     unsigned long long bytes, int keep, int compress);
+
+/* Deletes all rotated segments of a task, e.g. when a new log replaces them. */
+void logrotate_forget(int task_id);
+
+/* Accounts for bytes added to (or, if negative, removed from) current logs. */
+void logrotate_written(long long bytes);
+
+/* Deletes the oldest segments of any task until all logs together fit in cap bytes (0 for no cap). */
+void logrotate_enforce(unsigned long long cap);
+
+/* Writes lines first..last (from 1, inclusive) of a task's rotated segments to fd,
+ * oldest first, decompressing them as needed. Returns 0 on success, -1 on error. */
+int logrotate_dump(int task_id, int fd, unsigned long long first, unsigned long long last);
+
+/* Returns 1 if compressed segments can be written and read. */
+int logrotate_can_compress();
+
+#endif /*LOGROTATE_H*/
@@ -0,0 +1,406 @@
+/* Parallel map of a command over the line-aligned chunks of an input. */
+
+#define _GNU_SOURCE
+
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <signal.h>
+#include <time.h>
+#include <sys/wait.h>
+
+#include "map.h"
+#include "reaper.h"
+
+#define READ_SIZE 65536
+
+typedef struct Chunk
+{
+    size_t start, end;  // byte range of the input
+    char *out;          // output held until it is the chunk's turn
+    size_t out_len, out_cap;
+    int done;           // 1 once its instance exited and its output ended
+    int code;           // exit code, or signal number if signaled
+    int signaled;
+} Chunk;
+
+typedef struct MapState MapState;
+
+typedef struct Slot
+{
+    MapState *m;
+    int chunk;          // chunk being processed, -1 if the slot is free
+    pid_t pid;
+    size_t fed;         // bytes of the chunk written so far
+    EvWatch w_in;       // its stdin, watched for room while input is left (EV_MAP)
+    EvWatch w_out;      // its stdout, until the output has ended
+    EvWatch w_pid;      // its pidfd, until it has been reaped
+} Slot;
+
+struct MapState
+{
+    const char *data;
+    Chunk *chunks;
+    int num_chunks;
+    int next_emit;      // first chunk whose output has not all been written
+    int running;        // instances not completely done
+    int failed;         // 1 once output could not be written or held
+    int out_fd;
+    MapReport report;
+    void *ctx;
+    MapStats *stats;
+};
+
+static int write_all(int fd, const char *buf, size_t len)
+{
+    while (len > 0)
+    {
+        ssize_t n = write(fd, buf, len);
+        if (n == -1 && errno == EINTR)
+        {
+            continue;
+        }
+        if (n <= 0)
+        {
+            return -1;
+        }
+        buf += n;
+        len -= n;
+    }
+    return 0;
+}
+
+/* Writes output of the chunk whose turn it is; a failure fails the whole map. */
+static void put(MapState *m, const char *buf, size_t len)
+{
+    if (m->failed || write_all(m->out_fd, buf, len) == -1)
+    {
+        m->failed = 1;
+        return;
+    }
+    m->stats->bytes_out += len;
+}
+
+static void close_watched(EvWatch *w)
+{
+    int fd = w->fd;
+    if (fd != -1)
+    {
+        ev_del(w);
+        close(fd);
+    }
+}
+
+/* Writes out every finished chunk whose turn has come, plus what the next one has so far. */
+static void emit(MapState *m)
+{
+    while (m->next_emit < m->num_chunks && !m->failed)
+    {
+        Chunk *c = &m->chunks[m->next_emit];
+        if (c->out_len > 0)
+        {
+            put(m, c->out, c->out_len);
+            c->out_len = 0;
+        }
+        if (!c->done || m->failed)
+        {
+            return; // still running: what it writes from now on is streamed
+        }
+        free(c->out);
+        c->out = NULL;
+        m->stats->finished++;
+        if (c->signaled || c->code != 0)
+        {
+            m->stats->failed++;
+        }
+        m->report(m->ctx, m->next_emit, c->start, c->end, c->code, c->signaled);
+        m->next_emit++;
+    }
+}
+
+/* Finds where the chunk after offset ends: at the first line end at or after offset + chunk_size. */
+static size_t chunk_end(const char *data, size_t size, size_t offset, size_t chunk_size)
+{
+    if (size - offset <= chunk_size)
+    {
+        return size;
+    }
+    const char *nl = memchr(data + offset + chunk_size - 1, '\n', size - offset - chunk_size + 1);
+    return nl ? (size_t)(nl - data) + 1 : size;
+}
+
+static int launch(MapState *m, Slot *slot, int chunk, MapSpawn spawn)
+{
+    int in[2], out[2];
+
+    if (pipe2(in, O_CLOEXEC) == -1)
+    {
+        return -1;
+    }
+    if (pipe2(out, O_CLOEXEC) == -1)
+    {
+        close(in[0]);
+        close(in[1]);
+        return -1;
+    }
+    slot->pid = spawn(m->ctx, in[0], out[1]);
+    close(in[0]);
+    close(out[1]);
+    int pidfd = (slot->pid > 0) ? pidfd_open_pid(slot->pid) : -1;
+    if (pidfd == -1 || ev_add(&slot->w_pid, pidfd, EV_MAP, slot) == -1)
+    {
+        if (slot->pid > 0)
+        {
+            kill(-slot->pid, SIGKILL); // it could never be watched
+            waitpid(slot->pid, NULL, 0);
+        }
+        if (pidfd != -1)
+        {
+            close(pidfd);
+        }
+        close(in[1]);
+        close(out[0]);
+        return -1;
+    }
+    reaper_claim(slot->pid);
+    fcntl(in[1], F_SETFL, O_NONBLOCK);
+    fcntl(out[0], F_SETFL, O_NONBLOCK);
+    slot->m = m;
+    slot->chunk = chunk;
+    slot->fed = 0;
+    ev_add_writable(&slot->w_in, in[1], EV_MAP, slot);
+    ev_add(&slot->w_out, out[0], EV_MAP, slot);
+    return 0;
+}
+
+/* Handles one event of a running instance. Returns 1 when the instance is completely done. */
+static int slot_event(MapState *m, Slot *slot, EvWatch *w)
+{
+    Chunk *c = &m->chunks[slot->chunk];
+
+    if (w == &slot->w_in && w->fd != -1)
+    {
+        ssize_t n = write(w->fd, m->data + c->start + slot->fed, c->end - c->start - slot->fed);
+        if (n > 0)
+        {
+            slot->fed += n;
+        }
+        if ((n == -1 && errno != EAGAIN && errno != EINTR) || slot->fed == c->end - c->start)
+        {
+            close_watched(w); // all written, or the instance stopped reading
+        }
+    }
+    else if (w == &slot->w_out && w->fd != -1)
+    {
+        char buffer[READ_SIZE];
+        ssize_t n = read(w->fd, buffer, sizeof(buffer));
+        if (n > 0 && slot->chunk == m->next_emit)
+        {
+            put(m, buffer, n); // its turn: stream it
+        }
+        else if (n > 0)
+        {
+            if (c->out_len + n > c->out_cap)
+            {
+                size_t cap = (c->out_cap ? c->out_cap * 2 : READ_SIZE);
+                while (cap < c->out_len + n)
+                {
+                    cap *= 2;
+                }
+                char *grown = realloc(c->out, cap);
+                if (!grown)
+                {
+                    m->failed = 1; // rather than leaving a hole in the output
+                    return 0;
+                }
+                c->out = grown;
+                c->out_cap = cap;
+            }
+            memcpy(c->out + c->out_len, buffer, n);
+            c->out_len += n;
+        }
+        else if (n == 0 || (errno != EAGAIN && errno != EINTR))
+        {
+            close_watched(w);
+        }
+    }
+    else if (w == &slot->w_pid && w->fd != -1)
+    {
+        int status;
+        if (waitpid(slot->pid, &status, WNOHANG) <= 0)
+        {
+            return 0;
+        }
+        reaper_unclaim(slot->pid);
+        close_watched(&slot->w_pid);
+        close_watched(&slot->w_in);
+        c->signaled = WIFSIGNALED(status);
+        c->code = c->signaled ? WTERMSIG(status) : WEXITSTATUS(status);
+    }
+    return slot->w_pid.fd == -1 && slot->w_out.fd == -1;
+}
+
+void map_event(EvWatch *watch)
+{
+    Slot *slot = (Slot *)watch->owner;
+    MapState *m = slot->m;
+
+    if (slot->chunk == -1 || !slot_event(m, slot, watch))
+    {
+        return;
+    }
+    m->chunks[slot->chunk].done = 1;
+    slot->chunk = -1;
+    m->running--;
+    emit(m);
+}
+
+/*
+ * Ends every running instance at once, after the map failed.
+ */
+static void abort_slots(Slot *slots, int jobs)
+{
+    for (int i = 0; i < jobs; i++)
+    {
+        Slot *slot = &slots[i];
+        if (slot->chunk == -1)
+        {
+            continue;
+        }
+        close_watched(&slot->w_in);
+        close_watched(&slot->w_out);
+        if (slot->w_pid.fd != -1)
+        {
+            kill(-slot->pid, SIGKILL);
+            waitpid(slot->pid, NULL, 0);
+            reaper_unclaim(slot->pid);
+            close_watched(&slot->w_pid);
+        }
+        slot->chunk = -1;
+    }
+}
+
+int map_run(const char *data, size_t size, size_t chunk_size, int jobs, MapSpawn spawn, MapWait pump_events, void *ctx,
+            int out_fd, volatile sig_atomic_t *stop, MapReport report, MapStats *stats)
+{
+    MapState m;
+    int started = 0;
+    int stopping = 0;
+
+    memset(stats, 0, sizeof(MapStats));
+    if (jobs < 1 || chunk_size < 1)
+    {
+        return -1;
+    }
+
+    /* split the input up front: chunk boundaries only need a memchr each */
+    int cap = 16;
+    Chunk *chunks = calloc(cap, sizeof(Chunk));
+    for (size_t offset = 0; chunks && offset < size; stats->chunks++)
+    {
+        if (stats->chunks == cap)
+        {
+            Chunk *grown = realloc(chunks, 2 * cap * sizeof(Chunk));
+            if (!grown)
+            {
+                free(chunks);
+                return -1;
+            }
+            memset(grown + cap, 0, cap * sizeof(Chunk));
+            chunks = grown;
+            cap *= 2;
+        }
+        chunks[stats->chunks].start = offset;
+        offset = chunks[stats->chunks].end = chunk_end(data, size, offset, chunk_size);
+    }
+    Slot *slots = calloc(jobs, sizeof(Slot));
+    if (!chunks || !slots)
+    {
+        free(chunks);
+        free(slots);
+        return -1;
+    }
+    /* an instance that stops reading early must give EPIPE, not SIGPIPE */
+    sigset_t pipe_set, saved;
+    sigemptyset(&pipe_set);
+    sigaddset(&pipe_set, SIGPIPE);
+    sigprocmask(SIG_BLOCK, &pipe_set, &saved);
+    m.data = data;
+    m.chunks = chunks;
+    m.num_chunks = stats->chunks;
+    m.next_emit = 0;
+    m.running = 0;
+    m.failed = 0;
+    m.out_fd = out_fd;
+    m.report = report;
+    m.ctx = ctx;
+    m.stats = stats;
+    for (int i = 0; i < jobs; i++)
+    {
+        slots[i].chunk = -1;
+        slots[i].w_in.fd = slots[i].w_out.fd = slots[i].w_pid.fd = -1;
+    }
+
+    while ((started < m.num_chunks || m.running > 0) && !m.failed)
+    {
+        for (int i = 0; i < jobs && started < m.num_chunks && !stopping; i++)
+        {
+            if (slots[i].chunk != -1)
+            {
+                continue;
+            }
+            if (launch(&m, &slots[i], started, spawn) == -1)
+            {
+                chunks[started].done = 1; // reported as failed with code 127
+                chunks[started].code = 127;
+                emit(&m);
+            }
+            else
+            {
+                m.running++;
+            }
+            started++;
+        }
+        if (*stop && !stopping)
+        { // control-c: end the running instances and start no more
+            stopping = 1;
+            for (int i = 0; i < jobs; i++)
+            {
+                if (slots[i].chunk != -1 && slots[i].w_pid.fd != -1)
+                {
+                    kill(-slots[i].pid, SIGTERM);
+                }
+            }
+        }
+        if ((stopping && m.running == 0) || m.failed)
+        {
+            break;
+        }
+        if (m.running == 0)
+        {
+            continue;
+        }
+
+        pump_events(); // the rest of taskman carries on meanwhile
+        emit(&m); // the next chunk in line may have produced output
+    }
+    if (m.failed)
+    {
+        abort_slots(slots, jobs);
+    }
+
+    for (int i = 0; i < m.num_chunks; i++)
+    {
+        free(chunks[i].out);
+    }
+    free(chunks);
+    free(slots);
+    struct timespec none = {0, 0};
+    while (sigtimedwait(&pipe_set, NULL, &none) == SIGPIPE)
+    {
+    }
+    sigprocmask(SIG_SETMASK, &saved, NULL);
+    return m.failed ? -1 : 0;
+}
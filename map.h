@@ -0,0 +1,46 @@
+#ifndef MAP_H
+#define MAP_H
+
+#include <signal.h>
+#include <stddef.h>
+#include <sys/types.h>
+
+#include "events.h"
+
+/* Totals of a map run. */
+typedef struct MapStats
+{
+    int chunks;          // chunks the input was split into
+    int finished;        // chunks whose instance ran to the end
+    int failed;          // of which exited non-zero or were killed
+    size_t bytes_out;    // output written, in input order
+} MapStats;
+
+/* Starts one instance with in_fd as its stdin and out_fd as its stdout, in a
+ * process group of its own. Returns its pid (or -1). It must be a child of the caller. */
+typedef pid_t (*MapSpawn)(void *ctx, int in_fd, int out_fd);
+
+/* Called for each chunk, in input order, after its output has been written:
+ * code is the exit code, or the signal number if signaled is set. */
+typedef void (*MapReport)(void *ctx, int chunk, size_t start, size_t end, int code, int signaled);
+
+/* Waits for and handles the next events of the event loop, returning early
+ * when interrupted by a signal. */
+typedef void (*MapWait)(void);
+
+/* Splits data on line boundaries into chunks of about chunk_size bytes and
+ * feeds each chunk to its own instance, at most jobs at a time. The output of
+ * the instances is written to out_fd in input order: the oldest running chunk
+ * is streamed, later ones are held until their turn. The instances' pipes and
+ * pidfds are watched by the caller's event loop (EV_MAP), which pump_events
+ * drives and which must pass their events to map_event(). Stops early
+ * (terminating the running instances) when *stop becomes non-zero. Returns 0 on
+ * success, -1 if it could not run, or if output could not be written or held,
+ * in which case the running instances are killed. */
+int map_run(const char *data, size_t size, size_t chunk_size, int jobs, MapSpawn spawn, MapWait pump_events, void *ctx,
+            int out_fd, volatile sig_atomic_t *stop, MapReport report, MapStats *stats);
+
+/* Handles an event of one of the instances behind an EV_MAP watch. */
+void map_event(EvWatch *watch);
+
+#endif /*MAP_H*/
@@ -0,0 +1,382 @@
+/* Task manager metrics and the thread serving them in Prometheus text format. */
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+#include <stdint.h>
+#include <ctype.h>
+#include <errno.h>
+#include <unistd.h>
+#include <signal.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#include "metrics.h"
+#include "admit.h"
+
+#define NUM_STATES  6  /* LOG_STATE_STANDBY .. LOG_STATE_PENDING */
+#define NUM_SIGNALS 65 /* signal numbers 1..64 */
+#define NUM_BUCKETS 11 /* histogram buckets, the last one is +Inf */
+#define RENDER_SIZE 16384
+
+static const char *state_names[NUM_STATES] = {"standby", "working", "suspended", "complete", "killed", "pending"};
+static const char *exit_names[3] = {"success", "failure", "signaled"};
+static const double bucket_bounds[NUM_BUCKETS - 1] = {0.0001, 0.0005, 0.001, 0.005, 0.01, 0.05, 0.1, 0.5, 1, 5};
+
+typedef struct Histogram
+{
+    atomic_ulong buckets[NUM_BUCKETS]; // observations per bucket (not cumulative)
+    atomic_ulong sum_us;               // sum of all observations in microseconds
+} Histogram;
+
+static atomic_long tasks_by_state[NUM_STATES];
+static atomic_ulong spawns;
+static atomic_ulong exits[3];
+static atomic_ulong signals_sent[NUM_SIGNALS];
+static atomic_ulong log_bytes;
+static atomic_ulong cache_lookups[2]; // misses, hits
+static atomic_ulong deferrals[ADMIT_REASONS];
+static Histogram exit_handling;
+static Histogram command_time;
+
+static int listen_fd = -1;           // socket metrics are served on, -1 if not serving
+static char socket_path[108] = {0};  // path of a Unix socket, removed when stopping
+static pthread_t server;
+
+void metrics_task_state(int old_state, int new_state)
+{
+    if (old_state >= 0 && old_state < NUM_STATES)
+    {
+        atomic_fetch_sub_explicit(&tasks_by_state[old_state], 1, memory_order_relaxed);
+    }
+    if (new_state >= 0 && new_state < NUM_STATES)
+    {
+        atomic_fetch_add_explicit(&tasks_by_state[new_state], 1, memory_order_relaxed);
+    }
+}
+
+void metrics_spawn(void)
+{
+    atomic_fetch_add_explicit(&spawns, 1, memory_order_relaxed);
+}
+
+void metrics_exit(int outcome)
+{
+    atomic_fetch_add_explicit(&exits[outcome], 1, memory_order_relaxed);
+}
+
+void metrics_signal(int sig)
+{
+    if (sig > 0 && sig < NUM_SIGNALS)
+    {
+        atomic_fetch_add_explicit(&signals_sent[sig], 1, memory_order_relaxed);
+    }
+}
+
+static void observe(Histogram *h, double seconds)
+{
+    int bucket = 0;
+    while (bucket < NUM_BUCKETS - 1 && seconds > bucket_bounds[bucket])
+    {
+        bucket++;
+    }
+    atomic_fetch_add_explicit(&h->buckets[bucket], 1, memory_order_relaxed);
+    atomic_fetch_add_explicit(&h->sum_us, (unsigned long)(seconds * 1e6), memory_order_relaxed);
+}
+
+void metrics_exit_handling(double seconds)
+{
+    observe(&exit_handling, seconds);
+}
+
+void metrics_command(double seconds)
+{
+    observe(&command_time, seconds);
+}
+
+void metrics_log_bytes(unsigned long long bytes)
+{
+    atomic_fetch_add_explicit(&log_bytes, bytes, memory_order_relaxed);
+}
+
+void metrics_deferral(int reason)
+{
+    if (reason > 0 && reason < ADMIT_REASONS)
+    {
+        atomic_fetch_add_explicit(&deferrals[reason], 1, memory_order_relaxed);
+    }
+}
+
+void metrics_cache(int hit)
+{
+    atomic_fetch_add_explicit(&cache_lookups[hit != 0], 1, memory_order_relaxed);
+}
+
+static const char *signal_name(int sig, char *buffer, size_t size)
+{
+    switch (sig)
+    {
+    case SIGHUP: return "SIGHUP";
+    case SIGINT: return "SIGINT";
+    case SIGKILL: return "SIGKILL";
+    case SIGTERM: return "SIGTERM";
+    case SIGCONT: return "SIGCONT";
+    case SIGSTOP: return "SIGSTOP";
+    case SIGTSTP: return "SIGTSTP";
+    }
+    snprintf(buffer, size, "%d", sig);
+    return buffer;
+}
+
+/* Appends formatted text at *len, stopping (and marking *len as -1) when out of room. */
+static void append(char *buffer, size_t size, int *len, const char *format, ...)
+{
+    if (*len < 0)
+    {
+        return;
+    }
+    va_list args;
+    va_start(args, format);
+    int n = vsnprintf(buffer + *len, size - *len, format, args);
+    va_end(args);
+    *len = (n < 0 || (size_t)n >= size - *len) ? -1 : *len + n;
+}
+
+static void render_histogram(char *buffer, size_t size, int *len, const char *name, const char *help, Histogram *h)
+{
+    unsigned long count = 0;
+
+    append(buffer, size, len, "# HELP %s %s\n# TYPE %s histogram\n", name, help, name);
+    for (int i = 0; i < NUM_BUCKETS; i++)
+    {
+        count += atomic_load_explicit(&h->buckets[i], memory_order_relaxed);
+        if (i < NUM_BUCKETS - 1)
+        {
+            append(buffer, size, len, "%s_bucket{le=\"%g\"} %lu\n", name, bucket_bounds[i], count);
+        }
+        else
+        {
+            append(buffer, size, len, "%s_bucket{le=\"+Inf\"} %lu\n", name, count);
+        }
+    }
+    append(buffer, size, len, "%s_sum %.6f\n%s_count %lu\n", name,
+           atomic_load_explicit(&h->sum_us, memory_order_relaxed) / 1e6, name, count);
+}
+
+int metrics_render(char *buffer, size_t size)
+{
+    int len = 0;
+    char number[16];
+
+    append(buffer, size, &len, "# HELP taskman_tasks Tasks in the task list by state.\n# TYPE taskman_tasks gauge\n");
+    for (int i = 0; i < NUM_STATES; i++)
+    {
+        append(buffer, size, &len, "taskman_tasks{state=\"%s\"} %ld\n", state_names[i],
+               atomic_load_explicit(&tasks_by_state[i], memory_order_relaxed));
+    }
+    append(buffer, size, &len, "# HELP taskman_spawns_total Task processes started.\n# TYPE taskman_spawns_total counter\n");
+    append(buffer, size, &len, "taskman_spawns_total %lu\n", atomic_load_explicit(&spawns, memory_order_relaxed));
+    append(buffer, size, &len, "# HELP taskman_exits_total Task processes ended, by outcome.\n# TYPE taskman_exits_total counter\n");
+    for (int i = 0; i < 3; i++)
+    {
+        append(buffer, size, &len, "taskman_exits_total{outcome=\"%s\"} %lu\n", exit_names[i],
+               atomic_load_explicit(&exits[i], memory_order_relaxed));
+    }
+    append(buffer, size, &len, "# HELP taskman_signals_sent_total Signals sent to tasks.\n# TYPE taskman_signals_sent_total counter\n");
+    for (int i = 1; i < NUM_SIGNALS; i++)
+    {
+        unsigned long sent = atomic_load_explicit(&signals_sent[i], memory_order_relaxed);
+        if (sent)
+        {
+            append(buffer, size, &len, "taskman_signals_sent_total{signal=\"%s\"} %lu\n",
+                   signal_name(i, number, sizeof(number)), sent);
+        }
+    }
+    append(buffer, size, &len, "# HELP taskman_log_bytes_total Bytes written to task logs.\n# TYPE taskman_log_bytes_total counter\n");
+    append(buffer, size, &len, "taskman_log_bytes_total %lu\n", atomic_load_explicit(&log_bytes, memory_order_relaxed));
+    append(buffer, size, &len, "# HELP taskman_launch_deferrals_total bg and log launches held back, by reason.\n# TYPE taskman_launch_deferrals_total counter\n");
+    for (int i = 1; i < ADMIT_REASONS; i++)
+    {
+        append(buffer, size, &len, "taskman_launch_deferrals_total{reason=\"%s\"} %lu\n", admit_reason_name(i),
+               atomic_load_explicit(&deferrals[i], memory_order_relaxed));
+    }
+    append(buffer, size, &len, "# HELP taskman_cache_lookups_total Result cache lookups, by result.\n# TYPE taskman_cache_lookups_total counter\n");
+    append(buffer, size, &len, "taskman_cache_lookups_total{result=\"hit\"} %lu\n",
+           atomic_load_explicit(&cache_lookups[1], memory_order_relaxed));
+    append(buffer, size, &len, "taskman_cache_lookups_total{result=\"miss\"} %lu\n",
+           atomic_load_explicit(&cache_lookups[0], memory_order_relaxed));
+    render_histogram(buffer, size, &len, "taskman_exit_handling_seconds",
+                     "Time from the event loop waking for a task exit to the exit being reaped.", &exit_handling);
+    render_histogram(buffer, size, &len, "taskman_command_duration_seconds",
+                     "Time spent handling a command line (commands that wait on tasks are left out).", &command_time);
+    return len;
+}
+
+/* Answers one scrape: the request is read (and ignored) and the metrics are sent back. */
+static void answer(int fd)
+{
+    static char body[RENDER_SIZE];
+    char request[4096];
+    char header[160];
+    size_t have = 0;
+    struct timeval timeout = {1, 0};
+
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+    while (have < sizeof(request) - 1)
+    {
+        ssize_t n = recv(fd, request + have, sizeof(request) - 1 - have, 0);
+        if (n <= 0)
+        {
+            break;
+        }
+        have += n;
+        request[have] = '\0';
+        if (strstr(request, "\r\n\r\n") || strstr(request, "\n\n"))
+        {
+            break;
+        }
+    }
+    int len = metrics_render(body, sizeof(body));
+    if (len < 0)
+    {
+        len = 0;
+    }
+    int head = snprintf(header, sizeof(header),
+                        "HTTP/1.0 200 OK\r\nContent-Type: text/plain; version=0.0.4\r\nContent-Length: %d\r\n\r\n", len);
+    send(fd, header, head, MSG_NOSIGNAL);
+    send(fd, body, len, MSG_NOSIGNAL);
+}
+
+static void *serve(void *arg)
+{
+    int fd = (int)(intptr_t)arg;
+    for (;;)
+    {
+        int client = accept4(fd, NULL, NULL, SOCK_CLOEXEC);
+        if (client == -1)
+        {
+            if (errno == EINTR || errno == ECONNABORTED)
+            {
+                continue;
+            }
+            break; // shut down by metrics_stop
+        }
+        answer(client);
+        close(client);
+    }
+    return NULL;
+}
+
+int metrics_serve(const char *where)
+{
+    int fd;
+    int is_port = (*where != '\0');
+    sigset_t all, old;
+
+    metrics_stop();
+    for (const char *p = where; *p; p++)
+    {
+        is_port = is_port && isdigit((unsigned char)*p);
+    }
+    if (is_port)
+    {
+        struct sockaddr_in addr;
+        int one = 1;
+        memset(&addr, 0, sizeof(addr));
+        addr.sin_family = AF_INET;
+        addr.sin_port = htons((unsigned short)atoi(where));
+        addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        fd = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        if (fd == -1)
+        {
+            return -1;
+        }
+        setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+        if (atoi(where) < 1 || atoi(where) > 65535)
+        {
+            close(fd);
+            errno = EINVAL;
+            return -1;
+        }
+        if (bind(fd, (struct sockaddr *)&addr, sizeof(addr)) == -1)
+        {
+            close(fd);
+            return -1;
+        }
+    }
+    else
+    {
+        struct sockaddr_un addr;
+        struct stat st;
+        memset(&addr, 0, sizeof(addr));
+        addr.sun_family = AF_UNIX;
+        if (strlen(where) >= sizeof(addr.sun_path))
+        {
+            errno = ENAMETOOLONG;
+            return -1;
+        }
+        if (lstat(where, &st) == 0 && !S_ISSOCK(st.st_mode))
+        {
+            errno = EADDRINUSE; // a log or any other file is never replaced
+            return -1;
+        }
+        strcpy(addr.sun_path, where);
+        fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        if (fd == -1)
+        {
+            return -1;
+        }
+        unlink(where); // a socket left by an earlier run, or nothing
+        if (bind(fd, (struct sockaddr *)&addr, sizeof(addr)) == -1)
+        {
+            close(fd);
+            return -1;
+        }
+        strcpy(socket_path, where);
+    }
+    if (listen(fd, 16) == -1)
+    {
+        close(fd);
+        return -1;
+    }
+
+    /* the thread must not take control-c or SIGCHLD from the main thread */
+    listen_fd = fd;
+    sigfillset(&all);
+    pthread_sigmask(SIG_SETMASK, &all, &old);
+    int rc = pthread_create(&server, NULL, serve, (void *)(intptr_t)fd);
+    pthread_sigmask(SIG_SETMASK, &old, NULL);
+    if (rc != 0)
+    {
+        listen_fd = -1;
+        close(fd);
+        return -1;
+    }
+    return 0;
+}
+
+void metrics_stop(void)
+{
+    if (listen_fd == -1)
+    {
+        return;
+    }
+    shutdown(listen_fd, SHUT_RDWR); // wakes up accept
+    pthread_join(server, NULL);
+    close(listen_fd);
+    listen_fd = -1;
+    if (socket_path[0])
+    {
+        unlink(socket_path);
+        socket_path[0] = '\0';
+    }
+}
@@ -0,0 +1,53 @@
+#ifndef METRICS_H
+#define METRICS_H
+
+#include <stddef.h>
+
+/* How a task's process ended, for metrics_exit() */
+#define METRICS_EXIT_SUCCESS  0 /* exited with status 0 */
+#define METRICS_EXIT_FAILURE  1 /* exited with another status */
+#define METRICS_EXIT_SIGNALED 2 /* ended by a signal */
+
+/* Counters and gauges of the task manager. Updates are relaxed atomic
+ * operations (safe in signal handlers), so scraping never blocks them. */
+
+/* Moves a task from one state (LOG_STATE_*) to another; -1 for "no task". */
+void metrics_task_state(int old_state, int new_state);
+
+/* Counts a task process started. */
+void metrics_spawn(void);
+
+/* Counts a task process that ended, with a METRICS_EXIT_* outcome. */
+void metrics_exit(int outcome);
+
+/* Counts a signal sent to a task. */
+void metrics_signal(int sig);
+
+/* Records the time between the event loop waking for an exit and the exit being reaped. The
+ * exit itself is not timestamped by the kernel, so time spent before the wakeup is not counted. */
+void metrics_exit_handling(double seconds);
+
+/* Records the time spent handling a command line. */
+void metrics_command(double seconds);
+
+/* Counts bytes written to task logs. */
+void metrics_log_bytes(unsigned long long bytes);
+
+/* Counts a launch held back by admission control, with its ADMIT_* reason. */
+void metrics_deferral(int reason);
+
+/* Counts a result cache lookup, hit or not. */
+void metrics_cache(int hit);
+
+/* Writes all metrics in Prometheus text format. Returns the length, or -1 if size is too small. */
+int metrics_render(char *buffer, size_t size);
+
+/* Serves the metrics over HTTP from a thread, on 127.0.0.1 if where is a port
+ * number and on a Unix socket at that path otherwise. An existing socket at the
+ * path is replaced, any other file is not. Returns 0 on success, else -1 with errno set. */
+int metrics_serve(const char *where);
+
+/* Stops serving the metrics. */
+void metrics_stop(void);
+
+#endif /*METRICS_H*/
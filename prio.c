@@ -0,0 +1,132 @@
+/* Priority classes for tasks.
+ * Each class maps to a nice value (setpriority) and an I/O scheduling class (ioprio_set). */
+
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/time.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <linux/ioprio.h>
+#include <linux/capability.h>
+
+#include "prio.h"
+
+typedef struct
+{
+    const char *name; // name used by renice and shown in tasks
+    int nice;         // value passed to setpriority
+    int io_class;     // IOPRIO_CLASS_* passed to ioprio_set
+    int io_level;     // level within the I/O class (0 is highest)
+} PrioClass;
+
+static const PrioClass prio_classes[PRIO_COUNT] = {
+    {"interactive", -5, IOPRIO_CLASS_BE, 0},
+    {"normal", 0, IOPRIO_CLASS_BE, IOPRIO_NORM},
+    {"batch", 10, IOPRIO_CLASS_BE, 7},
+    {"idle", 19, IOPRIO_CLASS_IDLE, 0},
+};
+
+const char *prio_name(int prio_class)
+{
+    if (prio_class < 0 || prio_class >= PRIO_COUNT)
+    {
+        return "unknown";
+    }
+    return prio_classes[prio_class].name;
+}
+
+int prio_from_name(const char *name)
+{
+    if (!name)
+    {
+        return -1;
+    }
+    for (int i = 0; i < PRIO_COUNT; i++)
+    {
+        if (strcmp(name, prio_classes[i].name) == 0)
+        {
+            return i;
+        }
+    }
+    return -1;
+}
+
+/*
+ * Sets the nice value and I/O class of a process (which == IOPRIO_WHO_PROCESS)
+ * or of a whole process group (which == IOPRIO_WHO_PGRP).
+ */
+static int prio_apply(int which, pid_t who, int prio_class)
+{
+    if (prio_class < 0 || prio_class >= PRIO_COUNT)
+    {
+        return -1;
+    }
+    const PrioClass *p = &prio_classes[prio_class];
+    int result = 0;
+
+    int nice_which = (which == IOPRIO_WHO_PGRP) ? PRIO_PGRP : PRIO_PROCESS;
+    if (setpriority(nice_which, who, p->nice) == -1)
+    {
+        result = -1; // lowering the nice value needs CAP_SYS_NICE
+    }
+    if (syscall(SYS_ioprio_set, which, who, IOPRIO_PRIO_VALUE(p->io_class, p->io_level)) == -1)
+    {
+        result = -1;
+    }
+    return result;
+}
+
+int prio_apply_self(int prio_class)
+{
+    return prio_apply(IOPRIO_WHO_PROCESS, 0, prio_class);
+}
+
+int prio_apply_group(pid_t pgid, int prio_class)
+{
+    return prio_apply(IOPRIO_WHO_PGRP, pgid, prio_class);
+}
+
+/*
+ * Returns 1 if the calling process has CAP_SYS_NICE in its effective set.
+ */
+static int has_sys_nice(void)
+{
+    struct __user_cap_header_struct header = {_LINUX_CAPABILITY_VERSION_3, 0};
+    struct __user_cap_data_struct data[_LINUX_CAPABILITY_U32S_3];
+
+    if (syscall(SYS_capget, &header, data) == -1)
+    {
+        return 0;
+    }
+    return (data[CAP_TO_INDEX(CAP_SYS_NICE)].effective & CAP_TO_MASK(CAP_SYS_NICE)) != 0;
+}
+
+int prio_allowed(int prio_class)
+{
+    struct rlimit limit;
+
+    if (prio_class < 0 || prio_class >= PRIO_COUNT)
+    {
+        return 0;
+    }
+    int nice = prio_classes[prio_class].nice;
+    errno = 0;
+    int current = getpriority(PRIO_PROCESS, 0);
+    if (current == -1 && errno != 0)
+    {
+        return 0;
+    }
+    if (nice >= current)
+    {
+        return 1; // raising the nice value is always allowed
+    }
+    /* lowering it is allowed down to 20 - RLIMIT_NICE, or to any value with CAP_SYS_NICE;
+       both are inherited by the task, and neither changes taskman's own priority to find out */
+    if (getrlimit(RLIMIT_NICE, &limit) == 0 &&
+        (limit.rlim_cur == RLIM_INFINITY || (rlim_t)(20 - nice) <= limit.rlim_cur))
+    {
+        return 1;
+    }
+    return has_sys_nice();
+}
@@ -0,0 +1,32 @@
+#ifndef PRIO_H
+#define PRIO_H
+
+#include <sys/types.h>
+
+/* Priority classes a task can be launched under. */
+#define PRIO_INTERACTIVE 0
+#define PRIO_NORMAL      1
+#define PRIO_BATCH       2
+#define PRIO_IDLE        3
+#define PRIO_COUNT       4
+
+/* Returns the printable name of a priority class. */
+const char *prio_name(int prio_class);
+
+/* Returns the priority class with the given name, or -1 if there is none. */
+int prio_from_name(const char *name);
+
+/* Applies a priority class to the calling process (used in the child before exec).
+ * Returns 0 on success, -1 if the nice value or the I/O class could not be set. */
+int prio_apply_self(int prio_class);
+
+/* Applies a priority class to every process in the process group pgid.
+ * Returns 0 on success, -1 if the nice value or the I/O class could not be set. */
+int prio_apply_group(pid_t pgid, int prio_class);
+
+/* Returns 1 if processes started by taskman may run under the priority class,
+ * 0 if its nice value is out of reach (lowering it needs CAP_SYS_NICE or a
+ * large enough RLIMIT_NICE). */
+int prio_allowed(int prio_class);
+
+#endif /*PRIO_H*/
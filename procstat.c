@@ -0,0 +1,166 @@
+/* Sampling of process resource usage through /proc. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/resource.h>
+
+#include "procstat.h"
+
+#define STAT_BUFSIZE 1024
+
+void procstat_raise_fd_limit(void)
+{
+    struct rlimit limit;
+    if (getrlimit(RLIMIT_NOFILE, &limit) == 0 && limit.rlim_cur < limit.rlim_max)
+    {
+        limit.rlim_cur = limit.rlim_max;
+        setrlimit(RLIMIT_NOFILE, &limit);
+    }
+}
+
+void procstat_reset(ProcStat *ps)
+{
+    memset(ps, 0, sizeof(ProcStat));
+    ps->stat_fd = -1;
+    ps->statm_fd = -1;
+    ps->io_fd = -1;
+}
+
+/*
+ * Reads a whole /proc file from offset 0 into buffer. Returns the length, or -1.
+ */
+static ssize_t read_proc_file(int fd, char *buffer, size_t size)
+{
+    ssize_t len = pread(fd, buffer, size - 1, 0);
+    if (len <= 0)
+    {
+        return -1; // ESRCH once the process has been reaped
+    }
+    buffer[len] = '\0';
+    return len;
+}
+
+int procstat_open(ProcStat *ps, pid_t pid)
+{
+    char path[64];
+
+    procstat_close(ps);
+    snprintf(path, sizeof(path), "/proc/%d/stat", (int)pid);
+    ps->stat_fd = open(path, O_RDONLY | O_CLOEXEC);
+    snprintf(path, sizeof(path), "/proc/%d/statm", (int)pid);
+    ps->statm_fd = open(path, O_RDONLY | O_CLOEXEC);
+    snprintf(path, sizeof(path), "/proc/%d/io", (int)pid);
+    ps->io_fd = open(path, O_RDONLY | O_CLOEXEC); // optional, may need ptrace access
+
+    if (ps->stat_fd == -1 || ps->statm_fd == -1)
+    {
+        procstat_close(ps);
+        return -1;
+    }
+    ps->pid = pid;
+    if (procstat_sample(ps) == -1)
+    {
+        procstat_close(ps);
+        return -1;
+    }
+    ps->cpu_percent = 0.0; // no previous sample to compare against yet
+    return 0;
+}
+
+int procstat_sample(ProcStat *ps)
+{
+    static long ticks_per_sec = 0;
+    static long page_kb = 0;
+    char buffer[STAT_BUFSIZE];
+    struct timespec now;
+
+    if (!ticks_per_sec)
+    {
+        ticks_per_sec = sysconf(_SC_CLK_TCK);
+        page_kb = sysconf(_SC_PAGESIZE) / 1024;
+    }
+    if (ps->stat_fd == -1)
+    {
+        return -1;
+    }
+
+    /* stat: the command name may contain spaces, so fields are counted after the last ')' */
+    if (read_proc_file(ps->stat_fd, buffer, sizeof(buffer)) == -1)
+    {
+        return -1;
+    }
+    char *p = strrchr(buffer, ')');
+    if (!p)
+    {
+        return -1;
+    }
+    unsigned long long utime = 0, stime = 0;
+    long threads = 0;
+    int field = 2;
+    for (char *tok = strtok(p + 1, " "); tok; tok = strtok(NULL, " "))
+    {
+        field++;
+        if (field == 14)
+        {
+            utime = strtoull(tok, NULL, 10);
+        }
+        else if (field == 15)
+        {
+            stime = strtoull(tok, NULL, 10);
+        }
+        else if (field == 20)
+        {
+            threads = strtol(tok, NULL, 10);
+            break;
+        }
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    unsigned long long ticks = utime + stime;
+    double elapsed = (now.tv_sec - ps->last_time.tv_sec) + (now.tv_nsec - ps->last_time.tv_nsec) / 1e9;
+    if (ps->last_time.tv_sec && elapsed > 0)
+    {
+        ps->cpu_percent = 100.0 * (double)(ticks - ps->last_ticks) / ticks_per_sec / elapsed;
+    }
+    ps->last_ticks = ticks;
+    ps->last_time = now;
+    ps->threads = (int)threads;
+
+    /* statm: size resident shared text lib data dt, in pages */
+    if (read_proc_file(ps->statm_fd, buffer, sizeof(buffer)) == -1)
+    {
+        return -1;
+    }
+    long size = 0, resident = 0;
+    if (sscanf(buffer, "%ld %ld", &size, &resident) == 2)
+    {
+        ps->rss_kb = resident * page_kb;
+    }
+
+    /* io: "rchar: N\nwchar: N\n..." */
+    if (ps->io_fd != -1 && read_proc_file(ps->io_fd, buffer, sizeof(buffer)) != -1)
+    {
+        sscanf(buffer, "rchar: %llu wchar: %llu", &ps->read_bytes, &ps->write_bytes);
+    }
+    return 0;
+}
+
+void procstat_close(ProcStat *ps)
+{
+    if (ps->stat_fd != -1)
+    {
+        close(ps->stat_fd);
+    }
+    if (ps->statm_fd != -1)
+    {
+        close(ps->statm_fd);
+    }
+    if (ps->io_fd != -1)
+    {
+        close(ps->io_fd);
+    }
+    procstat_reset(ps);
+}
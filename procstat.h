@@ -0,0 +1,43 @@
+#ifndef PROCSTAT_H
+#define PROCSTAT_H
+
+#include <sys/types.h>
+#include <time.h>
+
+/* Live resource usage of one process, read from /proc/<pid>.
+ *
+ * The stat, statm and io files are opened once and then re-read with pread() on
+ * every sample, so sampling thousands of processes does not pay for open/close.
+ */
+typedef struct ProcStat
+{
+    pid_t pid;                      // process the files belong to, 0 when closed
+    int stat_fd;                    // /proc/<pid>/stat
+    int statm_fd;                   // /proc/<pid>/statm
+    int io_fd;                      // /proc/<pid>/io (-1 if not readable)
+    unsigned long long last_ticks;  // utime + stime at the previous sample
+    struct timespec last_time;      // when the previous sample was taken
+
+    double cpu_percent;             // CPU use since the previous sample
+    long rss_kb;                    // resident set size
+    int threads;                    // number of threads
+    unsigned long long read_bytes;  // bytes read (rchar)
+    unsigned long long write_bytes; // bytes written (wchar)
+} ProcStat;
+
+/* Raises the soft open file limit to the hard limit, since every sampled process holds three fds. */
+void procstat_raise_fd_limit(void);
+
+/* Marks a ProcStat as closed without touching any fds. */
+void procstat_reset(ProcStat *ps);
+
+/* Opens the /proc files of pid and takes a first sample. Returns 0 on success, -1 on failure. */
+int procstat_open(ProcStat *ps, pid_t pid);
+
+/* Re-reads the /proc files. Returns 0 on success, -1 if the process is gone. */
+int procstat_sample(ProcStat *ps);
+
+/* Closes the /proc files. */
+void procstat_close(ProcStat *ps);
+
+#endif /*PROCSTAT_H*/
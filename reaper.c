@@ -0,0 +1,282 @@
+/* Reaping of children no task tracks itself, and child subreaper mode. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <dirent.h>
+#include <sys/prctl.h>
+
+#include "reaper.h"
+
+typedef struct Stray
+{
+    EvWatch watch;      // pidfd of the child, EV_HELPER
+    pid_t pid;
+    void *owner;        // task it is attributed to, NULL if none
+    struct Stray *next;
+} Stray;
+
+static Stray *strays = NULL;
+static int subreaper = 0;
+
+/* Children somebody reaps: task processes, bench runs, map instances and the
+ * strays. A set of pids with open addressing, 0 marking a free slot. */
+static pid_t *known = NULL;
+static size_t known_size = 0; // slots, a power of two
+static size_t known_count = 0;
+
+static size_t known_slot(pid_t pid)
+{
+    return ((size_t)pid * 2654435761u) & (known_size - 1);
+}
+
+static int known_has(pid_t pid)
+{
+    if (known_count == 0)
+    {
+        return 0;
+    }
+    for (size_t i = known_slot(pid); known[i]; i = (i + 1) & (known_size - 1))
+    {
+        if (known[i] == pid)
+        {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+static int known_add(pid_t pid)
+{
+    if (known_has(pid))
+    {
+        return 0;
+    }
+    if ((known_count + 1) * 2 > known_size)
+    { // keep it at most half full, so probes stay short
+        size_t old_size = known_size;
+        pid_t *old = known;
+        pid_t *grown = (pid_t *)calloc(old_size ? old_size * 2 : 64, sizeof(pid_t));
+        if (!grown && known_count + 1 >= old_size)
+        {
+            return -1;
+        }
+        if (grown)
+        {
+            known = grown;
+            known_size = old_size ? old_size * 2 : 64;
+            for (size_t i = 0; i < old_size; i++)
+            {
+                if (old[i])
+                {
+                    size_t j = known_slot(old[i]);
+                    while (known[j])
+                    {
+                        j = (j + 1) & (known_size - 1);
+                    }
+                    known[j] = old[i];
+                }
+            }
+            free(old);
+        }
+    }
+    size_t i = known_slot(pid);
+    while (known[i])
+    {
+        i = (i + 1) & (known_size - 1);
+    }
+    known[i] = pid;
+    known_count++;
+    return 0;
+}
+
+static void known_remove(pid_t pid)
+{
+    if (known_count == 0)
+    {
+        return;
+    }
+    size_t i = known_slot(pid);
+    while (known[i] && known[i] != pid)
+    {
+        i = (i + 1) & (known_size - 1);
+    }
+    if (!known[i])
+    {
+        return;
+    }
+    known[i] = 0;
+    known_count--;
+    /* move later entries of the probe run back so that lookups still find them */
+    for (size_t j = (i + 1) & (known_size - 1); known[j]; j = (j + 1) & (known_size - 1))
+    {
+        size_t home = known_slot(known[j]);
+        if (((j - home) & (known_size - 1)) >= ((j - i) & (known_size - 1)))
+        {
+            known[i] = known[j];
+            known[j] = 0;
+            i = j;
+        }
+    }
+}
+
+int reaper_enable(int on)
+{
+    if (prctl(PR_SET_CHILD_SUBREAPER, on ? 1 : 0, 0, 0, 0) == -1)
+    {
+        return -1;
+    }
+    subreaper = on ? 1 : 0;
+    return 0;
+}
+
+int reaper_enabled(void)
+{
+    return subreaper;
+}
+
+int reaper_claim(pid_t pid)
+{
+    return known_add(pid);
+}
+
+void reaper_unclaim(pid_t pid)
+{
+    known_remove(pid);
+}
+
+int reaper_track(int pidfd, pid_t pid, void *owner)
+{
+    if (pidfd == -1)
+    {
+        return -1;
+    }
+    Stray *stray = (Stray *)malloc(sizeof(Stray));
+    if (!stray || known_add(pid) == -1)
+    {
+        free(stray);
+        close(pidfd);
+        return -1;
+    }
+    stray->pid = pid;
+    stray->owner = owner;
+    if (ev_add(&stray->watch, pidfd, EV_HELPER, stray) == -1)
+    {
+        known_remove(pid);
+        close(pidfd);
+        free(stray);
+        return -1;
+    }
+    stray->next = strays;
+    strays = stray;
+    return 0;
+}
+
+/*
+ * Adopts the children listed in one /proc/self/task/<tid>/children file (a
+ * re-parented orphan may land on any thread of taskman).
+ */
+static int scan_thread(const char *tid, ReaperOwner owner)
+{
+    char path[64];
+    snprintf(path, sizeof(path), "/proc/self/task/%s/children", tid);
+    FILE *file = fopen(path, "re");
+    if (!file)
+    {
+        return 0;
+    }
+    int adopted = 0;
+    int pid;
+    while (fscanf(file, "%d", &pid) == 1)
+    {
+        if (known_has(pid))
+        {
+            continue;
+        }
+        /* getpgid works on zombies too, and a child cannot be recycled until it is reaped */
+        pid_t pgid = getpgid(pid);
+        if (reaper_track(pidfd_open_pid(pid), pid, (pgid > 0) ? owner(pgid) : NULL) == 0)
+        {
+            adopted++;
+        }
+    }
+    fclose(file);
+    return adopted;
+}
+
+int reaper_scan(ReaperOwner owner)
+{
+    if (!subreaper)
+    {
+        return 0;
+    }
+    DIR *dir = opendir("/proc/self/task");
+    if (!dir)
+    {
+        return 0;
+    }
+    int adopted = 0;
+    struct dirent *entry;
+    while ((entry = readdir(dir)))
+    {
+        if (entry->d_name[0] != '.')
+        {
+            adopted += scan_thread(entry->d_name, owner);
+        }
+    }
+    closedir(dir);
+    return adopted;
+}
+
+int reaper_exit(EvWatch *watch, void **owner, struct rusage *usage)
+{
+    Stray *stray = (Stray *)watch->owner;
+    siginfo_t info;
+    if (pidfd_reap(watch->fd, &info, usage) == -1)
+    {
+        memset(usage, 0, sizeof(struct rusage)); // reaped by someone else, stop watching it
+    }
+    else if (info.si_pid == 0)
+    {
+        return -1;
+    }
+
+    for (Stray **link = &strays; *link; link = &(*link)->next)
+    {
+        if (*link == stray)
+        {
+            *link = stray->next;
+            break;
+        }
+    }
+    *owner = stray->owner;
+    known_remove(stray->pid);
+    int pidfd = stray->watch.fd;
+    ev_del(&stray->watch);
+    close(pidfd);
+    free(stray);
+    return 0;
+}
+
+int reaper_count(void *owner)
+{
+    int count = 0;
+    for (Stray *stray = strays; stray; stray = stray->next)
+    {
+        count += (stray->owner == owner);
+    }
+    return count;
+}
+
+void reaper_detach(void *owner)
+{
+    for (Stray *stray = strays; stray; stray = stray->next)
+    {
+        if (stray->owner == owner)
+        {
+            stray->owner = NULL;
+        }
+    }
+}
@@ -0,0 +1,55 @@
+#ifndef REAPER_H
+#define REAPER_H
+
+#include <sys/types.h>
+#include <sys/resource.h>
+
+#include "events.h"
+
+/* Children that no task tracks itself: abandoned runs of restarted tasks and,
+ * in subreaper mode, descendants of tasks that were orphaned and re-parented
+ * to taskman. Each is watched through a pidfd (EV_HELPER) and reaped by the
+ * event loop. An adopted process is attributed to a task by its process
+ * group, which it keeps from the task's leader unless it left it. */
+
+/* Returns the owner of process group pgid (e.g. the task it leads), or NULL. */
+typedef void *(*ReaperOwner)(pid_t pgid);
+
+/* Turns child subreaper mode on or off (PR_SET_CHILD_SUBREAPER). Returns 0 on
+ * success, -1 on failure. */
+int reaper_enable(int on);
+
+/* Returns 1 in subreaper mode. */
+int reaper_enabled(void);
+
+/* Marks pid as a child its caller reaps itself (a task's process, a bench run,
+ * a map instance), so that reaper_scan() leaves it alone. Returns 0, or -1 if
+ * it cannot be recorded. */
+int reaper_claim(pid_t pid);
+
+/* Forgets a claimed child once its caller has reaped it. */
+void reaper_unclaim(pid_t pid);
+
+/* Watches a child until it exits, on behalf of owner (NULL if none). Takes
+ * over pidfd. Returns 0, or -1 if it cannot be watched (pidfd is closed). */
+int reaper_track(int pidfd, pid_t pid, void *owner);
+
+/* Looks for children that are neither claimed nor tracked, i.e. orphans that
+ * were re-parented, and tracks them. Reads the children of every thread, so it
+ * is meant for when orphans are due (a task's process was just reaped), not for
+ * every SIGCHLD. Returns the number adopted. */
+int reaper_scan(ReaperOwner owner);
+
+/* Reaps the child of an EV_HELPER watch. Returns 0 with its owner and resource
+ * usage (of the child and its reaped children) once it has exited, -1 while it
+ * is still running. A child that turns out to be gone is dropped all the same
+ * with a zeroed usage. */
+int reaper_exit(EvWatch *watch, void **owner, struct rusage *usage);
+
+/* Returns the number of children still watched on behalf of owner. */
+int reaper_count(void *owner);
+
+/* Forgets owner: its children are still reaped, on behalf of nobody. */
+void reaper_detach(void *owner);
+
+#endif /*REAPER_H*/
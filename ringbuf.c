@@ -0,0 +1,230 @@
+/* Per-task output ring buffers allocated from a shared, capped pool. */
+
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+
+#include "ringbuf.h"
+
+static size_t pool_cap = 64 * 1024 * 1024;
+static size_t pool_used = 0;
+static RingBuf *closed_head = NULL; // oldest closed buffer, reclaimed first
+static RingBuf *closed_tail = NULL;
+
+void ring_pool_limit(size_t cap)
+{
+    pool_cap = cap;
+}
+
+size_t ring_pool_used(void)
+{
+    return pool_used;
+}
+
+void ring_init(RingBuf *rb)
+{
+    memset(rb, 0, sizeof(RingBuf));
+}
+
+static void unlink_closed(RingBuf *rb)
+{
+    if (!rb->listed)
+    {
+        return;
+    }
+    if (rb->prev)
+    {
+        rb->prev->next = rb->next;
+    }
+    else
+    {
+        closed_head = rb->next;
+    }
+    if (rb->next)
+    {
+        rb->next->prev = rb->prev;
+    }
+    else
+    {
+        closed_tail = rb->prev;
+    }
+    rb->prev = rb->next = NULL;
+    rb->listed = 0;
+}
+
+static void free_data(RingBuf *rb)
+{
+    if (rb->data)
+    {
+        free(rb->data);
+        pool_used -= rb->size;
+        rb->data = NULL;
+    }
+}
+
+/*
+ * Allocates rb->size bytes, reclaiming finished buffers (oldest first) while the
+ * pool is over its cap. Returns 0 on success, -1 if the memory is not available.
+ */
+static int alloc_data(RingBuf *rb)
+{
+    while (pool_used + rb->size > pool_cap && closed_head)
+    {
+        RingBuf *victim = closed_head;
+        unlink_closed(victim);
+        free_data(victim);
+        victim->reclaimed = 1;
+    }
+    if (pool_used + rb->size > pool_cap)
+    {
+        return -1;
+    }
+    rb->data = malloc(rb->size);
+    if (!rb->data)
+    {
+        return -1;
+    }
+    pool_used += rb->size;
+    return 0;
+}
+
+void ring_open(RingBuf *rb, size_t size)
+{
+    unlink_closed(rb);
+    if (rb->data && rb->size != size)
+    {
+        free_data(rb);
+    }
+    rb->size = size;
+    rb->total = 0;
+    rb->dropped = 0;
+    rb->closed = 0;
+    rb->reclaimed = 0;
+}
+
+void ring_write(RingBuf *rb, const char *buf, size_t len)
+{
+    if (len == 0 || rb->size == 0)
+    {
+        return;
+    }
+    if (!rb->data && alloc_data(rb) == -1)
+    {
+        rb->dropped += len;
+        return;
+    }
+
+    rb->total += len;
+    if (len > rb->size)
+    { // only the tail of this write survives
+        buf += len - rb->size;
+        len = rb->size;
+    }
+    size_t start = (rb->total - len) % rb->size;
+    size_t first = rb->size - start;
+    if (first > len)
+    {
+        first = len;
+    }
+    memcpy(rb->data + start, buf, first);
+    memcpy(rb->data, buf + first, len - first);
+}
+
+void ring_close(RingBuf *rb)
+{
+    if (rb->closed)
+    {
+        return;
+    }
+    rb->closed = 1;
+    if (!rb->data)
+    {
+        return;
+    }
+    rb->listed = 1;
+    rb->prev = closed_tail;
+    rb->next = NULL;
+    if (closed_tail)
+    {
+        closed_tail->next = rb;
+    }
+    else
+    {
+        closed_head = rb;
+    }
+    closed_tail = rb;
+}
+
+void ring_release(RingBuf *rb)
+{
+    unlink_closed(rb);
+    free_data(rb);
+    ring_init(rb);
+}
+
+size_t ring_length(RingBuf *rb)
+{
+    if (!rb->data)
+    {
+        return 0;
+    }
+    return (rb->total < rb->size) ? rb->total : rb->size;
+}
+
+int ring_wrapped(RingBuf *rb)
+{
+    return rb->total > rb->size || rb->dropped > 0 || rb->reclaimed;
+}
+
+void ring_pieces(RingBuf *rb, const char **first, size_t *first_len, const char **second, size_t *second_len)
+{
+    size_t len = ring_length(rb);
+    *second = NULL;
+    *second_len = 0;
+    if (len < rb->size || !rb->data)
+    {
+        *first = rb->data;
+        *first_len = len;
+        return;
+    }
+    size_t start = rb->total % rb->size; // oldest byte
+    *first = rb->data + start;
+    *first_len = rb->size - start;
+    *second = rb->data;
+    *second_len = start;
+}
+
+/*
+ * Writes all of len bytes to fd.
+ */
+static int write_all(int fd, const char *buf, size_t len)
+{
+    while (len > 0)
+    {
+        ssize_t n = write(fd, buf, len);
+        if (n == -1)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            return -1;
+        }
+        buf += n;
+        len -= n;
+    }
+    return 0;
+}
+
+int ring_dump(RingBuf *rb, int fd)
+{
+    const char *first, *second;
+    size_t first_len, second_len;
+    ring_pieces(rb, &first, &first_len, &second, &second_len);
+    if (write_all(fd, first, first_len) == -1)
+    {
+        return -1;
+    }
+    return write_all(fd, second, second_len);
+}
@@ -0,0 +1,56 @@
+#ifndef RINGBUF_H
+#define RINGBUF_H
+
+#include <stddef.h>
+
+/* Fixed-size buffer holding the most recent output of a task.
+ *
+ * Buffers come from a shared pool with a global memory cap. When the pool is full,
+ * the buffer of the task that finished longest ago is reclaimed; if every buffer
+ * belongs to a running task, new output is counted as dropped instead. */
+typedef struct RingBuf
+{
+    char *data;                  // buffer memory, NULL if none has been allocated
+    size_t size;                 // capacity of data
+    size_t total;                // bytes written since ring_open (write position is total % size)
+    size_t dropped;              // bytes that could not be stored because the pool was full
+    int closed;                  // 1 once no more output will be written
+    int reclaimed;               // 1 if the pool took the memory back after the task finished
+    int listed;                  // 1 while on the list of closed buffers
+    struct RingBuf *prev, *next; // list of closed buffers, oldest first
+} RingBuf;
+
+/* Sets the global memory cap of the pool, in bytes. */
+void ring_pool_limit(size_t cap);
+
+/* Returns the number of bytes currently allocated from the pool. */
+size_t ring_pool_used(void);
+
+/* Initializes a buffer that holds nothing. */
+void ring_init(RingBuf *rb);
+
+/* Empties the buffer for a new run that keeps the last size bytes of output. */
+void ring_open(RingBuf *rb, size_t size);
+
+/* Appends output, overwriting the oldest bytes once the buffer is full. */
+void ring_write(RingBuf *rb, const char *buf, size_t len);
+
+/* Marks the buffer as finished, which makes its memory reclaimable by the pool. */
+void ring_close(RingBuf *rb);
+
+/* Frees the buffer's memory. */
+void ring_release(RingBuf *rb);
+
+/* Returns the number of bytes held. */
+size_t ring_length(RingBuf *rb);
+
+/* Returns 1 if older output has been overwritten, so the buffer no longer holds all of it. */
+int ring_wrapped(RingBuf *rb);
+
+/* Gives the contents, oldest first, as up to two pieces (the second may be empty). */
+void ring_pieces(RingBuf *rb, const char **first, size_t *first_len, const char **second, size_t *second_len);
+
+/* Writes the contents to fd, oldest first. Returns 0 on success, -1 on a write error. */
+int ring_dump(RingBuf *rb, int fd);
+
+#endif /*RINGBUF_H*/
@@ -0,0 +1,306 @@
+/* Parallel substring search over task output.
+ *
+ * Every source is mapped (files) or used in place (memory) and cut into chunks
+ * that end on a line boundary. Worker threads take chunks off a shared counter,
+ * find matches with a memchr prefilter on the rarest byte of the pattern, and
+ * count lines with memchr. Line numbers are made absolute afterwards from the
+ * per-chunk line counts, so no chunk has to wait for the one before it. */
+
+#define _GNU_SOURCE /* memrchr */
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "search.h"
+
+#define CHUNK_SIZE (4 * 1024 * 1024)
+#define MAX_WORKERS 64
+
+typedef struct
+{
+    unsigned long line; // line number within the chunk, from 0
+    const char *text;   // start of the line
+    size_t len;         // length of the line without '\n'
+} Match;
+
+typedef struct
+{
+    int source;            // index into the sources
+    const char *start;     // first byte (always at the start of a line)
+    size_t len;            // bytes in the chunk
+    unsigned long lines;   // newlines in the chunk
+    Match *matches;        // matching lines found
+    size_t num_matches;
+    size_t cap_matches;
+} Chunk;
+
+typedef struct
+{
+    Chunk *chunks;
+    size_t num_chunks;
+    atomic_size_t next; // next chunk to hand out
+    const char *pattern;
+    size_t pattern_len;
+    size_t rare;        // index of the pattern byte used as the prefilter
+} SearchJob;
+
+/*
+ * Rough frequency rank of bytes in text output; lower means rarer. Digits, lower
+ * case letters and spaces are common, everything else is treated as rare.
+ */
+static int byte_rank(unsigned char c)
+{
+    if (c == ' ' || c == 'e' || c == 't' || c == 'a' || c == 'o' || c == 'n')
+    {
+        return 4;
+    }
+    if ((c >= 'a' && c <= 'z') || (c >= '0' && c <= '9'))
+    {
+        return 3;
+    }
+    if (c >= 'A' && c <= 'Z')
+    {
+        return 2;
+    }
+    return 1;
+}
+
+static size_t count_newlines(const char *p, const char *end)
+{
+    size_t count = 0;
+    while (p < end && (p = memchr(p, '\n', end - p)))
+    {
+        count++;
+        p++;
+    }
+    return count;
+}
+
+static void add_match(Chunk *chunk, unsigned long line, const char *text, size_t len)
+{
+    if (chunk->num_matches == chunk->cap_matches)
+    {
+        size_t cap = chunk->cap_matches ? chunk->cap_matches * 2 : 16;
+        Match *grown = realloc(chunk->matches, cap * sizeof(Match));
+        if (!grown)
+        {
+            return;
+        }
+        chunk->matches = grown;
+        chunk->cap_matches = cap;
+    }
+    chunk->matches[chunk->num_matches].line = line;
+    chunk->matches[chunk->num_matches].text = text;
+    chunk->matches[chunk->num_matches].len = len;
+    chunk->num_matches++;
+}
+
+/*
+ * Finds every line of a chunk that contains the pattern (each line reported once).
+ */
+static void search_chunk(SearchJob *job, Chunk *chunk)
+{
+    const char *p = chunk->start;
+    const char *end = chunk->start + chunk->len;
+    const char *counted = p; // newlines before this point are in line
+    unsigned long line = 0;
+    unsigned char rare_byte = (unsigned char)job->pattern[job->rare];
+
+    while ((size_t)(end - p) >= job->pattern_len)
+    {
+        const char *hit = memchr(p + job->rare, rare_byte, end - p - job->rare);
+        if (!hit)
+        {
+            break;
+        }
+        const char *candidate = hit - job->rare;
+        if (candidate + job->pattern_len > end || memcmp(candidate, job->pattern, job->pattern_len) != 0)
+        {
+            p = candidate + 1;
+            continue;
+        }
+
+        line += count_newlines(counted, candidate);
+        const char *line_start = memrchr(chunk->start, '\n', candidate - chunk->start);
+        line_start = line_start ? line_start + 1 : chunk->start;
+        const char *line_end = memchr(candidate, '\n', end - candidate);
+        if (!line_end)
+        {
+            line_end = end;
+        }
+        add_match(chunk, line, line_start, line_end - line_start);
+
+        if (line_end == end)
+        {
+            counted = end;
+            break;
+        }
+        counted = line_end + 1; // skip the rest of the line
+        line++;
+        p = line_end + 1;
+    }
+    chunk->lines = line + count_newlines(counted, end);
+}
+
+static void *search_worker(void *arg)
+{
+    SearchJob *job = arg;
+    size_t i;
+    while ((i = atomic_fetch_add(&job->next, 1)) < job->num_chunks)
+    {
+        search_chunk(job, &job->chunks[i]);
+    }
+    return NULL;
+}
+
+long search_sources(SearchSource *sources, int count, const char *pattern, long max_report, SearchReport report)
+{
+    SearchJob job;
+    pthread_t workers[MAX_WORKERS];
+    char **maps = calloc(count, sizeof(char *));
+    size_t *map_lens = calloc(count, sizeof(size_t));
+    size_t cap_chunks = 64;
+    long total = 0;
+
+    memset(&job, 0, sizeof(job));
+    job.pattern = pattern;
+    job.pattern_len = strlen(pattern);
+    job.chunks = malloc(cap_chunks * sizeof(Chunk));
+    if (!maps || !map_lens || !job.chunks || job.pattern_len == 0)
+    {
+        free(maps);
+        free(map_lens);
+        free(job.chunks);
+        return -1;
+    }
+    for (size_t i = 1; i < job.pattern_len; i++)
+    {
+        if (byte_rank((unsigned char)pattern[i]) < byte_rank((unsigned char)pattern[job.rare]))
+        {
+            job.rare = i;
+        }
+    }
+
+    /* map the files and cut every source into line-aligned chunks */
+    for (int s = 0; s < count; s++)
+    {
+        const char *data = sources[s].data;
+        size_t len = sources[s].len;
+        if (sources[s].path)
+        {
+            struct stat st;
+            int fd = open(sources[s].path, O_RDONLY | O_CLOEXEC);
+            if (fd == -1)
+            {
+                continue;
+            }
+            if (fstat(fd, &st) == 0 && st.st_size > 0)
+            {
+                maps[s] = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+                if (maps[s] == MAP_FAILED)
+                {
+                    maps[s] = NULL;
+                }
+                else
+                {
+                    map_lens[s] = st.st_size;
+                    madvise(maps[s], st.st_size, MADV_SEQUENTIAL);
+                }
+            }
+            close(fd);
+            data = maps[s];
+            len = map_lens[s];
+        }
+
+        while (data && len > 0)
+        {
+            size_t take = len;
+            if (take > CHUNK_SIZE)
+            {
+                const char *nl = memchr(data + CHUNK_SIZE, '\n', len - CHUNK_SIZE);
+                take = nl ? (size_t)(nl - data) + 1 : len;
+            }
+            if (job.num_chunks == cap_chunks)
+            {
+                cap_chunks *= 2;
+                Chunk *grown = realloc(job.chunks, cap_chunks * sizeof(Chunk));
+                if (!grown)
+                {
+                    break;
+                }
+                job.chunks = grown;
+            }
+            Chunk *chunk = &job.chunks[job.num_chunks++];
+            memset(chunk, 0, sizeof(Chunk));
+            chunk->source = s;
+            chunk->start = data;
+            chunk->len = take;
+            data += take;
+            len -= take;
+        }
+    }
+
+    /* search the chunks in parallel */
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    size_t num_workers = (cpus > 0) ? (size_t)cpus : 1;
+    if (num_workers > MAX_WORKERS)
+    {
+        num_workers = MAX_WORKERS;
+    }
+    if (num_workers > job.num_chunks)
+    {
+        num_workers = job.num_chunks;
+    }
+    atomic_init(&job.next, 0);
+    size_t started = 0;
+    for (; started < num_workers; started++)
+    {
+        if (pthread_create(&workers[started], NULL, search_worker, &job) != 0)
+        {
+            break;
+        }
+    }
+    search_worker(&job); // the calling thread helps too
+    for (size_t w = 0; w < started; w++)
+    {
+        pthread_join(workers[w], NULL);
+    }
+
+    /* report in source order with absolute line numbers */
+    unsigned long base = 0;
+    for (size_t c = 0; c < job.num_chunks; c++)
+    {
+        Chunk *chunk = &job.chunks[c];
+        if (c == 0 || chunk->source != job.chunks[c - 1].source)
+        {
+            base = sources[chunk->source].line_base;
+        }
+        for (size_t m = 0; m < chunk->num_matches; m++, total++)
+        {
+            if (total < max_report)
+            {
+                report(sources[chunk->source].task_id, base + chunk->matches[m].line + 1,
+                       chunk->matches[m].text, chunk->matches[m].len);
+            }
+        }
+        base += chunk->lines;
+        free(chunk->matches);
+    }
+
+    for (int s = 0; s < count; s++)
+    {
+        if (maps[s])
+        {
+            munmap(maps[s], map_lens[s]);
+        }
+    }
+    free(maps);
+    free(map_lens);
+    free(job.chunks);
+    return total;
+}
@@ -0,0 +1,25 @@
+#ifndef SEARCH_H
+#define SEARCH_H
+
+#include <stddef.h>
+
+/* Something to search: a file (path set) or a block of memory (data set). */
+typedef struct SearchSource
+{
+    int task_id;      // task the output belongs to
+    const char *path; // file to map, or NULL
+    const char *data; // memory to search when path is NULL
+    size_t len;       // length of data
+    unsigned long line_base; // lines of the task's output before the first one of the source
+} SearchSource;
+
+/* Called for every matching line, in task order and then line order. Line numbers
+ * count from 1 at the start of the task's output, i.e. line_base + line in the source. */
+typedef void (*SearchReport)(int task_id, unsigned long line, const char *text, size_t len);
+
+/* Searches all sources for lines containing pattern, using worker threads over
+ * line-aligned chunks. At most max_report matches are passed to report.
+ * Returns the number of matching lines, or -1 on error. */
+long search_sources(SearchSource *sources, int count, const char *pattern, long max_report, SearchReport report);
+
+#endif /*SEARCH_H*/
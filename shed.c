@@ -0,0 +1,84 @@
+/* Decisions of memory pressure load shedding, with hysteresis. */
+
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <time.h>
+
+#include "shed.h"
+
+static int meminfo_fd = -2;      // -2 until opened, -1 if not available
+static struct timespec last_step; // when the last task was suspended or resumed
+static int stepped = 0;           // 1 once a step was taken
+static struct timespec calm_since; // since when pressure is low enough to resume
+static int calm = 0;
+
+static double seconds_since_ts(const struct timespec *start)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (now.tv_sec - start->tv_sec) + (now.tv_nsec - start->tv_nsec) / 1e9;
+}
+
+long shed_mem_available(void)
+{
+    char buffer[4096];
+
+    if (meminfo_fd == -2)
+    { // kept open: rereading from offset 0 gives fresh values
+        meminfo_fd = open("/proc/meminfo", O_RDONLY | O_CLOEXEC);
+    }
+    if (meminfo_fd == -1)
+    {
+        return -1;
+    }
+    ssize_t n = pread(meminfo_fd, buffer, sizeof(buffer) - 1, 0);
+    if (n <= 0)
+    {
+        return -1;
+    }
+    buffer[n] = '\0';
+    char *avail = strstr(buffer, "MemAvailable:");
+    if (!avail)
+    {
+        return -1; // before Linux 3.14
+    }
+    return strtol(avail + strlen("MemAvailable:"), NULL, 10);
+}
+
+int shed_decide(double pressure, long avail_kb, long psi_limit, long avail_floor_mb, long hold_secs, int suspended)
+{
+    long floor_kb = avail_floor_mb * 1024;
+    int high = (psi_limit > 0 && pressure >= psi_limit) || (floor_kb > 0 && avail_kb >= 0 && avail_kb < floor_kb);
+    int low = (psi_limit == 0 || pressure < psi_limit / 2.0) &&
+              (floor_kb == 0 || avail_kb < 0 || avail_kb >= floor_kb + floor_kb / 2);
+
+    if (!low)
+    {
+        calm = 0;
+    }
+    else if (!calm)
+    {
+        calm = 1;
+        clock_gettime(CLOCK_MONOTONIC, &calm_since);
+    }
+
+    /* avg10 takes a while to reflect a step, so wait a hold time before the next one */
+    int rested = !stepped || seconds_since_ts(&last_step) >= hold_secs;
+    if (high && rested)
+    {
+        return SHED_SUSPEND;
+    }
+    if (low && suspended > 0 && rested && seconds_since_ts(&calm_since) >= hold_secs)
+    {
+        return SHED_RESUME;
+    }
+    return SHED_NONE;
+}
+
+void shed_stepped(void)
+{
+    clock_gettime(CLOCK_MONOTONIC, &last_step);
+    stepped = 1;
+}
@@ -0,0 +1,29 @@
+#ifndef SHED_H
+#define SHED_H
+
+/* Load shedding under memory pressure: decides when background tasks should
+ * be suspended automatically, and when they may be resumed again. Tasks are
+ * suspended above a threshold and only resumed once pressure has stayed well
+ * below it (half the memory pressure, one and a half times the available
+ * memory) for a hold time, one task per hold time either way, so that the
+ * tasks do not flap between states. */
+
+/* Steps returned by shed_decide() */
+#define SHED_NONE    0
+#define SHED_SUSPEND 1 /* suspend one more task */
+#define SHED_RESUME  2 /* resume one automatically suspended task */
+
+/* Reads MemAvailable from /proc/meminfo, in KiB. Returns -1 if it is unknown. */
+long shed_mem_available(void);
+
+/* Decides the next step given the memory pressure ("some avg10", %, -1 if
+ * unknown) and the available memory (KiB, -1 if unknown), the thresholds
+ * psi_limit (%) and avail_floor_mb (MiB), 0 for none, the hold time in
+ * seconds and the number of tasks suspended so far. Meant to be called about
+ * once a second. */
+int shed_decide(double pressure, long avail_kb, long psi_limit, long avail_floor_mb, long hold_secs, int suspended);
+
+/* Records that a step was taken, which starts a new hold time. */
+void shed_stepped(void);
+
+#endif /*SHED_H*/
@@ -0,0 +1,632 @@
+/* Stress test for taskman (make stress).
+ *
+ * Drives a fresh taskman with thousands of concurrent children built from
+ * stress_child: short-lived ones, long-lived ones that get random cancel,
+ * suspend and resume commands, ones that kill or stop themselves, and
+ * foreground ones that get control-c or control-z (SIGINT or SIGTSTP sent to
+ * taskman, as a terminal does). Once everything has settled, the task table
+ * is checked against the state each task must have ended in. Reports wrong
+ * final states, transitions that were never reported, and how long taskman
+ * took to report a signalled process.
+ *
+ *   taskman_stress [--tasks N] [--ops N] [--seed S] [--taskman PATH]
+ *
+ * Exits with 0 if nothing was lost or wrong, 1 otherwise.
+ */
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <poll.h>
+#include <signal.h>
+#include <time.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+
+/* Kinds of tasks */
+#define KIND_ECHO  0 /* exits at once with a code */
+#define KIND_SLEEP 1 /* runs until cancelled, gets random commands meanwhile */
+#define KIND_TERM  2 /* kills itself with SIGTERM */
+#define KIND_STOP  3 /* stops itself with SIGSTOP */
+#define KIND_FG    4 /* runs in the foreground and gets control-c or control-z */
+#define KINDS      5
+
+#define SETTLE_SECS  60 /* how long the final table may take to match */
+#define STEP_SECS    10 /* how long a single expected report may take */
+#define MAX_REPORTED 20 /* wrong tasks listed */
+
+typedef struct Task
+{
+    int kind;
+    int code;           // exit code of a KIND_ECHO task
+    const char *expect; // state the task must be in at the end
+    int ready;          // 1 once the program reported that it runs
+    int cancelled;      // 1 once cancelled; no further commands are sent to it
+    double sent;        // when a signal whose report is timed was sent, 0 if none
+    int reported;       // 1 once taskman reported the outcome of that signal
+    const char *seen;   // state in the latest task table, NULL if not listed
+    int seen_code;      // exit code in the latest task table
+} Task;
+
+static const char *states[] = {"Standby", "Working", "Suspended", "Complete", "Killed", "Pending"};
+static const char *kind_names[KINDS] = {"short", "long", "self-killing", "self-stopping", "foreground"};
+
+static Task *tasks;
+static int num_tasks;
+static pid_t taskman_pid;
+static int to_taskman = -1, from_taskman = -1;
+static char *out_queue;   // commands not written to taskman yet
+static size_t out_len, out_cap;
+static char in_buf[1 << 16];
+static size_t in_len;
+static int added;         // "Adding Task ID" lines seen
+static int table_left;    // rows of the task table still to come
+static int tables;        // task tables fully read
+static double *latency[2]; // report delays of cancels and of keyboard signals, in ms
+static int num_latency[2];
+static unsigned long long rng;
+
+static double now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/*
+ * xorshift64*, so that a run can be repeated with its seed.
+ */
+static unsigned long random_below(unsigned long n)
+{
+    rng ^= rng >> 12;
+    rng ^= rng << 25;
+    rng ^= rng >> 27;
+    return (unsigned long)((rng * 2685821657736338717ULL) >> 33) % n;
+}
+
+/*
+ * Queues a command line for taskman.
+ */
+static void send(const char *format, ...)
+{
+    char line[128];
+    va_list ap;
+    va_start(ap, format);
+    int len = vsnprintf(line, sizeof(line) - 1, format, ap);
+    va_end(ap);
+    line[len++] = '\n';
+    if (out_len + len > out_cap)
+    {
+        out_cap = (out_len + len) * 2;
+        out_queue = realloc(out_queue, out_cap);
+        if (!out_queue)
+        {
+            perror("taskman_stress");
+            exit(2);
+        }
+    }
+    memcpy(out_queue + out_len, line, len);
+    out_len += len;
+}
+
+/*
+ * Removes colours and prompts from a line of taskman output.
+ */
+static void clean_line(char *line)
+{
+    char *in = line, *out = line;
+    while (*in)
+    {
+        if (in[0] == '\033' && in[1] == '[')
+        {
+            in += 2;
+            while (*in && !(*in >= '@' && *in <= '~'))
+            {
+                in++;
+            }
+            in += (*in != '\0');
+        }
+        else if (strncmp(in, "A-A: ", 5) == 0)
+        {
+            in += 5;
+        }
+        else
+        {
+            *out++ = *in++;
+        }
+    }
+    *out = '\0';
+}
+
+static Task *task_by_id(int id)
+{
+    return (id >= 1 && id <= num_tasks) ? &tasks[id - 1] : NULL;
+}
+
+/*
+ * Reads one row of the task table: "Task N: CMD (PID P; STATE; PRIO[; exit code C])".
+ */
+static void table_row(const char *row)
+{
+    int id;
+    const char *fields = strrchr(row, '(');
+    if (sscanf(row, "Task %d:", &id) != 1 || !fields)
+    {
+        return;
+    }
+    Task *task = task_by_id(id);
+    fields++;
+    if (strncmp(fields, "PID ", 4) == 0)
+    {
+        fields = strstr(fields, "; ");
+        fields = fields ? fields + 2 : "";
+    }
+    if (task)
+    {
+        task->seen = NULL;
+        for (size_t i = 0; i < sizeof(states) / sizeof(states[0]); i++)
+        {
+            size_t len = strlen(states[i]);
+            if (strncmp(fields, states[i], len) == 0 && (fields[len] == ';' || fields[len] == ')'))
+            {
+                task->seen = states[i];
+            }
+        }
+        const char *code = strstr(fields, "exit code ");
+        task->seen_code = code ? atoi(code + strlen("exit code ")) : 0;
+    }
+}
+
+static void handle_line(char *line)
+{
+    int id, pid, count;
+    char *text;
+
+    clean_line(line);
+    if ((text = strstr(line, "stress_child ")) && sscanf(text, "stress_child %d ready", &id) == 1)
+    {
+        if (task_by_id(id))
+        {
+            task_by_id(id)->ready = 1;
+        }
+        return;
+    }
+    text = strstr(line, "[AALOG] ");
+    if (!text)
+    {
+        return;
+    }
+    text += strlen("[AALOG] ");
+
+    if (sscanf(text, "Adding Task ID %d:", &id) == 1)
+    {
+        if (id != ++added)
+        {
+            fprintf(stderr, "taskman_stress: expected task %d, taskman added task %d\n", added, id);
+            exit(2);
+        }
+    }
+    else if (table_left > 0 && strncmp(text, "Task ", 5) == 0)
+    {
+        table_row(text);
+        if (--table_left == 0)
+        {
+            tables++;
+        }
+    }
+    else if (sscanf(text, "%d Task(s)", &count) == 1)
+    {
+        table_left = count;
+        if (count == 0)
+        {
+            tables++;
+        }
+    }
+    else if ((text = strstr(text, " Process ")) && sscanf(text, " Process %d (Task %d):", &pid, &id) == 2)
+    {
+        Task *task = task_by_id(id);
+        if (task && task->sent > 0 && !task->reported &&
+            (strstr(text, "(Terminated by Signal)") || strstr(text, "(Terminated Normally)") ||
+             strstr(text, "(Stopped)")))
+        {
+            int which = (task->kind == KIND_FG);
+            latency[which][num_latency[which]++] = (now() - task->sent) * 1000;
+            task->reported = 1;
+        }
+    }
+}
+
+/*
+ * Writes queued commands and reads taskman's output for up to timeout seconds,
+ * or until some output arrived.
+ */
+static void pump(double timeout)
+{
+    struct pollfd fds[2] = {{from_taskman, POLLIN, 0}, {to_taskman, out_len ? POLLOUT : 0, 0}};
+    if (poll(fds, 2, (int)(timeout * 1000)) <= 0)
+    {
+        return;
+    }
+    if (fds[1].revents & (POLLOUT | POLLERR))
+    {
+        ssize_t n = write(to_taskman, out_queue, out_len);
+        if (n > 0)
+        {
+            memmove(out_queue, out_queue + n, out_len - n);
+            out_len -= n;
+        }
+    }
+    if (fds[0].revents & (POLLIN | POLLHUP))
+    {
+        ssize_t n = read(from_taskman, in_buf + in_len, sizeof(in_buf) - 1 - in_len);
+        if (n <= 0)
+        {
+            fprintf(stderr, "taskman_stress: taskman exited\n");
+            exit(2);
+        }
+        in_len += n;
+        char *start = in_buf, *end;
+        while ((end = memchr(start, '\n', in_buf + in_len - start)))
+        {
+            *end = '\0';
+            handle_line(start);
+            start = end + 1;
+        }
+        in_len -= start - in_buf;
+        memmove(in_buf, start, in_len);
+        if (in_len == sizeof(in_buf) - 1)
+        {
+            in_len = 0; // a line this long is nothing we look for
+        }
+    }
+}
+
+/*
+ * Keeps pumping until *value reaches target or timeout seconds have passed.
+ * Returns 1 if it was reached.
+ */
+static int wait_for(const int *value, int target, double timeout)
+{
+    double deadline = now() + timeout;
+    while (*value < target && now() < deadline)
+    {
+        pump(0.05);
+    }
+    return *value >= target;
+}
+
+static void start_taskman(const char *path)
+{
+    int in[2], out[2];
+    if (pipe2(in, O_CLOEXEC) == -1 || pipe2(out, O_CLOEXEC) == -1)
+    {
+        perror("taskman_stress");
+        exit(2);
+    }
+    taskman_pid = fork();
+    if (taskman_pid == 0)
+    {
+        dup2(in[0], STDIN_FILENO);
+        dup2(out[1], STDOUT_FILENO);
+        dup2(out[1], STDERR_FILENO);
+        execl(path, path, (char *)NULL);
+        perror(path);
+        _exit(127);
+    }
+    close(in[0]);
+    close(out[1]);
+    to_taskman = in[1];
+    from_taskman = out[0];
+    fcntl(to_taskman, F_SETFL, O_NONBLOCK);
+    signal(SIGPIPE, SIG_IGN);
+}
+
+/*
+ * Creates the tasks and starts every one that does not run in the foreground.
+ */
+static void launch(void)
+{
+    for (int id = 1; id <= num_tasks; id++)
+    {
+        Task *task = &tasks[id - 1];
+        unsigned long roll = random_below(100);
+        task->kind = (roll < 40) ? KIND_ECHO : (roll < 75) ? KIND_SLEEP : (roll < 85) ? KIND_TERM
+                                                                      : (roll < 95) ? KIND_STOP : KIND_FG;
+        switch (task->kind)
+        {
+        case KIND_ECHO:
+            task->code = (int)random_below(4);
+            task->expect = "Complete";
+            send("stress_child echo %d", task->code);
+            break;
+        case KIND_SLEEP:
+        case KIND_FG:
+            task->expect = "Working";
+            send("stress_child sleep 600 %d", id);
+            break;
+        case KIND_TERM:
+            task->expect = "Killed";
+            send("stress_child raise %d %lu %d", SIGTERM, random_below(500), id);
+            break;
+        default:
+            task->expect = "Suspended";
+            send("stress_child raise %d %lu %d", SIGSTOP, random_below(500), id);
+        }
+    }
+    if (!wait_for(&added, num_tasks, STEP_SECS + num_tasks / 100))
+    {
+        fprintf(stderr, "taskman_stress: only %d of %d tasks were added\n", added, num_tasks);
+        exit(2);
+    }
+    for (int id = 1; id <= num_tasks; id++)
+    {
+        if (tasks[id - 1].kind != KIND_FG)
+        {
+            send("bg %d", id);
+        }
+    }
+}
+
+/*
+ * Runs a foreground task and interrupts or stops it from the "keyboard".
+ */
+static void keyboard_signal(int id)
+{
+    Task *task = &tasks[id - 1];
+    send("run %d", id);
+    if (!wait_for(&task->ready, 1, STEP_SECS))
+    {
+        return; // it never ran: its state is checked all the same
+    }
+    int stop = (int)random_below(2);
+    task->expect = stop ? "Suspended" : "Killed";
+    task->sent = now();
+    kill(taskman_pid, stop ? SIGTSTP : SIGINT);
+    wait_for(&task->reported, 1, STEP_SECS);
+}
+
+/*
+ * Sends a random cancel, suspend or resume to a long-lived task that runs.
+ */
+static void random_command(void)
+{
+    Task *task = NULL;
+    for (int tries = 0; tries < 16 && !task; tries++)
+    {
+        int id = (int)random_below(num_tasks) + 1;
+        Task *candidate = &tasks[id - 1];
+        if (candidate->kind == KIND_SLEEP && candidate->ready && !candidate->cancelled)
+        {
+            task = candidate;
+        }
+    }
+    if (!task)
+    {
+        return;
+    }
+    int id = (int)(task - tasks) + 1;
+    if (random_below(10) < 3)
+    {
+        send("cancel %d", id);
+        task->expect = "Killed";
+        task->cancelled = 1;
+        task->sent = now();
+    }
+    else if (strcmp(task->expect, "Working") == 0)
+    {
+        send("suspend %d", id);
+        task->expect = "Suspended";
+    }
+    else
+    {
+        send("resume %d", id);
+        task->expect = "Working";
+    }
+}
+
+/*
+ * Reads the task table and counts the tasks not in their expected state.
+ */
+static int check_table(void)
+{
+    int before = tables;
+    send("tasks");
+    if (!wait_for(&tables, before + 1, STEP_SECS))
+    {
+        return num_tasks;
+    }
+    int wrong = 0;
+    for (int i = 0; i < num_tasks; i++)
+    {
+        Task *task = &tasks[i];
+        wrong += !task->seen || strcmp(task->seen, task->expect) != 0 ||
+                 (task->kind == KIND_ECHO && task->seen_code != task->code);
+    }
+    return wrong;
+}
+
+static int compare_ms(const void *a, const void *b)
+{
+    double x = *(const double *)a, y = *(const double *)b;
+    return (x > y) - (x < y);
+}
+
+static void report_latency(const char *what, int which)
+{
+    int n = num_latency[which];
+    if (n == 0)
+    {
+        printf("%s: none timed\n", what);
+        return;
+    }
+    qsort(latency[which], n, sizeof(double), compare_ms);
+    printf("%s: %d timed, p50 %.1f ms, p99 %.1f ms, max %.1f ms\n", what, n, latency[which][n / 2],
+           latency[which][(n * 99) / 100], latency[which][n - 1]);
+}
+
+int main(int argc, char *argv[])
+{
+    const char *path = "./taskman";
+    int ops = -1;
+    num_tasks = 2000;
+    rng = (unsigned long long)time(NULL) ^ ((unsigned long long)getpid() << 32);
+
+    for (int i = 1; i < argc; i++)
+    {
+        if (strcmp(argv[i], "--tasks") == 0 && i + 1 < argc)
+        {
+            num_tasks = atoi(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--ops") == 0 && i + 1 < argc)
+        {
+            ops = atoi(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--seed") == 0 && i + 1 < argc)
+        {
+            rng = strtoull(argv[++i], NULL, 10);
+        }
+        else if (strcmp(argv[i], "--taskman") == 0 && i + 1 < argc)
+        {
+            path = argv[++i];
+        }
+        else
+        {
+            fprintf(stderr, "Usage: taskman_stress [--tasks N] [--ops N] [--seed S] [--taskman PATH]\n");
+            return 2;
+        }
+    }
+    if (num_tasks < 1)
+    {
+        num_tasks = 1;
+    }
+    if (ops < 0)
+    {
+        ops = num_tasks;
+    }
+    rng += !rng; // xorshift never leaves 0
+    unsigned long long seed = rng;
+
+    tasks = calloc(num_tasks, sizeof(Task));
+    latency[0] = calloc(num_tasks, sizeof(double));
+    latency[1] = calloc(num_tasks, sizeof(double));
+    if (!tasks || !latency[0] || !latency[1])
+    {
+        perror("taskman_stress");
+        return 2;
+    }
+
+    start_taskman(path);
+    launch();
+
+    /* random commands, with the foreground tasks run one at a time in between */
+    int foreground = 0, keyboard = 0;
+    for (int i = 0; i < num_tasks; i++)
+    {
+        foreground += (tasks[i].kind == KIND_FG);
+    }
+    int next_fg = 0;
+    for (int op = 0; op < ops || next_fg < num_tasks; op++)
+    {
+        if (op < ops)
+        {
+            random_command();
+            pump(0.001);
+        }
+        if (foreground > 0 && (op >= ops || op % (ops / foreground + 1) == 0))
+        {
+            while (next_fg < num_tasks && tasks[next_fg].kind != KIND_FG)
+            {
+                next_fg++;
+            }
+            if (next_fg < num_tasks)
+            {
+                keyboard_signal(next_fg + 1);
+                keyboard++;
+                next_fg++;
+            }
+        }
+        else if (op >= ops)
+        {
+            break;
+        }
+    }
+
+    /* let everything settle */
+    double deadline = now() + SETTLE_SECS;
+    int wrong;
+    while ((wrong = check_table()) > 0 && now() < deadline)
+    {
+        pump(0.25);
+    }
+    int lost = 0;
+    for (int i = 0; i < num_tasks; i++)
+    {
+        lost += (tasks[i].sent > 0 && !tasks[i].reported);
+    }
+
+    int per_kind[KINDS] = {0};
+    for (int i = 0; i < num_tasks; i++)
+    {
+        per_kind[tasks[i].kind]++;
+    }
+    printf("seed %llu: %d tasks (", seed, num_tasks);
+    for (int k = 0; k < KINDS; k++)
+    {
+        printf("%d %s%s", per_kind[k], kind_names[k], k + 1 < KINDS ? ", " : ")");
+    }
+    printf(", %d random commands, %d keyboard signals\n", ops, keyboard);
+    report_latency("cancel to report", 0);
+    report_latency("keyboard signal to report", 1);
+    printf("signals without a report: %d, tasks in a wrong state: %d\n", lost, wrong);
+    int listed = 0;
+    for (int i = 0; i < num_tasks && listed < MAX_REPORTED; i++)
+    {
+        Task *task = &tasks[i];
+        int bad = !task->seen || strcmp(task->seen, task->expect) != 0 ||
+                  (task->kind == KIND_ECHO && task->seen_code != task->code);
+        if (bad || (task->sent > 0 && !task->reported))
+        {
+            printf("  Task %d (%s): expected %s", i + 1, kind_names[task->kind], task->expect);
+            if (task->kind == KIND_ECHO)
+            {
+                printf(" with exit code %d", task->code);
+            }
+            printf(", listed as %s", task->seen ? task->seen : "(missing)");
+            if (task->seen && task->kind == KIND_ECHO)
+            {
+                printf(" with exit code %d", task->seen_code);
+            }
+            printf("%s\n", (task->sent > 0 && !task->reported) ? ", outcome never reported" : "");
+            listed++;
+        }
+    }
+
+    /* clean up: whatever still runs is cancelled, then taskman quits */
+    send("cancel all");
+    send("quit");
+    deadline = now() + STEP_SECS;
+    while (waitpid(taskman_pid, NULL, WNOHANG) == 0 && now() < deadline)
+    {
+        struct pollfd fd = {from_taskman, POLLIN, 0};
+        if (out_len)
+        {
+            pump(0.05);
+        }
+        else if (poll(&fd, 1, 50) > 0 && read(from_taskman, in_buf, sizeof(in_buf)) <= 0)
+        {
+            usleep(10000); // output closed, the exit is near
+        }
+    }
+    if (waitpid(taskman_pid, NULL, WNOHANG) == 0)
+    {
+        kill(taskman_pid, SIGKILL);
+        waitpid(taskman_pid, NULL, 0);
+    }
+    return (lost || wrong) ? 1 : 0;
+}
@@ -0,0 +1,49 @@
+/* A sample program used by the stress test (see stress.c), combining
+ * my_echo, slow_cooker and my_pause with a self-signalling mode.
+ * - "stress_child echo K" exits right away with status K.
+ * - "stress_child sleep S ID" reports that it is ready, then sleeps S seconds.
+ * - "stress_child raise SIG MS ID" reports that it is ready, waits MS
+ *   milliseconds and then sends itself SIG.
+ * Ready lines read "stress_child ID ready", so that the stress test knows
+ *   when signals sent to the task reach the program itself.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <signal.h>
+#include <time.h>
+
+static void ready(const char *id)
+{
+   char line[64];
+   int len = snprintf(line, sizeof(line), "stress_child %s ready\n", id);
+   write(STDOUT_FILENO, line, len); /* one write, so lines of many children do not mix */
+}
+
+int main(int argc, char *argv[]){
+   if (argc == 3 && strcmp(argv[1], "echo") == 0)
+	return atoi(argv[2]);
+
+   if (argc == 4 && strcmp(argv[1], "sleep") == 0){
+	ready(argv[3]);
+	struct timespec left = {atoi(argv[2]), 0};
+	while (nanosleep(&left, &left) == -1)
+	   ;
+	return 0;
+   }
+
+   if (argc == 5 && strcmp(argv[1], "raise") == 0){
+	ready(argv[4]);
+	long ms = atol(argv[3]);
+	struct timespec delay = {ms / 1000, (ms % 1000) * 1000000L};
+	while (nanosleep(&delay, &delay) == -1)
+	   ;
+	raise(atoi(argv[2]));
+	return 0;
+   }
+
+   fprintf(stderr, "usage: stress_child echo K | sleep S ID | raise SIG MS ID\n");
+   return 2;
+}
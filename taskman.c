@@ -4,20 +4,96 @@
  * GNumber: G01139446
  */
 
+#define _GNU_SOURCE /* pipe2 */
 #include <sys/wait.h>
+#include <sys/signalfd.h>
+#include <sys/mman.h>
+#include <sys/timerfd.h>
+#include <stdint.h>
 #include "taskman.h"
 #include "parse.h"
 #include "util.h"
+#include "prio.h"
+#include "procstat.h"
+#include "events.h"
+#include "ringbuf.h"
+#include "config.h"
+#include "bench.h"
+#include "search.h"
+#include "logindex.h"
+#include "logrotate.h"
+#include "metrics.h"
+#include "trace.h"
+#include "intern.h"
+#include "broadcast.h"
+#include "map.h"
+#include "cache.h"
+#include "watch.h"
+#include "history.h"
+#include "admit.h"
+#include "reaper.h"
+#include "shed.h"
 
 /* Constants */
 #define DEBUG 0
 #define NUM_PATHS 2
+#define SEARCH_MAX_SHOWN 1000 /* matching lines printed by search */
+
+/* Where the saved output of a task is (see output_source) */
+#define OUTPUT_NONE 0
+#define OUTPUT_FILE 1
+#define OUTPUT_RING 2
+
+/* What the wait built-ins wait for (see wait_command) */
+#define WAIT_FOR_TASKS 0 /* wait: every task named */
+#define WAIT_FOR_ANY   1 /* waitany: the first running task to finish */
+#define WAIT_FOR_ALL   2 /* waitall: every running task */
+
+/* Status of a wait cut short */
+#define WAIT_TIMED_OUT   124 /* as timeout(1) */
+#define WAIT_INTERRUPTED 130 /* as a shell after control-c */
 
 /* Structures */
+/* State of a task's run that only exists while the run is live: from its launch,
+ * or from being held back by admission control, until its process has been
+ * reaped and its output drained (see run_begin and run_end). */
+typedef struct Run_t
+{
+    ProcStat stats;         // open /proc files of the running process, used by top
+    int pidfd;              // pidfd of the running process, -1 once it has been reaped
+    EvWatch watch;          // event loop registration of pidfd
+    int out_fd;             // read end of the pipe capturing stdout, and stderr too without err_fd, -1 if none
+    EvWatch out_watch;      // event loop registration of out_fd
+    int err_fd;             // read end of a pipe capturing stderr apart for the result cache, -1 if none
+    EvWatch err_watch;      // event loop registration of err_fd
+    int log_fd;             // logN.txt while a logged task's output is being captured, else -1
+    CacheRun cache;         // output collected for the result cache during the run
+    struct Node_t *pending_next; // next task in the admission queue (see Tasks_t)
+    char *pending_file;     // input file of the held back launch (interned), NULL if none
+    int pending_logged;     // 1 if the held back launch is a log
+    int pending_in_fd;      // stdin pipe of the held back launch (broadcast), -1 if none
+    int tree_wait;          // 1 once the process was reaped while adopted descendants still run
+    unsigned long tree_cpu_ms; // CPU time of the run, with every descendant reaped so far
+    long tree_rss_kb;       // largest resident set among them, in KiB
+    int adopted;            // orphaned descendants reaped for the run (subreaper mode)
+    struct Run_t *retired_next; // next run waiting to be freed (see run_free)
+} Run_t;
+
+/* Output captured by a task's background runs, kept from the first one until the
+ * task is deleted (see output_of). */
+typedef struct Output_t
+{
+    RingBuf ring;           // most recent captured output
+    LogIndex index;         // line offsets of logN.txt, built while it is written
+    unsigned long long log_size; // bytes written to logN.txt since it was started
+    unsigned long long log_base; // lines rotated out of the log before the first line of logN.txt
+    unsigned long long lines; // newlines captured during the last run, to number lines in output
+} Output_t;
+
 typedef struct Node_t
 {
-    char *instruction;      // only instruction without flags
-    char **argv;            // string array holding instruction and all flags
+    char *instruction;      // only instruction without flags (interned, never modified)
+    char **argv;            // string array holding instruction and all flags (each interned)
     char *command;          // entire instruction with flags
     struct Node_t *next;    // next task in LList
     int state;              // state of task
@@ -26,103 +102,205 @@ typedef struct Node_t
     pid_t pid;              // unique pid of task
     int exit_status;        // exit status of process
     int stopped;            // 1 if process is stopped, 0 by default
+    int prio_class;         // priority class (PRIO_*) the task is launched under
+    unsigned int tags;      // bit (1 << tag) for every user-defined tag on the task
+    Run_t *run;             // the live run, NULL while there is none
+    Output_t *output;       // captured output, NULL until a background run has been started
+    int logged;             // 1 if the last run was started with log
+    struct timespec finished; // when the last run was reaped
+    struct Node_t *done_prev; // neighbours in the list of finished tasks (see Tasks_t)
+    struct Node_t *done_next;
+    int done_listed;          // 1 while in the list of finished tasks
+    int evict;                // 1 once picked for eviction by the retention policy
+    int watched;              // 1 while watch restarts the task when its files change
+    char *watch_file;         // input file of the watched runs (interned), NULL if none
+    int term_signal;          // signal that ended the last run, 0 if it exited
+    int waited;               // 1 while a wait built-in waits for the task
+    RunHistory history;       // outcomes of the most recent runs
+    int shed;                 // 1 while suspended automatically under memory pressure
 
 } Node_t;
 
+/* A set of tasks named on the command line, e.g. "cancel 1-5,9 @nightly suspended" */
+typedef struct Selector_t
+{
+    int low[MAXARGS];      // first ID of each range
+    int high[MAXARGS];     // last ID of each range (same as low for a single ID)
+    int found[MAXARGS];    // 1 once a single ID has matched a task
+    int num_ranges;        // number of ranges in use
+    int state_mask;        // bit (1 << LOG_STATE_*) for every state selected
+    unsigned int tag_mask; // bit (1 << tag) for every tag selected
+    int all;               // 1 if every task is selected
+} Selector_t;
+
 typedef struct Tasks_t
 {
     Node_t *head; // Points to FIRST node of linked list. No Dummy Nodes.
     int count;    // Number of items in list
+    Node_t *done_head; // finished tasks in the order they were reaped, oldest first
+    Node_t *done_tail;
+    int done_count;    // number of finished tasks listed
+    long evicted;          // finished tasks removed by the retention policy
+    long evicted_complete; // of which Complete with exit code 0
+    long evicted_failed;   // of which Complete with another exit code
+    long evicted_killed;   // of which Killed
+    struct timespec last_retention; // when the retention policy last ran
+    Node_t *pending_head; // Pending tasks in the order their launches were held back
+    Node_t *pending_tail;
+    int pending_count;
+    int shed_count;             // tasks suspended by load shedding, as of its last run
+    struct timespec last_shed;  // when load shedding last ran
 } Tasks_t;
 
 /*Function Stubs*/
 void *dmalloc(size_t size);
+char *dintern(const char *s);
 Node_t *create_node(Instruction *i, char *cmd, int taskid, char *argv[]);
 int get_task_id(Tasks_t *tasks);
 int insertEnd(Tasks_t *queue, Node_t *node);
 void print_tasks(Tasks_t *tasks);
+void free_node(Node_t *node);
+Run_t *run_begin(Node_t *node);
+void run_end(Node_t *node);
+void run_free(Node_t *node);
+void free_retired_runs(void);
+Output_t *output_of(Node_t *node);
+char **intern_argv(char *argv[]);
+void release_argv(char **argv);
+void mem_report(Tasks_t *tasks);
+void done_list_add(Tasks_t *tasks, Node_t *node);
+void done_list_remove(Tasks_t *tasks, Node_t *node);
+int retention_due(Tasks_t *tasks);
+void retention_run(Tasks_t *tasks);
+void remove_logs(Node_t *node);
+int shed_due(Tasks_t *tasks);
+void shed_run(Tasks_t *tasks);
+Node_t *shed_pick(Tasks_t *tasks, int step);
+long task_rss_kb(Node_t *node);
 int is_busy(Node_t *node);
+int run_open(Node_t *node);
+void set_state(Node_t *node, int state);
 void delete (Tasks_t *tasks, int taskid);
 void insertAscendingOrder(Tasks_t *tasks, Node_t *node);
 Node_t *find_node(Tasks_t *tasks, int taskid);
+void prio_check(Node_t *node);
 void run_task(Node_t *node, char *file);
 void bg(Node_t *node, char *filename);
 void log_task(Node_t *node, int taskid, char *filename);
+void launch_background(Node_t *node, char *filename, int in_fd, int logged);
+void exec_task(Node_t *node, char *filename, int in_fd, int out_fd, int err_fd);
+void broadcast_command(Tasks_t *tasks, char *args[], int argc);
+void map_command(Tasks_t *tasks, char *args[], int argc);
+pid_t map_spawn(void *ctx, int in_fd, int out_fd);
+void map_pump_events(void);
+void map_report(void *ctx, int chunk, size_t start, size_t end, int code, int signaled);
+void start_log(Node_t *node);
+void start_capture(Node_t *node, int fd);
+void capture_event(Node_t *node, int stream, int drain);
+void save_output(Node_t *node, int stream, const char *buf, size_t len);
+int run_cached(Node_t *node, char *filename, int logged, int foreground);
+int task_executable(Node_t *node, char *path, size_t size);
+void cache_command(char *args[], int argc);
+void watch_command(Tasks_t *tasks, char *args[], int argc, int start);
+void restart_watched(Node_t *node);
+void watched_changed(void *owner);
+void wait_command(Tasks_t *tasks, char *args[], int argc, int mode);
+int wait_pending(Node_t *node);
+int wait_status(Node_t *node);
+void history_command(Node_t *node);
+int history_mode(Node_t *node);
+int admit_launch(Node_t *node, char *filename, int in_fd, int logged);
+void pending_remove(Tasks_t *tasks, Node_t *node);
+void admission_event(Tasks_t *tasks);
+void admission_retry(double seconds);
+void admission_command(Tasks_t *tasks);
+void finish_capture(Node_t *node);
+void write_log(Node_t *node, const char *buf, size_t len);
+void rotate_log(Node_t *node);
+void show_output(Node_t *node, unsigned long long first, unsigned long long last, unsigned long long tail);
+int output_source(Node_t *node, char *filename, size_t size);
+void search_command(Tasks_t *tasks, const char *pattern);
+void set_command(char *args[], int argc);
+void bench_command(Tasks_t *tasks, char *args[], int argc);
+pid_t bench_spawn(void *ctx);
+void bench_pump_events(void);
 void output(char *file);
 int file_exists(char *filename);
-Node_t *find_node_from_pid(Tasks_t *tasks, pid_t processID);
 void cancel(Node_t *node);
 void suspend(Node_t *node);
 void resume(Node_t *node);
 void print_node(Node_t *node);
 void print_tasks2(Tasks_t *tasks);
-void reaper(int status, pid_t pid);
-void fg_reaper(pid_t pid);
+void fg_reaper(Node_t *node);
+int handle_events(int timeout_ms);
+int track_child(Node_t *node, pid_t pid);
+void launch_failed(Node_t *node, int error);
+void abandon_run(Node_t *node);
+void release_pidfd(Node_t *node);
+void task_exit_event(Node_t *node);
+void finish_task(Node_t *node);
+void helper_exit_event(EvWatch *watch);
+int tree_alive(Node_t *node);
+void *task_of_group(pid_t pgid);
+unsigned long cpu_ms_of(const struct rusage *usage);
+void task_stop_scan(Tasks_t *tasks);
+int task_signal(Node_t *node, int sig);
+void want_stdin(int wanted);
+int split_args(const char *cmdline, char *buffer, char *args[], int max);
+int parse_task_id(const char *token, int *taskid);
+int parse_output_slice(char *args[], int count, unsigned long long *first, unsigned long long *last,
+                       unsigned long long *tail);
+void output_slice(Node_t *node, char *filename, unsigned long long first, unsigned long long last,
+                  unsigned long long tail);
+void renice(Node_t *node, int prio_class);
+int find_tag(const char *name, int create);
+int parse_selector(Selector_t *sel, char *args[], int count);
+int selector_matches(Selector_t *sel, Node_t *node, int *explicit);
+void signal_selection(Tasks_t *tasks, Selector_t *sel, int sig_type);
+void log_unmatched_ids(Selector_t *sel);
+void top(Tasks_t *tasks, double interval, int count);
+int top_sleep(double interval);
+void tag_selection(Tasks_t *tasks, Selector_t *sel, int tag, int add);
+void follow(Node_t *node);
+void metrics_command_line(char *args[], int argc);
+void trace_command_line(char *args[], int argc);
+double seconds_since(struct timespec *start);
+
+#define MAX_TAGS 32
+#define RETENTION_BATCH 1024 /* finished tasks removed per run of the retention policy */
 
 /* globals */
+char *tag_names[MAX_TAGS]; // names of user-defined tags, indexed by tag bit
 int num_logged_files = 0;
 Tasks_t *global_tasks = NULL;
 Node_t *global_node = NULL;
+volatile sig_atomic_t command_interrupted = 0; // set by control-c to stop top, bench or follow
+Node_t *follow_node = NULL; // task whose output is copied to the terminal by follow
+EvWatch stdin_watch;     // the command line in the event loop
+EvWatch sigchld_watch;   // signalfd for SIGCHLD in the event loop
+EvWatch files_watch = {-1, EV_WATCH, NULL};       // inotify of watched tasks, registered on first use
+EvWatch debounce_watch = {-1, EV_DEBOUNCE, NULL}; // their debounce timer
+EvWatch admit_watch = {-1, EV_ADMIT, NULL};       // retry timer of held back launches, made on first use
+int stdin_pollable = 1;  // 0 if stdin is a regular file, which epoll cannot watch
+int stdin_wanted = 1;    // 0 while a foreground task or top owns the terminal
+struct timespec events_woke; // when the event loop last returned from waiting
+Run_t *retired_runs = NULL;  // ended runs whose memory is freed before the next wait
 
 /* Signal Handling
- * Four different reasons that a process could send a SIGCHLD to its parent,
- * 1)Child process exits
- * 2)Child process is killed by a signal
- * 3)Child process is stopped by a signal
- * 4)Child process is continued by a signal
+ * SIGCHLD is not handled here: it is blocked and read from a signalfd by the
+ * event loop, and exits are read from each child's pidfd (see handle_events).
+ * Control-c and control-z are forwarded to the foreground task right away.
  */
-void child_handler()
-{
-    pid_t pid = 0;
-    int status = 0;
-
-
-    // wnohang: dont wait if process has not terminated or stopped
-    // wuntraced: request status information from stopped processes as well
-    //  as processes that have terminated.
-
-    (pid = waitpid(-1, &status, WNOHANG | WUNTRACED));
-
-    while (pid > 0)
-    {
-        
-
-        Node_t *task = find_node_from_pid(global_tasks, pid);
-
-        if (WIFSIGNALED(status))
-        {
-
-            log_status_change(task->taskID, task->pid, task->is_background_task, task->command, LOG_CANCEL_SIG);
-            task->state = LOG_STATE_KILLED;
-            task->exit_status = WEXITSTATUS(status);
-            return;
-        }
-        else if (WIFSTOPPED(status))
-        {
-            log_status_change(task->taskID, task->pid, task->is_background_task, task->command, LOG_SUSPEND);
-            task->state = LOG_STATE_SUSPENDED;
-            task->exit_status = WEXITSTATUS(status);
-            return;
-        }
-        else if (WIFEXITED(status))
-        {
-            log_status_change(task->taskID, task->pid, task->is_background_task, task->command, LOG_CANCEL);
-            task->state = LOG_STATE_COMPLETE;
-            task->exit_status = WEXITSTATUS(status);
-            return;
-        }
-    }
-}
-
 void sigint_handler()
 {
     log_ctrl_c();
+    command_interrupted = 1;
     if(!global_node){return;}
     if (!(global_node->is_background_task) && (global_node->state == LOG_STATE_WORKING))
     { //if it is foreground and working
         global_node->stopped = 1;
-        global_node->state = LOG_STATE_KILLED;
-        kill(global_node->pid, SIGINT);
+        set_state(global_node, LOG_STATE_KILLED);
+        task_signal(global_node, SIGINT);
     }
 }
 
@@ -132,9 +310,9 @@ void sigtstp_handler()
     if(!global_node){return;}
     if (!(global_node->is_background_task) && (global_node->state == LOG_STATE_WORKING))
     { // if it is foreground and working
-        global_node->state = LOG_STATE_SUSPENDED;
+        set_state(global_node, LOG_STATE_SUSPENDED);
         global_node->stopped = 1;
-        kill(global_node->pid, SIGTSTP);
+        task_signal(global_node, SIGTSTP);
     }
 }
 void sigcont_handler()
@@ -145,11 +323,7 @@ void sigcont_handler()
 
 void signal_hanlder(int signal)
 {
-    if (signal == SIGCHLD)
-    {
-        child_handler();
-    }
-    else if (signal == SIGINT)
+    if (signal == SIGINT)
     {
         sigint_handler();
     }
@@ -173,6 +347,10 @@ int main()
 {
     char cmdline[MAXLINE]; /* Command line */
     char *cmd = NULL;
+    char command_line[MAXLINE];    /* the command line being handled, for the trace */
+    struct timespec command_start; /* when it was read */
+    int command_active = 0;        /* 1 until its handling time has been recorded */
+    int command_timed = 0;         /* 1 if its handling time goes into the metrics */
 
     /* Intial Prompt and Welcome */
     log_intro();
@@ -182,24 +360,65 @@ int main()
     Tasks_t *tasks = (Tasks_t *)dmalloc(sizeof(Tasks_t));
     tasks->count = 0;
     tasks->head = NULL;
+    tasks->done_head = tasks->done_tail = NULL;
+    tasks->done_count = 0;
+    tasks->evicted = tasks->evicted_complete = tasks->evicted_failed = tasks->evicted_killed = 0;
+    clock_gettime(CLOCK_MONOTONIC, &tasks->last_retention);
+    tasks->pending_head = tasks->pending_tail = NULL;
+    tasks->pending_count = 0;
+    tasks->shed_count = 0;
+    clock_gettime(CLOCK_MONOTONIC, &tasks->last_shed);
+    global_tasks = tasks;
 
     struct sigaction act;            // for storing signal handler overhead
     memset(&act, 0, sizeof(act));    // initialize to zero
-    act.sa_handler = signal_hanlder; // child_handler will be our signal handler
-    sigaction(SIGCHLD, &act, NULL);  // sets a new interrupt handler
-    sigaction(SIGINT, &act, NULL);
+    act.sa_handler = signal_hanlder; // signal_hanlder will be our signal handler
+    sigaction(SIGINT, &act, NULL);   // sets a new interrupt handler
     sigaction(SIGCONT, &act, NULL);
     sigaction(SIGTSTP, &act, NULL);
 
+    procstat_raise_fd_limit(); // top keeps /proc files open for every running task
+    if (!logrotate_can_compress())
+    {
+        config_set("log_gzip", 0); // built without zlib: rotated segments stay plain text
+    }
+
+    /* Event loop: the command line, and SIGCHLD through a signalfd */
+    if (ev_init() == -1)
+    {
+        exit(1);
+    }
+    ev_add(&sigchld_watch, ev_sigchld_fd(), EV_SIGCHLD, NULL);
+    if (ev_add(&stdin_watch, STDIN_FILENO, EV_STDIN, NULL) == -1)
+    {
+        stdin_pollable = 0;
+    }
+    setvbuf(stdin, NULL, _IONBF, 0); // no input may hide in a stdio buffer while we wait on the fd
+
     /* Shell looping here to accept user command and execute */
     while (1)
     {
         char *argv[MAXARGS]; /* Argument list */
         Instruction inst;    /* Instruction structure: check parse.h */
 
+        if (command_active)
+        {
+            double seconds = seconds_since(&command_start);
+            if (command_timed)
+            {
+                metrics_command(seconds);
+            }
+            TRACE(trace_command(&command_start, seconds, command_line));
+            command_active = 0;
+        }
+
         /* Print prompt */
         log_prompt();
 
+        /* Handle task events until a line can be read */
+        while (!handle_events(-1))
+            ;
+
         /* Read a line */
         // note: fgets will keep the ending '\n'
         errno = 0;
@@ -237,6 +456,14 @@ int main()
                 debug_print_parse(cmd, &inst, argv, "main (after parse)");
             }
 
+            /* commands that wait on tasks or the user would swamp the latency metric */
+            clock_gettime(CLOCK_MONOTONIC, &command_start);
+            snprintf(command_line, sizeof(command_line), "%s", cmdline);
+            command_active = 1;
+            command_timed = strcmp(inst.instruct, "run") && strcmp(inst.instruct, "top") &&
+                            strcmp(inst.instruct, "bench") && strcmp(inst.instruct, "follow") &&
+                            strcmp(inst.instruct, "map") && strncmp(inst.instruct, "wait", 4);
+
             /* After parsing: your code to continue from here */
             /*================================================*/
 
@@ -248,12 +475,22 @@ int main()
             else if (strcmp(inst.instruct, "quit") == 0)
             {
                 log_quit();
+                metrics_stop();
                 exit(0);
             }
+            else if (strcmp(inst.instruct, "mem") == 0)
+            {
+                mem_report(tasks);
+                continue;
+            }
             else if (strcmp(inst.instruct, "tasks") == 0)
             {
                 log_num_tasks(tasks->count);
                 print_tasks(tasks);
+                if (tasks->evicted)
+                {
+                    log_evicted(tasks->evicted, tasks->evicted_complete, tasks->evicted_failed, tasks->evicted_killed);
+                }
                 continue;
             }
             else if (strcmp(inst.instruct, "delete") == 0)
@@ -314,74 +551,250 @@ int main()
             }
             else if (strcmp(inst.instruct, "output") == 0)
             {
-                if (find_node(tasks, inst.id) == NULL)
+                Node_t *temp = find_node(tasks, inst.id);
+                if (!temp)
                 {
                     log_task_id_error(inst.id);
                     continue;
                 }
-                char output_filename[100] = "log";
-                snprintf(output_filename, sizeof(output_filename), "log%d", inst.id);
-                strcat(output_filename, ".txt");
-                if (!file_exists(output_filename))
+                char argbuf[MAXLINE];
+                char *args[MAXARGS];
+                int argc = split_args(cmdline, argbuf, args, MAXARGS);
+                unsigned long long first = 0, last = 0, tail = 0;
+                if (!parse_output_slice(args + 2, argc - 2, &first, &last, &tail))
                 {
-                    log_output_unlogged(inst.id);
+                    log_output_slice_error();
                     continue;
                 }
-                log_output_begin(inst.id);
-                output(output_filename);
+                show_output(temp, first, last, tail);
                 continue;
             }
-            else if (strcmp(inst.instruct, "cancel") == 0)
+            else if (strcmp(inst.instruct, "metrics") == 0)
             {
-                Node_t *temp = find_node(tasks, inst.id);
-                global_node = temp;
+                char argbuf[MAXLINE];
+                char *args[MAXARGS];
+                int argc = split_args(cmdline, argbuf, args, MAXARGS);
+                metrics_command_line(args, argc);
+                continue;
+            }
+            else if (strcmp(inst.instruct, "trace") == 0)
+            {
+                char argbuf[MAXLINE];
+                char *args[MAXARGS];
+                int argc = split_args(cmdline, argbuf, args, MAXARGS);
+                trace_command_line(args, argc);
+                continue;
+            }
+            else if (strcmp(inst.instruct, "follow") == 0)
+            {
+                char argbuf[MAXLINE];
+                char *args[MAXARGS];
+                int taskid;
+                if (split_args(cmdline, argbuf, args, MAXARGS) != 2 || !parse_task_id(args[1], &taskid))
+                {
+                    log_follow_usage();
+                    continue;
+                }
+                Node_t *temp = find_node(tasks, taskid);
                 if (!temp)
                 {
-                    log_task_id_error(inst.id);
+                    log_task_id_error(taskid);
+                    continue;
+                }
+                follow(temp);
+                continue;
+            }
+            else if ((strcmp(inst.instruct, "wait") == 0) || (strcmp(inst.instruct, "waitany") == 0) ||
+                     (strcmp(inst.instruct, "waitall") == 0))
+            {
+                char argbuf[MAXLINE];
+                char *args[MAXARGS];
+                int argc = split_args(cmdline, argbuf, args, MAXARGS);
+                int mode = WAIT_FOR_TASKS;
+                if (strcmp(inst.instruct, "waitany") == 0)
+                {
+                    mode = WAIT_FOR_ANY;
                 }
-                if (!(is_busy(temp)))
+                else if (strcmp(inst.instruct, "waitall") == 0)
                 {
-                    log_status_error(inst.id, temp->state);
+                    mode = WAIT_FOR_ALL;
                 }
-                cancel(temp);
+                wait_command(tasks, args, argc, mode);
                 continue;
             }
-            else if (strcmp(inst.instruct, "suspend") == 0)
+            else if (strcmp(inst.instruct, "admission") == 0)
             {
-                Node_t *temp = find_node(tasks, inst.id);
-                global_node = temp;
+                admission_command(tasks);
+                continue;
+            }
+            else if (strcmp(inst.instruct, "history") == 0)
+            {
+                char argbuf[MAXLINE];
+                char *args[MAXARGS];
+                int taskid = 0;
+                if (split_args(cmdline, argbuf, args, MAXARGS) != 2 || !parse_task_id(args[1], &taskid))
+                {
+                    log_history_usage();
+                    continue;
+                }
+                Node_t *temp = find_node(tasks, taskid);
                 if (!temp)
                 {
-                    log_task_id_error(inst.id);
+                    log_task_id_error(taskid);
+                    continue;
                 }
-                if (!(is_busy(temp)))
+                history_command(temp);
+                continue;
+            }
+            else if ((strcmp(inst.instruct, "watch") == 0) || (strcmp(inst.instruct, "unwatch") == 0))
+            {
+                char argbuf[MAXLINE];
+                char *args[MAXARGS];
+                int argc = split_args(cmdline, argbuf, args, MAXARGS);
+                watch_command(tasks, args, argc, strcmp(inst.instruct, "watch") == 0);
+                continue;
+            }
+            else if (strcmp(inst.instruct, "search") == 0)
+            {
+                const char *pattern = cmdline + strlen("search");
+                while (*pattern == ' ')
                 {
-                    log_status_error(inst.id, temp->state);
+                    pattern++;
                 }
-
-                suspend(temp);
+                search_command(tasks, pattern);
                 continue;
             }
-            else if (strcmp(inst.instruct, "resume") == 0)
+            else if (strcmp(inst.instruct, "bench") == 0)
             {
-                Node_t *temp = find_node(tasks, inst.id);
-                global_node = temp;
+                char argbuf[MAXLINE];
+                char *args[MAXARGS];
+                int argc = split_args(cmdline, argbuf, args, MAXARGS);
+                bench_command(tasks, args, argc);
+                continue;
+            }
+            else if (strcmp(inst.instruct, "set") == 0)
+            {
+                char argbuf[MAXLINE];
+                char *args[MAXARGS];
+                int argc = split_args(cmdline, argbuf, args, MAXARGS);
+                set_command(args, argc);
+                continue;
+            }
+            else if ((strcmp(inst.instruct, "cancel") == 0) || (strcmp(inst.instruct, "suspend") == 0) ||
+                     (strcmp(inst.instruct, "resume") == 0))
+            {
+                char argbuf[MAXLINE];
+                char *args[MAXARGS];
+                Selector_t sel;
+                int argc = split_args(cmdline, argbuf, args, MAXARGS);
+                if (!parse_selector(&sel, args + 1, argc - 1))
+                {
+                    continue;
+                }
+                int sig_type = LOG_CMD_CANCEL;
+                if (strcmp(inst.instruct, "suspend") == 0)
+                {
+                    sig_type = LOG_CMD_SUSPEND;
+                }
+                else if (strcmp(inst.instruct, "resume") == 0)
+                {
+                    sig_type = LOG_CMD_RESUME;
+                }
+                signal_selection(tasks, &sel, sig_type);
+                continue;
+            }
+            else if ((strcmp(inst.instruct, "tag") == 0) || (strcmp(inst.instruct, "untag") == 0))
+            {
+                char argbuf[MAXLINE];
+                char *args[MAXARGS];
+                Selector_t sel;
+                int add = (strcmp(inst.instruct, "tag") == 0);
+                int argc = split_args(cmdline, argbuf, args, MAXARGS);
+                if (argc < 3)
+                {
+                    log_selector_error(argc > 1 ? args[1] : "(missing)");
+                    continue;
+                }
+                int tag = find_tag(args[1], add);
+                if (tag < 0)
+                {
+                    log_selector_error(args[1]);
+                    continue;
+                }
+                if (!parse_selector(&sel, args + 2, argc - 2))
+                {
+                    continue;
+                }
+                tag_selection(tasks, &sel, tag, add);
+                continue;
+            }
+            else if (strcmp(inst.instruct, "broadcast") == 0)
+            {
+                char argbuf[MAXLINE];
+                char *args[MAXARGS];
+                int argc = split_args(cmdline, argbuf, args, MAXARGS);
+                broadcast_command(tasks, args, argc);
+                continue;
+            }
+            else if (strcmp(inst.instruct, "cache") == 0)
+            {
+                char argbuf[MAXLINE];
+                char *args[MAXARGS];
+                int argc = split_args(cmdline, argbuf, args, MAXARGS);
+                cache_command(args, argc);
+                continue;
+            }
+            else if (strcmp(inst.instruct, "map") == 0)
+            {
+                char argbuf[MAXLINE];
+                char *args[MAXARGS];
+                int argc = split_args(cmdline, argbuf, args, MAXARGS);
+                map_command(tasks, args, argc);
+                continue;
+            }
+            else if (strcmp(inst.instruct, "renice") == 0)
+            {
+                char argbuf[MAXLINE];
+                char *args[MAXARGS];
+                int taskid = 0;
+                if (split_args(cmdline, argbuf, args, MAXARGS) != 3 || !parse_task_id(args[1], &taskid))
+                {
+                    log_prio_error(taskid, "(missing)");
+                    continue;
+                }
+                Node_t *temp = find_node(tasks, taskid);
                 if (!temp)
                 {
-                    log_task_id_error(inst.id);
+                    log_task_id_error(taskid);
+                    continue;
+                }
+                int prio_class = prio_from_name(args[2]);
+                if (prio_class < 0)
+                {
+                    log_prio_error(taskid, args[2]);
+                    continue;
                 }
-                if (!(is_busy(temp)))
+                renice(temp, prio_class);
+                continue;
+            }
+            else if (strcmp(inst.instruct, "top") == 0)
+            {
+                char argbuf[MAXLINE];
+                char *args[MAXARGS];
+                int argc = split_args(cmdline, argbuf, args, MAXARGS);
+                double interval = (argc > 1) ? atof(args[1]) : 1.0;
+                int count = (argc > 2) ? atoi(args[2]) : 0;
+                if (interval <= 0)
                 {
-                    log_status_error(inst.id, temp->state);
+                    interval = 1.0;
                 }
-                resume(temp);
+                top(tasks, interval, count);
                 continue;
             }
             Node_t *node = create_node(&inst, cmdline, get_task_id(tasks), argv);
 
             insertAscendingOrder(tasks, node);
             log_task_init(node->taskID, cmdline);
-            global_tasks = tasks;
 
         }
 
@@ -402,18 +815,246 @@ void *dmalloc(size_t size)
     return p;
 }
 
+/*
+ * Interns a string like dmalloc allocates: running out of memory is fatal.
+ */
+char *dintern(const char *s)
+{
+    char *p = intern(s);
+    if (!p)
+    {
+        printf("memory allocation failed\n");
+        exit(1);
+    }
+    return p;
+}
+
 Node_t *create_node(Instruction *i, char *cmd, int taskid, char *argv[])
 {
     Node_t *node = (Node_t *)dmalloc(sizeof(Node_t));
-    node->command = string_copy(cmd);
-    node->instruction = string_copy(i->instruct);
+    node->command = string_copy(cmd); // nearly always distinct, not worth interning
+    node->instruction = dintern(i->instruct);
     node->state = LOG_STATE_STANDBY; // all tasks start out in the standby state.
+    metrics_task_state(-1, LOG_STATE_STANDBY);
     node->taskID = taskid;
-    node->argv = clone_argv(argv);
+    TRACE(trace_create(node->taskID, node->command));
+    node->argv = intern_argv(argv);
     node->stopped = 0;
+    node->pid = 0;
+    node->exit_status = 0;
+    node->is_background_task = 0;
+    node->next = NULL;
+    node->prio_class = PRIO_NORMAL;
+    node->tags = 0;
+    node->run = NULL;
+    node->output = NULL;
+    node->logged = 0;
+    node->done_prev = node->done_next = NULL;
+    node->done_listed = 0;
+    node->evict = 0;
+    node->watched = 0;
+    node->watch_file = NULL;
+    node->term_signal = 0;
+    node->waited = 0;
+    history_init(&node->history);
+    node->shed = 0;
     return node;
 }
 
+/*
+ * Frees a task that has been removed from the task list, with everything it holds.
+ */
+void free_node(Node_t *node)
+{
+    if (global_node == node)
+    {
+        global_node = NULL; // the signal handlers look at it
+    }
+    run_free(node);
+    if (node->output)
+    {
+        ring_release(&node->output->ring);
+        logindex_free(&node->output->index);
+        logrotate_written(-(long long)node->output->log_size); // its log no longer counts towards logs_mb
+        free(node->output);
+    }
+    if (node->watched)
+    {
+        watch_remove(node);
+    }
+    intern_release(node->watch_file);
+    release_argv(node->argv);
+    free(node->command);
+    intern_release(node->instruction);
+    free(node);
+}
+
+/*
+ * Returns the live run of a task, starting one with nothing open if there is none.
+ */
+Run_t *run_begin(Node_t *node)
+{
+    if (node->run)
+    {
+        return node->run;
+    }
+    Run_t *run = (Run_t *)dmalloc(sizeof(Run_t));
+    procstat_reset(&run->stats);
+    run->pidfd = -1;
+    run->watch.fd = -1;
+    run->out_fd = -1;
+    run->out_watch.fd = -1;
+    run->err_fd = -1;
+    run->err_watch.fd = -1;
+    run->log_fd = -1;
+    cache_run_init(&run->cache);
+    run->pending_next = NULL;
+    run->pending_file = NULL;
+    run->pending_logged = 0;
+    run->pending_in_fd = -1;
+    run->tree_wait = 0;
+    run->tree_cpu_ms = 0;
+    run->tree_rss_kb = 0;
+    run->adopted = 0;
+    node->run = run;
+    return run;
+}
+
+/*
+ * Frees the run of a task once nothing of it is left: its process and adopted
+ * descendants are reaped, its output is drained and it is not held back.
+ */
+void run_end(Node_t *node)
+{
+    Run_t *run = node->run;
+    if (run && !run_open(node) && run->log_fd == -1 && node->state != LOG_STATE_PENDING)
+    {
+        run_free(node);
+    }
+}
+
+/*
+ * Ends the run of a task whatever is still open, closing it all. The memory is
+ * only freed by the next handle_events, since a watch of the run may still be
+ * among the ready ones of the current wait.
+ */
+void run_free(Node_t *node)
+{
+    Run_t *run = node->run;
+    if (!run)
+    {
+        return;
+    }
+    EvWatch *watches[3] = {&run->watch, &run->out_watch, &run->err_watch};
+    int fds[5] = {run->pidfd, run->out_fd, run->err_fd, run->log_fd, run->pending_in_fd};
+    for (int i = 0; i < 3; i++)
+    {
+        ev_del(watches[i]);
+    }
+    for (int i = 0; i < 5; i++)
+    {
+        if (fds[i] != -1)
+        {
+            close(fds[i]);
+        }
+    }
+    if (run->stats.pid)
+    {
+        procstat_close(&run->stats);
+    }
+    cache_abandon(&run->cache);
+    intern_release(run->pending_file);
+    reaper_detach(node); // no descendant is adopted for it anymore
+    run->retired_next = retired_runs;
+    retired_runs = run;
+    node->run = NULL;
+}
+
+/*
+ * Frees the runs ended since the last wait for events.
+ */
+void free_retired_runs(void)
+{
+    while (retired_runs)
+    {
+        Run_t *run = retired_runs;
+        retired_runs = run->retired_next;
+        free(run);
+    }
+}
+
+/*
+ * Returns the captured output of a task, making room for it on first use.
+ */
+Output_t *output_of(Node_t *node)
+{
+    if (!node->output)
+    {
+        node->output = (Output_t *)dmalloc(sizeof(Output_t));
+        ring_init(&node->output->ring);
+        logindex_init(&node->output->index);
+        node->output->log_size = 0;
+        node->output->log_base = 0;
+        node->output->lines = 0;
+    }
+    return node->output;
+}
+
+/*
+ * Copies an argument list, sharing the strings through the intern table.
+ */
+char **intern_argv(char *argv[])
+{
+    size_t n = 0;
+    while (argv[n])
+    {
+        n++;
+    }
+    char **copy = (char **)dmalloc((n + 1) * sizeof(char *));
+    for (size_t i = 0; i < n; i++)
+    {
+        copy[i] = dintern(argv[i]);
+    }
+    copy[n] = NULL;
+    return copy;
+}
+
+/*
+ * Frees an argument list made by intern_argv.
+ */
+void release_argv(char **argv)
+{
+    for (size_t i = 0; argv && argv[i]; i++)
+    {
+        intern_release(argv[i]);
+    }
+    free(argv);
+}
+
+/*
+ * The mem built-in: reports the memory held by task records, their interned
+ * strings and the captured output.
+ */
+void mem_report(Tasks_t *tasks)
+{
+    InternStats strings;
+    size_t record_bytes = 0;
+
+    intern_stats(&strings);
+    for (Node_t *current = tasks->head; current; current = current->next)
+    {
+        size_t n = 0;
+        while (current->argv && current->argv[n])
+        {
+            n++;
+        }
+        record_bytes += sizeof(Node_t) + (n + 1) * sizeof(char *) + strlen(current->command) + 1;
+        record_bytes += (current->run ? sizeof(Run_t) : 0) + (current->output ? sizeof(Output_t) : 0);
+    }
+    log_mem_report(tasks->count, record_bytes, strings.strings,
+                   strings.references, strings.bytes_stored, strings.bytes_shared, ring_pool_used());
+}
+
 int get_task_id(Tasks_t *tasks)
 {
 
@@ -466,18 +1107,30 @@ void print_tasks(Tasks_t *tasks)
     Node_t *current = tasks->head;
     while (current)
     {
-        log_task_info(current->taskID, current->state, current->exit_status, current->pid, current->command);
+        log_task_info(current->taskID, current->state, current->exit_status, current->pid, current->command, prio_name(current->prio_class));
         current = current->next;
     }
 }
 
 /*
- * A task is busy if it is working or suspended
+ * Changes the state of a task, keeping the tasks-by-state metrics in step. Also
+ * called from the signal handlers.
+ */
+void set_state(Node_t *node, int state)
+{
+    metrics_task_state(node->state, state);
+    TRACE(trace_state(node->taskID, node->state, state));
+    node->state = state;
+}
+
+/*
+ * A task is busy if it is working, suspended or pending
  * Returns one if node is busy.
  */
 int is_busy(Node_t *node)
 {
-    if ((node->state == LOG_STATE_WORKING) || (node->state == LOG_STATE_SUSPENDED))
+    if ((node->state == LOG_STATE_WORKING) || (node->state == LOG_STATE_SUSPENDED) ||
+        (node->state == LOG_STATE_PENDING))
     {
         // log_status_error(node->taskID, node->state);
         return 1;
@@ -485,6 +1138,17 @@ int is_busy(Node_t *node)
     return 0;
 }
 
+/*
+ * A cancelled task is no longer busy, but until its process has been reaped and
+ * its output drained it is still registered with the event loop and cannot be freed.
+ * Returns one if that is the case.
+ */
+int run_open(Node_t *node)
+{
+    Run_t *run = node->run;
+    return run && (run->pidfd != -1 || run->out_fd != -1 || run->err_fd != -1 || run->tree_wait);
+}
+
 void delete (Tasks_t *tasks, int taskid)
 {
 
@@ -497,8 +1161,16 @@ void delete (Tasks_t *tasks, int taskid)
             log_status_error(taskid, current->state);
             return;
         }
+        if (run_open(current))
+        {
+            log_delete_error(taskid);
+            return;
+        }
         tasks->head = current->next;
         tasks->count--;
+        metrics_task_state(current->state, -1);
+        done_list_remove(tasks, current);
+        free_node(current);
         log_delete(taskid);
         return;
     }
@@ -513,7 +1185,16 @@ void delete (Tasks_t *tasks, int taskid)
                 log_status_error(taskid, current->next->state);
                 return;
             }
-            current->next = current->next->next;
+            if (run_open(current->next))
+            {
+                log_delete_error(taskid);
+                return;
+            }
+            Node_t *deleted = current->next;
+            metrics_task_state(deleted->state, -1);
+            current->next = deleted->next;
+            done_list_remove(tasks, deleted);
+            free_node(deleted);
             log_delete(taskid);
             tasks->count--;
             return;
@@ -583,257 +1264,2725 @@ Node_t *find_node(Tasks_t *tasks, int taskid)
 
 }
 
-void run_task(Node_t *node, char *filename)
+/*
+ * Child side of every launch: own process group, default signal mask, priority
+ * class, optional input file and output pipes (stderr goes to err_fd if given,
+ * else to out_fd), then exec. Never returns.
+ */
+void exec_task(Node_t *node, char *filename, int in_fd, int out_fd, int err_fd)
 {
     char full_path[100] = "./";
     strcat(full_path, node->instruction);
     char second_path[100] = "/usr/bin/";
     strcat(second_path, node->instruction);
 
-    pid_t pid;
-
-    node->is_background_task = 0;
-    node->state = LOG_STATE_WORKING;
+    setpgid(0, 0);
+    ev_child_reset();
+    prio_apply_self(node->prio_class); // checked by prio_check in the parent
 
-    if ((pid = fork()) == 0)
+    if (filename)
     {
-        setpgid(0, 0);
-
-        if (filename)
+        int file = open(filename, O_RDONLY);
+        if (file == -1)
         {
-            int file = open(filename, O_RDONLY);
-            if (file == -1)
-            {
-                log_file_error(node->taskID, filename);
-                return;
-            }
-            int success = dup2(file, STDIN_FILENO);
-            if (success == -1)
-            { // dup2 failed
-                exit(1);
-            }
+            log_file_error(node->taskID, filename);
+            exit(1);
         }
-
-        execv(full_path, node->argv);
-        execv(second_path, node->argv);
-        log_run_error(node->command);
+        int success = dup2(file, STDIN_FILENO);
+        if (success == -1)
+        { // dup2 failed
+            exit(1);
+        }
+    }
+    else if (in_fd != -1 && dup2(in_fd, STDIN_FILENO) == -1)
+    {
         exit(1);
     }
+    if (out_fd != -1)
+    { // the pipes themselves are close-on-exec, only the copies on 1 and 2 survive
+        dup2(out_fd, STDOUT_FILENO);
+        dup2((err_fd != -1) ? err_fd : out_fd, STDERR_FILENO);
+    }
 
-    node->pid = pid;
-    log_status_change(node->taskID, pid, LOG_FG, node->command, LOG_START);
-    fg_reaper(pid);
-
+    execv(full_path, node->argv);
+    execv(second_path, node->argv);
+    log_run_error(node->command);
+    exit(1);
 }
 
-void bg(Node_t *node, char *filename)
+/*
+ * Makes sure a task about to be launched can run under its priority class.
+ * If the class is out of reach it is reported and the task falls back to the
+ * normal class, so that tasks never shows a class the process does not have.
+ */
+void prio_check(Node_t *node)
 {
-    char full_path[100] = "./";
-    strcat(full_path, node->instruction);
-    char second_path[100] = "/usr/bin/";
-    strcat(second_path, node->instruction);
+    if (node->prio_class != PRIO_NORMAL && !prio_allowed(node->prio_class))
+    {
+        log_prio_error(node->taskID, prio_name(node->prio_class));
+        node->prio_class = PRIO_NORMAL;
+    }
+}
 
+void run_task(Node_t *node, char *filename)
+{
     pid_t pid;
-    node->is_background_task = 1;
-    node->state = LOG_STATE_WORKING;
+    sigset_t keyboard, saved;
 
+    node->is_background_task = 0;
+    run_begin(node);
+    if (run_cached(node, filename, 0, 1))
+    {
+        return;
+    }
+    set_state(node, LOG_STATE_WORKING);
+    node->stopped = 0;
+    prio_check(node);
+
+    /* a control-c or control-z waits until the task can be signalled through its pidfd;
+       exec_task restores the mask in the child */
+    sigemptyset(&keyboard);
+    sigaddset(&keyboard, SIGINT);
+    sigaddset(&keyboard, SIGTSTP);
+    sigprocmask(SIG_BLOCK, &keyboard, &saved);
     if ((pid = fork()) == 0)
     {
-        setpgid(0, 0);
+        exec_task(node, filename, -1, -1, -1);
+    }
 
-        if (filename)
-        {
-            int file = open(filename, O_RDONLY);
-            if (file == -1)
-            {
-                log_file_error(node->taskID, filename);
-                return;
-            }
-            int success = dup2(file, STDIN_FILENO);
-            if (success == -1)
-            { // dup2 failed
-                exit(1);
-            }
-        }
-        execv(full_path, node->argv);
-        execv(second_path, node->argv);
-        log_run_error(node->command);
-        exit(1);
+    if (pid != -1)
+    {
+        setpgid(pid, pid); // also set in the parent so the group exists before renice/kill
     }
+    if (pid == -1 || track_child(node, pid) == -1)
+    {
+        launch_failed(node, errno);
+        sigprocmask(SIG_SETMASK, &saved, NULL);
+        return;
+    }
+    log_status_change(node->taskID, pid, LOG_FG, node->command, LOG_START);
+    sigprocmask(SIG_SETMASK, &saved, NULL);
+    fg_reaper(node);
 
-    node->pid = pid;
-    log_status_change(node->taskID, node->pid, LOG_LOG_BG, node->command, LOG_START);
 }
 
-void log_task(Node_t *node, int taskid, char *filename)
+void bg(Node_t *node, char *filename)
 {
-    char output_filename[100] = "log";
-    snprintf(output_filename, sizeof(output_filename), "log%d", taskid);
-    strcat(output_filename, ".txt");
+    if (admit_launch(node, filename, -1, 0))
+    {
+        launch_background(node, filename, -1, 0);
+    }
+}
 
-    char full_path[100] = "./";
-    strcat(full_path, node->instruction);
+void log_task(Node_t *node, int taskid, char *filename)
+{
+    num_logged_files++;
+    if (admit_launch(node, filename, -1, 1))
+    {
+        launch_background(node, filename, -1, 1);
+    }
+}
 
-    char second_path[100] = "/usr/bin/";
-    strcat(second_path, node->instruction);
+/*
+ * Admission control for background launches (bg, log, broadcast and watch
+ * restarts): returns 1 if the launch may go ahead now. Otherwise the task
+ * becomes Pending at the end of the admission queue, which admission_event
+ * releases in order as the spawn rate and pressure allow; the queue then owns
+ * in_fd, the stdin pipe of the launch (-1 if none).
+ */
+int admit_launch(Node_t *node, char *filename, int in_fd, int logged)
+{
+    long thresholds[3] = {config_get(CFG_PSI_CPU), config_get(CFG_PSI_MEMORY), config_get(CFG_PSI_IO)};
+    double retry = 0;
+    int reason = ADMIT_QUEUE; // nobody overtakes the launches already waiting
 
+    if (!global_tasks->pending_head)
+    {
+        reason = admit_check(config_get(CFG_SPAWN_RATE), config_get(CFG_SPAWN_BURST), thresholds, &retry);
+    }
+    admit_count(reason);
+    if (reason == ADMIT_OK)
+    {
+        return 1;
+    }
+    metrics_deferral(reason);
 
-    pid_t pid;
-    int pipefd[2];
-    pipe(pipefd);
-    num_logged_files++;
     node->is_background_task = 1;
-    if ((pid = fork()) == 0)
-    { // run command and output to process running tee
-        setpgid(0, 0);
-        node->state = LOG_STATE_WORKING;
-        dup2(pipefd[1], STDOUT_FILENO); // write to pipefd[1] instead of stdout
-        close(pipefd[0]);
-        execv(full_path, node->argv);
-        execv(second_path, node->argv);
-        log_run_error(node->command);
+    run_begin(node);
+    node->run->pending_file = filename ? dintern(filename) : NULL;
+    node->run->pending_logged = logged;
+    node->run->pending_in_fd = in_fd;
+    node->run->pending_next = NULL;
+    if (global_tasks->pending_tail)
+    {
+        global_tasks->pending_tail->run->pending_next = node;
+    }
+    else
+    {
+        global_tasks->pending_head = node;
+        admission_retry(retry);
+    }
+    global_tasks->pending_tail = node;
+    global_tasks->pending_count++;
+    done_list_remove(global_tasks, node); // busy again
+    set_state(node, LOG_STATE_PENDING);
+    log_pending(node->taskID, node->command, admit_reason_name(reason));
+    return 0;
+}
 
-        exit(1);
+/*
+ * Takes a task out of the admission queue, leaving its state alone.
+ */
+void pending_remove(Tasks_t *tasks, Node_t *node)
+{
+    Node_t *prev = NULL;
+    for (Node_t *current = tasks->pending_head; current; prev = current, current = current->run->pending_next)
+    {
+        if (current != node)
+        {
+            continue;
+        }
+        if (prev)
+        {
+            prev->run->pending_next = node->run->pending_next;
+        }
+        else
+        {
+            tasks->pending_head = node->run->pending_next;
+        }
+        if (tasks->pending_tail == node)
+        {
+            tasks->pending_tail = prev;
+        }
+        tasks->pending_count--;
+        node->run->pending_next = NULL;
+        intern_release(node->run->pending_file);
+        node->run->pending_file = NULL;
+        if (node->run->pending_in_fd != -1)
+        {
+            close(node->run->pending_in_fd); // a cancelled broadcast task sees no input
+            node->run->pending_in_fd = -1;
+        }
+        return;
     }
-    pid_t pid2;
-    if ((pid2 = fork()) == 0)
-    { // get input from previous child and use it for tee
-        setpgid(0, 0);
-        node->pid = getpid();
-        dup2(pipefd[0], STDIN_FILENO);
-        close(pipefd[1]);
-        close(pipefd[0]);
-        execl("/usr/bin/tee", "tee", output_filename, NULL);
+}
+
+/*
+ * The admission retry timer fired: launches held back tasks, oldest first,
+ * for as long as admission control lets them through.
+ */
+void admission_event(Tasks_t *tasks)
+{
+    uint64_t expirations;
+    long thresholds[3] = {config_get(CFG_PSI_CPU), config_get(CFG_PSI_MEMORY), config_get(CFG_PSI_IO)};
+    double retry = 0;
+
+    read(admit_watch.fd, &expirations, sizeof(expirations));
+    while (tasks->pending_head)
+    {
+        if (admit_check(config_get(CFG_SPAWN_RATE), config_get(CFG_SPAWN_BURST), thresholds, &retry) != ADMIT_OK)
+        {
+            admission_retry(retry);
+            return;
+        }
+        Node_t *node = tasks->pending_head;
+        char *filename = node->run->pending_file;
+        int in_fd = node->run->pending_in_fd;
+        node->run->pending_file = NULL; // both kept until the launch has used them
+        node->run->pending_in_fd = -1;
+        int logged = node->run->pending_logged;
+        pending_remove(tasks, node);
+        admit_released();
+        launch_background(node, filename, in_fd, logged);
+        intern_release(filename);
+        if (in_fd != -1)
+        {
+            close(in_fd);
+        }
     }
-    node->pid = pid;
-    log_status_change(node->taskID, node->pid, LOG_LOG_BG, node->command, LOG_START);
 }
 
-void output(char *file)
+/*
+ * Arms the admission retry timer, creating it on first use. It is only armed
+ * while launches are held back, so admission control costs nothing otherwise.
+ */
+void admission_retry(double seconds)
 {
+    struct itimerspec when;
 
-    pid_t pid;
-    if (!(pid = fork()))
+    if (admit_watch.fd == -1)
     {
-        execl("/usr/bin/cat", "cat", file, NULL);
-        printf("output failed\n");
-        exit(1);
+        int fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+        if (fd == -1 || ev_add(&admit_watch, fd, EV_ADMIT, NULL) == -1)
+        {
+            if (fd != -1)
+            {
+                close(fd);
+            }
+            return;
+        }
     }
-    waitpid(pid, NULL, 0);
+    if (seconds < 0.001)
+    {
+        seconds = 0.001; // an all-zero it_value would disarm the timer
+    }
+    memset(&when, 0, sizeof(when));
+    when.it_value.tv_sec = (time_t)seconds;
+    when.it_value.tv_nsec = (long)((seconds - (time_t)seconds) * 1e9);
+    timerfd_settime(admit_watch.fd, 0, &when, NULL);
 }
 
 /*
- * This helper function returns 1 if a file exists
+ * The admission built-in: shows the admission control limits, the current
+ * pressure and how many launches were held back, by reason.
  */
-int file_exists(char *filename)
+void admission_command(Tasks_t *tasks)
 {
-    FILE *f;
-    if ((f = fopen(filename, "r")))
+    static const char *names[ADMIT_REASONS];
+    long thresholds[3] = {config_get(CFG_PSI_CPU), config_get(CFG_PSI_MEMORY), config_get(CFG_PSI_IO)};
+    long rate = config_get(CFG_SPAWN_RATE), burst = config_get(CFG_SPAWN_BURST);
+    double pressure[3];
+    AdmitStats stats;
+
+    admit_pressure(pressure);
+    admit_stats(&stats);
+    for (int i = 0; i < ADMIT_REASONS; i++)
     {
-        fclose(f);
-        return 1;
+        names[i] = admit_reason_name(i);
     }
-    return 0;
+    log_admission(rate, burst, rate > 0 ? admit_tokens(rate, burst) : 0, pressure, thresholds, tasks->pending_count);
+    log_admission_counts(stats.admitted, stats.released, stats.deferred, names, ADMIT_REASONS);
+    long avail_kb = shed_mem_available();
+    log_shed_status(config_get(CFG_SHED_PSI), config_get(CFG_SHED_AVAIL_MB), avail_kb < 0 ? -1 : avail_kb / 1024,
+                    tasks->shed_count);
 }
 
 /*
- * If succesfully found, it returns the node, otherwise returns null
+ * Starts a background task with its stdout and stderr captured through a pipe.
+ * The output is kept in the task's ring buffer; a logged task also writes all of
+ * it to logN.txt. stdin is filename if given, otherwise in_fd unless it is -1.
+ * While the output is collected for the result cache, stderr comes through a
+ * second pipe so that the entry can keep it apart.
  */
-Node_t *find_node_from_pid(Tasks_t *tasks, pid_t processID)
+void launch_background(Node_t *node, char *filename, int in_fd, int logged)
 {
+    pid_t pid;
+    int pipefd[2] = {-1, -1};
+    int errfd[2] = {-1, -1};
 
-    Node_t *previous = tasks->head;
-    if (previous->pid == processID)
+    node->is_background_task = 1;
+    node->logged = logged;
+
+    if (node->run && node->run->out_fd != -1)
     {
-        return previous;
+        finish_capture(node); // a child of the previous run still holds the pipe
     }
-    Node_t *current = previous->next;
-    while (current && current->pid != processID)
+    run_begin(node);
+    if (in_fd == -1 && run_cached(node, filename, logged, 0))
     {
-        current = current->next;
-        previous = previous->next;
+        return;
+    }
+    set_state(node, LOG_STATE_WORKING);
+    prio_check(node);
+    if (pipe2(pipefd, O_CLOEXEC) == -1)
+    {
+        pipefd[0] = pipefd[1] = -1; // run without capturing
+    }
+    if (pipefd[0] == -1 || !cache_collecting(&node->run->cache) || pipe2(errfd, O_CLOEXEC) == -1)
+    {
+        cache_abandon(&node->run->cache); // stderr mixed into stdout is no entry
+        errfd[0] = errfd[1] = -1;
+    }
+    if (logged)
+    {
+        start_log(node);
+    }
+
+    if ((pid = fork()) == 0)
+    {
+        exec_task(node, filename, in_fd, pipefd[1], errfd[1]);
+    }
+
+    int error = errno;
+    for (int i = 0; i < 2; i++)
+    {
+        int *fds = i ? errfd : pipefd;
+        if (fds[1] != -1)
+        {
+            close(fds[1]); // end of file once the task and its children are done
+        }
+        if (pid == -1 && fds[0] != -1)
+        {
+            close(fds[0]);
+        }
     }
-    if (!current)
+    if (pid == -1)
     {
-        return NULL;
+        finish_capture(node); // closes the log
+        launch_failed(node, error);
+        return;
+    }
+    start_capture(node, pipefd[0]);
+    if (errfd[0] != -1)
+    {
+        fcntl(errfd[0], F_SETFL, fcntl(errfd[0], F_GETFL) | O_NONBLOCK);
+        node->run->err_fd = errfd[0];
+        ev_add(&node->run->err_watch, errfd[0], EV_OUTPUT, node);
+    }
+    setpgid(pid, pid); // also set in the parent so the group exists before renice/kill
+    if (track_child(node, pid) == -1)
+    {
+        launch_failed(node, errno); // the capture ends with the killed process
+        return;
     }
-    return current;
+    log_status_change(node->taskID, node->pid, LOG_LOG_BG, node->command, LOG_START);
 }
 
-void cancel(Node_t *node)
+/*
+ * Starts a fresh logN.txt for a logged run, dropping the previous log and its
+ * segments. If the log cannot be created that is reported and the run is not logged.
+ */
+void start_log(Node_t *node)
 {
-    log_sig_sent(LOG_CMD_CANCEL, node->taskID, node->pid);
-    kill(node->pid, SIGINT);
-    node->state = LOG_STATE_KILLED;
+    char output_filename[100];
+    Output_t *output = output_of(node);
+    logrotate_forget(node->taskID); // the new log replaces the old one and its segments
+    logrotate_written(-(long long)output->log_size);
+    output->log_size = 0;
+    output->log_base = 0;
+    snprintf(output_filename, sizeof(output_filename), "log%d.txt", node->taskID);
+    node->run->log_fd = open(output_filename, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (node->run->log_fd == -1)
+    {
+        log_file_error(node->taskID, output_filename); // the run goes on, its output only kept in memory
+        return;
+    }
+    snprintf(output_filename, sizeof(output_filename), "log%d.idx", node->taskID);
+    logindex_create(&output->index, output_filename);
 }
 
-void suspend(Node_t *node)
+/*
+ * Registers the read end of a task's output pipe with the event loop.
+ */
+void start_capture(Node_t *node, int fd)
 {
-    log_sig_sent(LOG_CMD_SUSPEND, node->taskID, node->pid);
-    kill(node->pid, SIGTSTP);
-    node->state = LOG_STATE_SUSPENDED;
+    Output_t *output = output_of(node);
+    ring_open(&output->ring, (size_t)config_get(CFG_RING_KB) * 1024);
+    output->lines = 0;
+    if (fd == -1)
+    {
+        return;
+    }
+    fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+    node->run->out_fd = fd;
+    ev_add(&node->run->out_watch, fd, EV_OUTPUT, node);
 }
 
-void resume(Node_t *node)
+/*
+ * Reads what a task has written to its output pipe, or with stream CACHE_STDERR
+ * to its separate stderr pipe. Unless drain is set, at most a few buffers are
+ * read so that one chatty task cannot starve the event loop.
+ */
+void capture_event(Node_t *node, int stream, int drain)
 {
-    log_sig_sent(LOG_CMD_RESUME, node->taskID, node->pid);
-    kill(node->pid, SIGCONT);
-    node->state = LOG_STATE_WORKING;
+    static char buffer[65536];
+    int fd = (stream == CACHE_STDERR) ? node->run->err_fd : node->run->out_fd;
+
+    for (int rounds = 0; drain || rounds < 4; rounds++)
+    {
+        ssize_t n = read(fd, buffer, sizeof(buffer));
+        if (n == -1 && errno == EINTR)
+        {
+            continue;
+        }
+        if (n == -1)
+        {
+            return; // EAGAIN: nothing more for now
+        }
+        if (n == 0 && stream == CACHE_STDERR)
+        {
+            ev_del(&node->run->err_watch);
+            close(node->run->err_fd);
+            node->run->err_fd = -1;
+            return;
+        }
+        if (n == 0)
+        {
+            if (node->run->err_fd != -1)
+            {
+                capture_event(node, CACHE_STDERR, 1); // what is left of stderr before it is closed
+            }
+            finish_capture(node);
+            return;
+        }
+        save_output(node, stream, buffer, n);
+    }
 }
 
+/*
+ * Keeps output of a background task: in its ring buffer, its log if it is
+ * logged, and the result cache entry being collected, echoing it if wanted.
+ * stream tells the cache whether it came from stdout or stderr.
+ */
+void save_output(Node_t *node, int stream, const char *buf, size_t len)
+{
+    ring_write(&node->output->ring, buf, len);
+    for (const char *p = buf; (p = memchr(p, '\n', buf + len - p)); p++)
+    {
+        node->output->lines++;
+    }
+    if (node->run->log_fd != -1)
+    {
+        write_log(node, buf, len);
+    }
+    cache_collect(&node->run->cache, stream, buf, len);
+    if (config_get(CFG_ECHO) || node == follow_node)
+    {
+        write(STDOUT_FILENO, buf, len);
+    }
+}
 
-void reaper(int status, pid_t pid)
+/*
+ * Appends captured output to logN.txt. Once the log reaches the log_mb cap it is
+ * rotated at the next line end (or right away if a single line is as long as the
+ * cap), and the oldest rotated segments of all tasks are trimmed to fit logs_mb.
+ */
+void write_log(Node_t *node, const char *buf, size_t len)
 {
+    unsigned long long cap = (unsigned long long)config_get(CFG_LOG_MB) * 1024 * 1024;
+    size_t head = len;
+
+    if (cap && node->output->log_size + len >= cap)
+    {
+        const char *nl = memrchr(buf, '\n', len);
+        head = nl ? (size_t)(nl + 1 - buf) : len;
+    }
+    write(node->run->log_fd, buf, head);
+    logindex_feed(&node->output->index, buf, head);
+    node->output->log_size += head;
+    logrotate_written(head);
+    metrics_log_bytes(head);
+    if (cap && node->output->log_size >= cap && (!node->output->index.partial || node->output->log_size >= 2 * cap))
+    {
+        rotate_log(node);
+    }
+    if (head < len && node->run->log_fd != -1) // the rotation may have lost the log
+    {
+        write(node->run->log_fd, buf + head, len - head);
+        logindex_feed(&node->output->index, buf + head, len - head);
+        node->output->log_size += len - head;
+        logrotate_written(len - head);
+        metrics_log_bytes(len - head);
+    }
+    logrotate_enforce((unsigned long long)config_get(CFG_LOGS_MB) * 1024 * 1024);
+}
 
-    Node_t *task = find_node_from_pid(global_tasks, pid);
+/*
+ * Moves logN.txt aside as a rotated segment and starts a new one. If the new
+ * log cannot be created that is reported and the rest of the run is not logged.
+ */
+void rotate_log(Node_t *node)
+{
+    char filename[100];
+    unsigned long long lines = logindex_lines(&node->output->index);
 
-    if (!task->is_background_task)
+    if (logrotate_rotate(node->taskID, node->output->log_base + 1, lines, node->output->log_size,
+                         (int)config_get(CFG_LOG_KEEP), (int)config_get(CFG_LOG_GZIP)) == -1)
     {
+        return; // keep writing to the current log
+    }
+    close(node->run->log_fd);
+    node->output->log_base += lines; // those lines are in the segment now
+    node->output->log_size = 0;
+    snprintf(filename, sizeof(filename), "log%d.txt", node->taskID);
+    node->run->log_fd = open(filename, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (node->run->log_fd == -1)
+    {
+        log_file_error(node->taskID, filename); // the output is only kept in memory from here on
+        logindex_free(&node->output->index);
         return;
     }
+    snprintf(filename, sizeof(filename), "log%d.idx", node->taskID);
+    logindex_create(&node->output->index, filename);
+}
 
-    if (WIFSIGNALED(status))
+/*
+ * Stops capturing a task's output.
+ */
+void finish_capture(Node_t *node)
+{
+    ev_del(&node->run->out_watch);
+    if (node->run->out_fd != -1)
+    {
+        close(node->run->out_fd);
+        node->run->out_fd = -1;
+    }
+    ev_del(&node->run->err_watch);
+    if (node->run->err_fd != -1)
     {
+        close(node->run->err_fd);
+        node->run->err_fd = -1;
+    }
+    if (node->run->log_fd != -1)
+    {
+        close(node->run->log_fd);
+        node->run->log_fd = -1;
+        logindex_close(&node->output->index);
+    }
+    if (node->output)
+    {
+        ring_close(&node->output->ring);
+    }
+    run_end(node);
+}
 
-        log_status_change(task->taskID, task->pid, task->is_background_task, task->command, LOG_CANCEL_SIG);
-        task->state = LOG_STATE_KILLED;
-        task->exit_status = WEXITSTATUS(status);
-        return;
+/*
+ * Finds where a task's saved output is: in memory if all of it is still held
+ * there, otherwise in logN.txt when the task was logged, otherwise the most
+ * recent part in memory. filename is set to the task's log file name.
+ */
+int output_source(Node_t *node, char *filename, size_t size)
+{
+    snprintf(filename, size, "log%d.txt", node->taskID);
+    if (!node->output)
+    {
+        return file_exists(filename) ? OUTPUT_FILE : OUTPUT_NONE; // nothing was captured yet
     }
-    else if (WIFSTOPPED(status))
+    int have_file = file_exists(filename) && (node->logged || node->output->ring.total == 0);
+
+    if (have_file && (ring_wrapped(&node->output->ring) || ring_length(&node->output->ring) == 0))
     {
-        log_status_change(task->taskID, task->pid, task->is_background_task, task->command, LOG_SUSPEND);
-        task->state = LOG_STATE_SUSPENDED;
-        task->exit_status = WEXITSTATUS(status);
-        return;
+        return OUTPUT_FILE;
     }
-    else if (WIFEXITED(status))
+    if (ring_length(&node->output->ring) > 0)
     {
-        log_status_change(task->taskID, task->pid, task->is_background_task, task->command, LOG_CANCEL);
-        task->state = LOG_STATE_COMPLETE;
-        task->exit_status = WEXITSTATUS(status);
-        return;
+        return OUTPUT_RING;
     }
+    return OUTPUT_NONE;
 }
 
-void fg_reaper(pid_t pid)
+/*
+ * The output built-in. Without a slice (first, last and tail all 0) the whole
+ * saved output is shown, otherwise lines first..last or the last tail lines.
+ */
+void show_output(Node_t *node, unsigned long long first, unsigned long long last, unsigned long long tail)
 {
-    int status;
-    waitpid(pid, &status, 0);
-    if(global_node->stopped){return;} // dont check for stopped process
-    if (WIFSIGNALED(status))
+    char output_filename[100];
+    int source = output_source(node, output_filename, sizeof(output_filename));
+
+    if (source == OUTPUT_NONE)
     {
-        log_status_change(global_node->taskID, global_node->pid, global_node->is_background_task, global_node->command, LOG_CANCEL_SIG);
-        global_node->state = LOG_STATE_KILLED;
-        global_node->exit_status = WEXITSTATUS(status);
+        log_output_unlogged(node->taskID);
         return;
     }
-
-    if (WIFEXITED(status))
+    log_output_begin(node->taskID);
+    if (source == OUTPUT_FILE)
     {
-        log_status_change(global_node->taskID, global_node->pid, global_node->is_background_task, global_node->command, LOG_CANCEL);
-        global_node->state = LOG_STATE_COMPLETE;
-        global_node->exit_status = WEXITSTATUS(status);
+        if (first || tail)
+        {
+            output_slice(node, output_filename, first, last, tail);
+            return;
+        }
+        logrotate_dump(node->taskID, STDOUT_FILENO, 1, ~0ULL);
+        output(output_filename);
         return;
     }
-}
\ No newline at end of file
+    if (ring_wrapped(&node->output->ring))
+    {
+        log_output_truncated(node->taskID, (unsigned long)ring_length(&node->output->ring));
+    }
+    if (!first && !tail)
+    {
+        ring_dump(&node->output->ring, STDOUT_FILENO);
+        return;
+    }
+
+    /* the ring is small enough to count its lines on the spot; lines dropped
+     * from it keep their numbers, so slices match the full output */
+    const char *piece1, *piece2;
+    size_t len1, len2;
+    ring_pieces(&node->output->ring, &piece1, &len1, &piece2, &len2);
+    LogIndex index;
+    logindex_init(&index);
+    logindex_feed(&index, piece1, len1);
+    logindex_feed(&index, piece2, len2);
+    unsigned long long dropped = node->output->lines - index.lines; // lines before the first one held
+    if (tail)
+    {
+        unsigned long long lines = dropped + logindex_lines(&index);
+        first = (tail < lines) ? lines - tail + 1 : 1;
+        last = lines;
+    }
+    for (unsigned long long line = dropped + 1, i = 0; i < len1 + len2 && line <= last; i++)
+    {
+        char c = (i < len1) ? piece1[i] : piece2[i - len1];
+        if (line >= first)
+        {
+            putchar(c);
+        }
+        line += (c == '\n');
+    }
+    fflush(stdout);
+    logindex_free(&index);
+}
+
+/*
+ * Shows part of a task's log, seeking to it through the line index of logN.txt.
+ * The index is completed (or loaded from logN.idx, or built) as far as needed
+ * first. Lines rotated out of logN.txt are read from the rotated segments.
+ */
+void output_slice(Node_t *node, char *filename, unsigned long long first, unsigned long long last,
+                  unsigned long long tail)
+{
+    char index_filename[100];
+    snprintf(index_filename, sizeof(index_filename), "log%d.idx", node->taskID);
+
+    int fd = open(filename, O_RDONLY | O_CLOEXEC);
+    if (fd == -1)
+    {
+        log_output_unlogged(node->taskID);
+        return;
+    }
+    Output_t *output = output_of(node);
+    logindex_load(&output->index, index_filename, fd);
+    unsigned long long base = output->log_base;
+    if (tail)
+    {
+        unsigned long long lines = base + logindex_lines(&output->index);
+        first = (tail < lines) ? lines - tail + 1 : 1;
+        last = lines;
+    }
+    if (first <= base)
+    {
+        logrotate_dump(node->taskID, STDOUT_FILENO, first, (last < base) ? last : base);
+    }
+    if (last > base)
+    {
+        logindex_print(&output->index, fd, (first > base) ? first - base : 1, last - base, STDOUT_FILENO);
+    }
+    close(fd);
+}
+
+/*
+ * The broadcast built-in: starts every selected task in the background with
+ * FILE on its stdin, reading the file only once for all of them (see broadcast.h).
+ */
+void broadcast_command(Tasks_t *tasks, char *args[], int argc)
+{
+    Selector_t sel;
+    struct stat st;
+    int explicit = -1;
+    int count = 0;
+
+    if (argc < 3)
+    {
+        log_broadcast(NULL, -1);
+        return;
+    }
+    if (!parse_selector(&sel, args + 2, argc - 2))
+    {
+        return;
+    }
+    int in_fd = open(args[1], O_RDONLY | O_CLOEXEC);
+    if (in_fd == -1 || fstat(in_fd, &st) == -1 || !S_ISREG(st.st_mode))
+    {
+        if (in_fd != -1)
+        {
+            close(in_fd);
+        }
+        log_broadcast(args[1], -1);
+        return;
+    }
+    int *fds = (int *)malloc((tasks->count + 1) * sizeof(int));
+    for (Node_t *current = tasks->head; fds && current; current = current->next)
+    {
+        int pipefd[2];
+        if (!selector_matches(&sel, current, &explicit))
+        {
+            continue;
+        }
+        if (is_busy(current))
+        {
+            log_status_error(current->taskID, current->state);
+            continue;
+        }
+        if (pipe2(pipefd, O_CLOEXEC) == -1)
+        {
+            break;
+        }
+        if (admit_launch(current, NULL, pipefd[0], 0))
+        {
+            launch_background(current, NULL, pipefd[0], 0);
+            close(pipefd[0]);
+        }
+        fds[count++] = pipefd[1]; // a held back task reads its input once it is let through
+    }
+    log_unmatched_ids(&sel);
+    if (count == 0 || broadcast_start(in_fd, fds, count) == -1)
+    {
+        for (int i = 0; i < count; i++)
+        {
+            close(fds[i]); // the tasks see an empty input
+        }
+        close(in_fd);
+        free(fds);
+        log_broadcast(args[1], count ? -1 : 0);
+        return;
+    }
+    free(fds);
+    log_broadcast(args[1], count);
+}
+
+/*
+ * Finds the file exec_task would run for a task, trying the same places in the
+ * same order. Returns 0, or -1 if there is none.
+ */
+int task_executable(Node_t *node, char *path, size_t size)
+{
+    snprintf(path, size, "./%s", node->instruction);
+    if (access(path, X_OK) == 0)
+    {
+        return 0;
+    }
+    snprintf(path, size, "/usr/bin/%s", node->instruction);
+    return access(path, X_OK);
+}
+
+/*
+ * Answers a run from the result cache when it is on (cache_mb) and holds the
+ * result of the same executable, arguments and input file: the saved output is
+ * replayed and the task marked Complete without starting anything. Returns 1 in
+ * that case. Otherwise a background run gets its output collected for the cache.
+ * A foreground run replays stdout and stderr to the terminal's stdout and
+ * stderr; a background run captures both, stdout first.
+ */
+int run_cached(Node_t *node, char *filename, int logged, int foreground)
+{
+    char path[256];
+    char key[CACHE_KEY_LEN];
+    char *data = NULL;
+    size_t len = 0, err_len = 0;
+    int code = 0;
+    unsigned long long cap = (unsigned long long)config_get(CFG_CACHE_MB) * 1024 * 1024;
+
+    cache_abandon(&node->run->cache);
+    if (cap == 0 || task_executable(node, path, sizeof(path)) == -1 ||
+        cache_key(path, node->argv, filename, key) == -1)
+    {
+        return 0; // nothing to go by: run it and let it report what is missing
+    }
+    if (cache_lookup(key, &data, &len, &err_len, &code) == -1)
+    {
+        metrics_cache(0);
+        if (!foreground)
+        {
+            cache_begin(&node->run->cache, key, cap); // a foreground run's output is not captured
+        }
+        return 0;
+    }
+    metrics_cache(1);
+
+    if (foreground)
+    {
+        write(STDOUT_FILENO, data, len);
+        write(STDERR_FILENO, data + len, err_len);
+    }
+    else
+    {
+        if (logged)
+        {
+            start_log(node);
+        }
+        start_capture(node, -1);
+        save_output(node, CACHE_STDOUT, data, len);
+        save_output(node, CACHE_STDERR, data + len, err_len);
+        finish_capture(node);
+    }
+    free(data);
+    set_state(node, LOG_STATE_COMPLETE);
+    node->exit_status = code;
+    node->stopped = 0;
+    history_begin(&node->history, 0, history_mode(node));
+    history_end(&node->history, HISTORY_CACHED, code, 0, 0, 0);
+    log_cache_hit(node->taskID, node->command, code, len + err_len);
+    done_list_add(global_tasks, node);
+    run_end(node);
+    return 1;
+}
+
+/*
+ * The cache built-in: cache [clear]
+ * Reports the result cache counters, or empties the cache.
+ */
+void cache_command(char *args[], int argc)
+{
+    CacheStats stats;
+
+    if (argc == 2 && strcmp(args[1], "clear") == 0)
+    {
+        cache_clear();
+    }
+    else if (argc != 1)
+    {
+        log_cache_stats(0, 0, 0, 0, 0, 0, -1);
+        return;
+    }
+    cache_stats(&stats);
+    log_cache_stats(stats.hits, stats.misses, stats.stores, stats.evictions, stats.entries, stats.bytes,
+                    config_get(CFG_CACHE_MB));
+}
+
+/*
+ * The watch built-in: watch <TASK> [<FILE>] starts the task in the background
+ * (logged if its last run was) with FILE as input, and starts it again whenever
+ * its executable or FILE changes; unwatch <TASK> stops that.
+ */
+void watch_command(Tasks_t *tasks, char *args[], int argc, int start)
+{
+    char path[256];
+    int taskid = 0;
+
+    if (argc < 2 || argc > (start ? 3 : 2) || !parse_task_id(args[1], &taskid))
+    {
+        log_watch_usage();
+        return;
+    }
+    Node_t *node = find_node(tasks, taskid);
+    if (!node)
+    {
+        log_task_id_error(taskid);
+        return;
+    }
+    if (!start)
+    {
+        if (node->watched)
+        {
+            watch_remove(node);
+            node->watched = 0;
+        }
+        log_watch(taskid, NULL, 0);
+        return;
+    }
+
+    const char *paths[2] = {path, (argc == 3) ? args[2] : NULL};
+    if (task_executable(node, path, sizeof(path)) == -1 || (paths[1] && !file_exists(args[2])) || watch_init() == -1)
+    {
+        log_watch_error(taskid);
+        return;
+    }
+    if (files_watch.fd == -1)
+    { // nothing is read from these until something changes
+        ev_add(&files_watch, watch_fd(), EV_WATCH, NULL);
+        ev_add(&debounce_watch, watch_timer_fd(), EV_DEBOUNCE, NULL);
+    }
+    if (watch_add(node, paths, 2) == -1)
+    {
+        log_watch_error(taskid);
+        return;
+    }
+    intern_release(node->watch_file);
+    node->watch_file = paths[1] ? dintern(paths[1]) : NULL;
+    node->watched = 1;
+    log_watch(taskid, paths[1], 1);
+    restart_watched(node);
+}
+
+/*
+ * Starts a watched task again in the background, cancelling the run in
+ * progress, through admission control like bg. A foreground run owns the
+ * terminal, and a Pending launch will see the changes anyway, so both are left alone.
+ */
+void restart_watched(Node_t *node)
+{
+    if (is_busy(node) && (!node->is_background_task || node->state == LOG_STATE_PENDING))
+    {
+        return;
+    }
+    if (is_busy(node))
+    {
+        cancel(node);
+        abandon_run(node); // its exit must not end a restart that is held back
+    }
+    if (admit_launch(node, node->watch_file, -1, node->logged))
+    {
+        launch_background(node, node->watch_file, -1, node->logged);
+    }
+}
+
+/*
+ * Called once a burst of changes to a watched task's files is over.
+ */
+void watched_changed(void *owner)
+{
+    Node_t *node = (Node_t *)owner;
+    log_watch_change(node->taskID, node->command);
+    restart_watched(node);
+}
+
+/*
+ * Parses a byte count with an optional K, M or G suffix. Returns 0 if invalid.
+ */
+static size_t parse_size(const char *s)
+{
+    char *end = NULL;
+    unsigned long long value = strtoull(s, &end, 10);
+    if (end == s || *s == '-')
+    {
+        return 0;
+    }
+    switch (*end)
+    {
+    case 'G':
+    case 'g':
+        value <<= 10;
+        /* fall through */
+    case 'M':
+    case 'm':
+        value <<= 10;
+        /* fall through */
+    case 'K':
+    case 'k':
+        value <<= 10;
+        end++;
+    }
+    return *end ? 0 : (size_t)value;
+}
+
+/*
+ * The map built-in: map <TASK> <FILE> [--jobs N] [--chunk SIZE]
+ * Splits FILE on line boundaries into chunks (1M by default) and runs the task's
+ * command once per chunk, N at a time (one per CPU by default), with the chunk
+ * on its stdin. The outputs are printed in input order and failed chunks are
+ * reported. Like bench, the instances are not tasks and the task is untouched.
+ */
+void map_command(Tasks_t *tasks, char *args[], int argc)
+{
+    int taskid = 0;
+    long jobs = sysconf(_SC_NPROCESSORS_ONLN);
+    size_t chunk_size = 1 << 20;
+    struct stat st;
+    MapStats stats;
+
+    if (argc < 3 || !parse_task_id(args[1], &taskid))
+    {
+        log_map_error(taskid, NULL);
+        return;
+    }
+    for (int i = 3; i < argc; i += 2)
+    {
+        if (i + 1 < argc && strcmp(args[i], "--jobs") == 0)
+        {
+            jobs = atoi(args[i + 1]);
+        }
+        else if (i + 1 < argc && strcmp(args[i], "--chunk") == 0)
+        {
+            chunk_size = parse_size(args[i + 1]);
+        }
+        else
+        {
+            jobs = 0;
+        }
+    }
+    if (jobs < 1 || chunk_size == 0)
+    {
+        log_map_error(taskid, NULL);
+        return;
+    }
+    Node_t *node = find_node(tasks, taskid);
+    if (!node)
+    {
+        log_task_id_error(taskid);
+        return;
+    }
+    int fd = open(args[2], O_RDONLY | O_CLOEXEC);
+    if (fd == -1 || fstat(fd, &st) == -1 || !S_ISREG(st.st_mode))
+    {
+        if (fd != -1)
+        {
+            close(fd);
+        }
+        log_map_error(taskid, args[2]);
+        return;
+    }
+    const char *data = NULL;
+    if (st.st_size > 0)
+    {
+        data = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (data == MAP_FAILED)
+        {
+            close(fd);
+            log_map_error(taskid, args[2]);
+            return;
+        }
+        madvise((void *)data, st.st_size, MADV_SEQUENTIAL);
+    }
+    close(fd);
+
+    command_interrupted = 0;
+    want_stdin(0);
+    int result = map_run(data, st.st_size, chunk_size, jobs, map_spawn, map_pump_events, node, STDOUT_FILENO,
+                         &command_interrupted, map_report, &stats);
+    want_stdin(1);
+    if (data)
+    {
+        munmap((void *)data, st.st_size);
+    }
+    if (result == -1)
+    {
+        log_map_error(taskid, args[2]);
+        return;
+    }
+    log_map_summary(taskid, stats.chunks, stats.finished, stats.failed, jobs, stats.bytes_out);
+}
+
+/*
+ * Keeps the event loop going during a map, so that background tasks are served
+ * while the instances run.
+ */
+void map_pump_events(void)
+{
+    handle_events(-1);
+}
+
+/*
+ * Forks one map instance of a task: the chunk comes in on in_fd and its stdout
+ * goes to out_fd, while its stderr stays on the terminal.
+ */
+pid_t map_spawn(void *ctx, int in_fd, int out_fd)
+{
+    Node_t *node = (Node_t *)ctx;
+    pid_t pid = fork();
+    if (pid == 0)
+    {
+        if (dup2(in_fd, STDIN_FILENO) == -1 || dup2(out_fd, STDOUT_FILENO) == -1)
+        {
+            exit(1);
+        }
+        exec_task(node, NULL, -1, -1, -1);
+    }
+    if (pid > 0)
+    {
+        setpgid(pid, pid); // as in run_task, so the group can be signaled right away
+    }
+    return pid;
+}
+
+/*
+ * Reports a map chunk once its output is printed; only failures are worth a line.
+ */
+void map_report(void *ctx, int chunk, size_t start, size_t end, int code, int signaled)
+{
+    (void)ctx;
+    if (signaled || code != 0)
+    {
+        log_map_chunk(chunk, start, end, code, signaled);
+    }
+}
+
+/*
+ * The search built-in: prints every line of saved task output (log files and
+ * output kept in memory) that contains pattern, searching all tasks in parallel.
+ * Line numbers are those of output --lines. Of a rotated log only the current
+ * logN.txt is searched, not the segments rotated out of it.
+ */
+void search_command(Tasks_t *tasks, const char *pattern)
+{
+    if (!*pattern)
+    {
+        log_search_done(pattern, -1, 0);
+        return;
+    }
+    SearchSource *sources = (SearchSource *)calloc(tasks->count + 1, sizeof(SearchSource));
+    char **copies = (char **)calloc(tasks->count + 1, sizeof(char *));
+    int count = 0;
+
+    for (Node_t *current = tasks->head; current; current = current->next)
+    {
+        char filename[100];
+        int source = output_source(current, filename, sizeof(filename));
+        if (source == OUTPUT_NONE)
+        {
+            continue;
+        }
+        sources[count].task_id = current->taskID;
+        if (source == OUTPUT_FILE)
+        {
+            copies[count] = string_copy(filename);
+            sources[count].path = copies[count];
+            sources[count].line_base = current->output ? current->output->log_base : 0; // lines in the rotated segments
+        }
+        else
+        { // the ring may wrap in the middle of a line, so search a straightened copy
+            const char *first, *second;
+            size_t first_len, second_len;
+            ring_pieces(&current->output->ring, &first, &first_len, &second, &second_len);
+            copies[count] = (char *)dmalloc(first_len + second_len + 1);
+            memcpy(copies[count], first, first_len);
+            if (second_len)
+            {
+                memcpy(copies[count] + first_len, second, second_len); // second is NULL unless the ring wrapped
+            }
+            sources[count].data = copies[count];
+            sources[count].len = first_len + second_len;
+            unsigned long long held = 0;
+            for (const char *p = copies[count]; (p = memchr(p, '\n', copies[count] + sources[count].len - p)); p++)
+            {
+                held++;
+            }
+            sources[count].line_base = current->output->lines - held; // lines dropped from the ring keep their numbers
+        }
+        count++;
+    }
+
+    long total = search_sources(sources, count, pattern, SEARCH_MAX_SHOWN, log_search_match);
+    log_search_done(pattern, total, (total > SEARCH_MAX_SHOWN) ? SEARCH_MAX_SHOWN : total);
+
+    for (int i = 0; i < count; i++)
+    {
+        free(copies[i]);
+    }
+    free(copies);
+    free(sources);
+}
+
+/*
+ * The bench built-in: bench <TASK> <N> [--warmup K] [--parallel P]
+ * Runs the task's command N times (after K unmeasured warmup runs), P at a time,
+ * with its output discarded, and reports the wall time distribution. The runs
+ * are not tasks of their own, so the task list and the task's state are untouched.
+ */
+void bench_command(Tasks_t *tasks, char *args[], int argc)
+{
+    int taskid = 0, runs = 0, warmup = 0, parallel = 1;
+    BenchStats stats;
+
+    if (argc < 3 || !parse_task_id(args[1], &taskid) || (runs = atoi(args[2])) < 1)
+    {
+        log_bench_error(taskid);
+        return;
+    }
+    for (int i = 3; i < argc; i += 2)
+    {
+        if (i + 1 < argc && strcmp(args[i], "--warmup") == 0)
+        {
+            warmup = atoi(args[i + 1]);
+        }
+        else if (i + 1 < argc && strcmp(args[i], "--parallel") == 0)
+        {
+            parallel = atoi(args[i + 1]);
+        }
+        else
+        {
+            parallel = 0; // an unknown option or one without its value
+        }
+    }
+    if (warmup < 0 || parallel < 1)
+    {
+        log_bench_error(taskid);
+        return;
+    }
+    Node_t *node = find_node(tasks, taskid);
+    if (!node)
+    {
+        log_task_id_error(taskid);
+        return;
+    }
+
+    command_interrupted = 0;
+    want_stdin(0);
+    int result = bench_run(runs, warmup, parallel, bench_spawn, bench_pump_events, node, &command_interrupted, &stats);
+    want_stdin(1);
+    if (result == -1)
+    {
+        log_bench_error(taskid);
+        return;
+    }
+    log_bench_summary(taskid, stats.runs, warmup, parallel, stats.failed);
+    log_bench_times(stats.min, stats.mean, stats.p50, stats.p90, stats.p99, stats.max, stats.stddev);
+    log_bench_usage(stats.user_ms, stats.sys_ms, stats.max_rss_kb, stats.mild_outliers, stats.far_outliers);
+}
+
+/*
+ * Keeps the event loop going during a benchmark, so that background tasks are
+ * served while the runs are measured.
+ */
+void bench_pump_events(void)
+{
+    handle_events(-1);
+}
+
+/*
+ * Forks one benchmark run of a task, with its output discarded.
+ */
+pid_t bench_spawn(void *ctx)
+{
+    Node_t *node = (Node_t *)ctx;
+    int devnull = open("/dev/null", O_WRONLY | O_CLOEXEC);
+    pid_t pid = fork();
+    if (pid == 0)
+    {
+        exec_task(node, NULL, -1, devnull, -1);
+    }
+    if (devnull != -1)
+    {
+        close(devnull);
+    }
+    return pid;
+}
+
+/*
+ * The set built-in: lists all settings, or changes one.
+ */
+void set_command(char *args[], int argc)
+{
+    if (argc == 1)
+    {
+        for (int key = 0; key < CFG_COUNT; key++)
+        {
+            log_setting(config_name(key), config_get(key), config_help(key));
+        }
+        return;
+    }
+
+    char *end = NULL;
+    long value = (argc == 3) ? strtol(args[2], &end, 10) : 0;
+    int key = -1;
+    if (argc == 3 && end != args[2] && !*end)
+    {
+        key = config_set(args[1], value);
+    }
+    if (key < 0)
+    {
+        log_setting_error(argc > 1 ? args[1] : "(missing)");
+        return;
+    }
+    if (key == CFG_POOL_MB)
+    {
+        ring_pool_limit((size_t)value * 1024 * 1024);
+    }
+    if (key == CFG_LOG_GZIP && value && !logrotate_can_compress())
+    {
+        config_set(args[1], 0);
+        log_setting_error(args[1]);
+        return;
+    }
+    if (key == CFG_SUBREAPER && reaper_enable((int)value) == -1)
+    {
+        config_set(args[1], reaper_enabled());
+        log_setting_error(args[1]);
+        return;
+    }
+    log_setting(config_name(key), config_get(key), config_help(key));
+}
+
+void output(char *file)
+{
+
+    pid_t pid;
+    if (!(pid = fork()))
+    {
+        ev_child_reset();
+        execl("/usr/bin/cat", "cat", file, NULL);
+        printf("output failed\n");
+        exit(1);
+    }
+    waitpid(pid, NULL, 0);
+}
+
+/*
+ * Parses the options of output: "--lines A:B" (either end may be left out, and
+ * "--lines A" is line A alone) or "--tail N". Returns 0 if they are invalid.
+ */
+int parse_output_slice(char *args[], int count, unsigned long long *first, unsigned long long *last,
+                       unsigned long long *tail)
+{
+    char *end;
+
+    if (count <= 0)
+    {
+        return 1;
+    }
+    if (count != 2)
+    {
+        return 0;
+    }
+    if (strcmp(args[0], "--tail") == 0)
+    {
+        *tail = strtoull(args[1], &end, 10);
+        return (*end == '\0' && *tail > 0 && args[1][0] != '-');
+    }
+    if (strcmp(args[0], "--lines") != 0 || args[1][0] == '-')
+    {
+        return 0;
+    }
+    char *colon = strchr(args[1], ':');
+    *first = (args[1][0] == ':') ? 1 : strtoull(args[1], &end, 10);
+    if (args[1][0] != ':' && end != (colon ? colon : args[1] + strlen(args[1])))
+    {
+        return 0;
+    }
+    *last = *first;
+    if (colon)
+    {
+        *last = colon[1] ? strtoull(colon + 1, &end, 10) : ~0ULL;
+        if (colon[1] && (*end != '\0' || colon[1] == '-'))
+        {
+            return 0;
+        }
+    }
+    return (*first > 0 && *first <= *last);
+}
+
+/*
+ * Splits a copy of cmdline (kept in buffer, at least MAXLINE bytes) into words.
+ * Returns the number of words stored in args, which is NULL terminated.
+ */
+int split_args(const char *cmdline, char *buffer, char *args[], int max)
+{
+    int count = 0;
+    snprintf(buffer, MAXLINE, "%s", cmdline);
+    char *p_tok = strtok(buffer, " ");
+    while (p_tok && count < max - 1)
+    {
+        args[count++] = p_tok;
+        p_tok = strtok(NULL, " ");
+    }
+    args[count] = NULL;
+    return count;
+}
+
+/*
+ * Reads a task ID from a word. Returns 1 if the whole word is a number.
+ */
+int parse_task_id(const char *token, int *taskid)
+{
+    char *end = NULL;
+    if (!token)
+    {
+        return 0;
+    }
+    *taskid = (int)strtol(token, &end, 10);
+    if (!end || *end || end == token)
+    {
+        *taskid = 0;
+        return 0;
+    }
+    return 1;
+}
+
+/*
+ * This helper function returns 1 if a file exists
+ */
+int file_exists(char *filename)
+{
+    FILE *f;
+    if ((f = fopen(filename, "r")))
+    {
+        fclose(f);
+        return 1;
+    }
+    return 0;
+}
+
+/*
+ * The signals below go to the task's whole process group (see task_signal), so
+ * any children the task started are stopped or cancelled along with it.
+ */
+void cancel(Node_t *node)
+{
+    if (node->state == LOG_STATE_PENDING)
+    { // nothing was started yet
+        pending_remove(global_tasks, node);
+        set_state(node, LOG_STATE_KILLED);
+        log_pending_cancel(node->taskID, node->command);
+        done_list_add(global_tasks, node);
+        run_end(node);
+        return;
+    }
+    log_sig_sent(LOG_CMD_CANCEL, node->taskID, node->pid);
+    task_signal(node, SIGINT);
+    if (node->state == LOG_STATE_SUSPENDED)
+    {
+        task_signal(node, SIGCONT); // a stopped group only acts on the SIGINT once continued
+    }
+    set_state(node, LOG_STATE_KILLED);
+}
+
+void suspend(Node_t *node)
+{
+    node->shed = 0; // from now on it is up to whoever suspended it
+    log_sig_sent(LOG_CMD_SUSPEND, node->taskID, node->pid);
+    task_signal(node, SIGTSTP);
+    set_state(node, LOG_STATE_SUSPENDED);
+}
+
+void resume(Node_t *node)
+{
+    node->shed = 0;
+    log_sig_sent(LOG_CMD_RESUME, node->taskID, node->pid);
+    task_signal(node, SIGCONT);
+    set_state(node, LOG_STATE_WORKING);
+}
+
+/*
+ * Returns the index of the tag with the given name. If it does not exist yet and
+ * create is set, it is added. Returns -1 if not found or the table is full.
+ */
+int find_tag(const char *name, int create)
+{
+    int free_slot = -1;
+    for (int i = 0; i < MAX_TAGS; i++)
+    {
+        if (tag_names[i] && strcmp(tag_names[i], name) == 0)
+        {
+            return i;
+        }
+        if (!tag_names[i] && free_slot < 0)
+        {
+            free_slot = i;
+        }
+    }
+    if (!create || free_slot < 0)
+    {
+        return -1;
+    }
+    tag_names[free_slot] = string_copy(name);
+    return free_slot;
+}
+
+/*
+ * Fills in a selector from the words of a command. Each word is one of
+ *   N, A-B, or a comma separated list of those      task IDs and ranges
+ *   all                                             every task
+ *   standby, working, suspended, complete, killed   tasks in that state
+ *   @NAME                                           tasks carrying tag NAME
+ * A task is selected if any word matches it. Returns 0 (after logging) on a bad word.
+ */
+int parse_selector(Selector_t *sel, char *args[], int count)
+{
+    static const char *states[] = {"standby", "working", "suspended", "complete", "killed", "pending", NULL};
+    memset(sel, 0, sizeof(Selector_t));
+
+    if (count < 1)
+    {
+        log_selector_error("(missing)");
+        return 0;
+    }
+
+    for (int i = 0; i < count; i++)
+    {
+        char *word = args[i];
+        int is_state = 0;
+
+        if (strcmp(word, "all") == 0)
+        {
+            sel->all = 1;
+            continue;
+        }
+        for (int s = 0; states[s]; s++)
+        {
+            if (strcasecmp(word, states[s]) == 0)
+            {
+                sel->state_mask |= 1 << s;
+                is_state = 1;
+            }
+        }
+        if (is_state)
+        {
+            continue;
+        }
+        if (word[0] == '@')
+        {
+            int tag = find_tag(word + 1, 0);
+            if (tag < 0)
+            {
+                log_selector_error(word);
+                return 0;
+            }
+            sel->tag_mask |= 1u << tag;
+            continue;
+        }
+
+        char *save = NULL;
+        for (char *part = strtok_r(word, ",", &save); part; part = strtok_r(NULL, ",", &save))
+        {
+            char *end = NULL;
+            long low = strtol(part, &end, 10);
+            long high = low;
+            if (end != part && *end == '-')
+            {
+                char *start = end + 1;
+                high = strtol(start, &end, 10);
+                if (end == start)
+                {
+                    end = NULL;
+                }
+            }
+            if (!end || *end || end == part || low < 1 || high < low || sel->num_ranges >= MAXARGS)
+            {
+                log_selector_error(part);
+                return 0;
+            }
+            sel->low[sel->num_ranges] = (int)low;
+            sel->high[sel->num_ranges] = (int)high;
+            sel->num_ranges++;
+        }
+    }
+    return 1;
+}
+
+/*
+ * Returns 1 if the selector picks the node. explicit is set to the index of the
+ * single ID that named it, or -1 if it was only matched by a range or filter.
+ */
+int selector_matches(Selector_t *sel, Node_t *node, int *explicit)
+{
+    int matches = sel->all || (sel->state_mask & (1 << node->state)) || (sel->tag_mask & node->tags);
+    *explicit = -1;
+    for (int r = 0; r < sel->num_ranges; r++)
+    {
+        if (node->taskID >= sel->low[r] && node->taskID <= sel->high[r])
+        {
+            matches = 1;
+            if (sel->low[r] == sel->high[r])
+            {
+                *explicit = r;
+                sel->found[r] = 1;
+            }
+        }
+    }
+    return matches;
+}
+
+/*
+ * Logs an error for every single ID in the selector that matched no task.
+ */
+void log_unmatched_ids(Selector_t *sel)
+{
+    for (int r = 0; r < sel->num_ranges; r++)
+    {
+        if (sel->low[r] == sel->high[r] && !sel->found[r])
+        {
+            log_task_id_error(sel->low[r]);
+        }
+    }
+}
+
+/*
+ * Sends cancel, suspend or resume to every selected task in a single pass over
+ * the task list. Tasks picked by a filter or range are skipped if the signal does
+ * not apply to their state; tasks named by a single ID report the error instead.
+ */
+void signal_selection(Tasks_t *tasks, Selector_t *sel, int sig_type)
+{
+    int explicit = -1;
+
+    for (Node_t *current = tasks->head; current; current = current->next)
+    {
+        if (!selector_matches(sel, current, &explicit))
+        {
+            continue;
+        }
+
+        int applies = is_busy(current);
+        if (sig_type == LOG_CMD_SUSPEND)
+        {
+            applies = (current->state == LOG_STATE_WORKING);
+        }
+        else if (sig_type == LOG_CMD_RESUME)
+        {
+            applies = (current->state == LOG_STATE_SUSPENDED);
+        }
+
+        if (!applies)
+        {
+            if (explicit >= 0)
+            {
+                log_status_error(current->taskID, current->state);
+            }
+            continue;
+        }
+
+        if (sig_type == LOG_CMD_CANCEL)
+        {
+            cancel(current);
+        }
+        else if (sig_type == LOG_CMD_SUSPEND)
+        {
+            suspend(current);
+        }
+        else
+        {
+            resume(current);
+        }
+    }
+    log_unmatched_ids(sel);
+}
+
+/*
+ * Adds (or removes) a tag on every selected task.
+ */
+void tag_selection(Tasks_t *tasks, Selector_t *sel, int tag, int add)
+{
+    int explicit = -1;
+    int count = 0;
+
+    for (Node_t *current = tasks->head; current; current = current->next)
+    {
+        if (!selector_matches(sel, current, &explicit))
+        {
+            continue;
+        }
+        if (add)
+        {
+            current->tags |= 1u << tag;
+        }
+        else
+        {
+            current->tags &= ~(1u << tag);
+        }
+        count++;
+    }
+    log_unmatched_ids(sel);
+    log_tag_change(tag_names[tag], count, add);
+}
+
+/*
+ * Shows CPU, memory, thread and I/O usage of every Working task, refreshed every
+ * interval seconds until control-c, until count refreshes have been shown (if
+ * count is not 0), or until no task is Working anymore.
+ */
+void top(Tasks_t *tasks, double interval, int count)
+{
+    int refreshes = 0;
+    command_interrupted = 0;
+
+    while (!command_interrupted && (count == 0 || refreshes < count))
+    {
+        int working = 0; // Working tasks found
+        int shown = 0;   // Working tasks with a sample to show
+        for (Node_t *current = tasks->head; current; current = current->next)
+        {
+            if (current->state != LOG_STATE_WORKING)
+            {
+                if (!is_busy(current) && current->run && current->run->stats.pid)
+                {
+                    procstat_close(&current->run->stats);
+                }
+                continue;
+            }
+            working++;
+            if (!current->run)
+            {
+                continue; // its launch is still being set up
+            }
+            if (current->run->stats.pid != current->pid)
+            {
+                procstat_open(&current->run->stats, current->pid); // baseline, shown from the next refresh
+                continue;
+            }
+            if (procstat_sample(&current->run->stats) == -1)
+            {
+                procstat_close(&current->run->stats);
+                continue;
+            }
+            if (!shown)
+            {
+                log_top_header();
+            }
+            shown++;
+            log_top_row(current->taskID, current->pid, current->run->stats.cpu_percent, current->run->stats.rss_kb,
+                        current->run->stats.threads, current->run->stats.read_bytes, current->run->stats.write_bytes,
+                        current->command);
+        }
+        if (!working)
+        {
+            break;
+        }
+        refreshes += (shown > 0);
+        if ((count == 0 || refreshes < count) && top_sleep(interval))
+        {
+            break;
+        }
+    }
+}
+
+/*
+ * The follow built-in: shows the last lines of a task's output and then copies
+ * new output to the terminal as it is captured, until the task is Complete or
+ * Killed and its output is drained, or control-c is pressed.
+ */
+void follow(Node_t *node)
+{
+    show_output(node, 0, 0, 10);
+    if (!is_busy(node) && (!node->run || node->run->out_fd == -1))
+    {
+        return; // nothing more will come
+    }
+    log_follow(node->taskID, 1);
+    command_interrupted = 0;
+    follow_node = node;
+    want_stdin(0);
+    while (!command_interrupted && (is_busy(node) || (node->run && node->run->out_fd != -1)))
+    {
+        handle_events(-1);
+    }
+    want_stdin(1);
+    follow_node = NULL;
+    log_follow(node->taskID, 0);
+}
+
+/*
+ * The wait built-ins: wait <TASKS>, waitany and waitall, each with an optional
+ * --timeout <SECONDS>. They block the command line in the event loop (no
+ * polling) until the tasks named, the first running task or all running tasks
+ * have finished and been reaped, reporting each one as it finishes. The status
+ * printed at the end is the largest of theirs (see wait_status), WAIT_TIMED_OUT
+ * or WAIT_INTERRUPTED (control-c).
+ */
+void wait_command(Tasks_t *tasks, char *args[], int argc, int mode)
+{
+    Selector_t sel;
+    char *named[MAXARGS];
+    int num_named = 0, explicit = -1;
+    double timeout = -1;
+    struct timespec start;
+
+    for (int i = 1; i < argc; i++)
+    {
+        if (strcmp(args[i], "--timeout") == 0)
+        {
+            char *end = NULL;
+            timeout = (i + 1 < argc) ? strtod(args[++i], &end) : -1;
+            if (timeout < 0 || end == args[i] || *end)
+            {
+                log_wait_usage();
+                return;
+            }
+        }
+        else
+        {
+            named[num_named++] = args[i];
+        }
+    }
+    if ((mode == WAIT_FOR_TASKS) != (num_named > 0))
+    {
+        log_wait_usage();
+        return;
+    }
+    if (mode == WAIT_FOR_TASKS && !parse_selector(&sel, named, num_named))
+    {
+        return;
+    }
+
+    /* the tasks are kept from the retention policy while waited for, so the pointers stay valid */
+    Node_t **waiting = (Node_t **)malloc((tasks->count + 1) * sizeof(Node_t *));
+    int count = 0;
+    for (Node_t *current = tasks->head; waiting && current; current = current->next)
+    {
+        if ((mode == WAIT_FOR_TASKS) ? selector_matches(&sel, current, &explicit) : wait_pending(current))
+        {
+            current->waited = 1;
+            waiting[count++] = current;
+        }
+    }
+    if (mode == WAIT_FOR_TASKS)
+    {
+        log_unmatched_ids(&sel);
+    }
+
+    int finished = 0, status = 0, reason = 0;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    command_interrupted = 0;
+    want_stdin(0);
+    while (1)
+    {
+        for (int i = finished; i < count; i++)
+        { // finished tasks are moved to the front, in the order they finished
+            Node_t *node = waiting[i];
+            if (wait_pending(node))
+            {
+                continue;
+            }
+            log_wait_result(node->taskID, node->command, node->state, node->exit_status, node->term_signal);
+            status = (wait_status(node) > status) ? wait_status(node) : status;
+            waiting[i] = waiting[finished];
+            waiting[finished++] = node;
+        }
+        if (finished == count || (mode == WAIT_FOR_ANY && finished > 0))
+        {
+            break;
+        }
+        if (command_interrupted)
+        {
+            reason = status = WAIT_INTERRUPTED;
+            break;
+        }
+        int timeout_ms = -1;
+        if (timeout >= 0)
+        {
+            double left = timeout - seconds_since(&start);
+            if (left <= 0)
+            {
+                reason = status = WAIT_TIMED_OUT;
+                break;
+            }
+            timeout_ms = (int)(left * 1000) + 1;
+        }
+        handle_events(timeout_ms);
+    }
+    want_stdin(1);
+    for (int i = 0; i < count; i++)
+    {
+        waiting[i]->waited = 0;
+    }
+    free(waiting);
+    log_wait_done(finished, count - finished, status, reason);
+}
+
+/*
+ * Returns 1 while a task has a run that has not finished or not been reaped yet.
+ */
+int wait_pending(Node_t *node)
+{
+    return is_busy(node) || (node->run && (node->run->pidfd != -1 || node->run->tree_wait));
+}
+
+/*
+ * Status of a finished task for the wait built-ins: its exit code if it is
+ * Complete, 128 plus the signal if it is Killed (as shells do), 0 otherwise.
+ */
+int wait_status(Node_t *node)
+{
+    if (node->state == LOG_STATE_COMPLETE)
+    {
+        return node->exit_status;
+    }
+    if (node->state == LOG_STATE_KILLED)
+    {
+        return 128 + node->term_signal;
+    }
+    return 0;
+}
+
+/*
+ * The history built-in: lists the recent runs of a task, oldest first.
+ */
+void history_command(Node_t *node)
+{
+    static const char *modes[] = {"fg", "bg", "log"};
+    RunHistory *h = &node->history;
+    unsigned long first = (h->total > HISTORY_RUNS) ? h->total - HISTORY_RUNS : 0;
+
+    log_history_header(node->taskID, node->command, h->total, h->total - first);
+    for (unsigned long n = first; n < h->total; n++)
+    {
+        const RunRecord *run = history_run(h, n);
+        char start[32], outcome[32];
+        history_format_time(run->start_ms, start, sizeof(start));
+        switch (run->kind)
+        {
+        case HISTORY_RUNNING:
+            snprintf(outcome, sizeof(outcome), "running");
+            break;
+        case HISTORY_EXITED:
+            snprintf(outcome, sizeof(outcome), "exit code %d", run->code);
+            break;
+        case HISTORY_SIGNALED:
+            snprintf(outcome, sizeof(outcome), "signal %d", run->code);
+            break;
+        case HISTORY_CACHED:
+            snprintf(outcome, sizeof(outcome), "cached, exit code %d", run->code);
+            break;
+        default:
+            snprintf(outcome, sizeof(outcome), "not reaped");
+        }
+        log_history_run(n + 1, start, run->kind == HISTORY_RUNNING ? -1 : (long)run->duration_ms, modes[run->mode],
+                        run->pid, outcome, run->cpu_ms, run->max_rss_kb, run->adopted);
+    }
+}
+
+/*
+ * How the current run of a task was started, as a HISTORY_* mode.
+ */
+int history_mode(Node_t *node)
+{
+    if (!node->is_background_task)
+    {
+        return HISTORY_FG;
+    }
+    return node->logged ? HISTORY_LOG : HISTORY_BG;
+}
+
+/*
+ * The metrics built-in: "metrics" prints the metrics, "metrics <PORT>" or
+ * "metrics <PATH>" serves them to Prometheus on 127.0.0.1 or a Unix socket,
+ * and "metrics off" stops serving them.
+ */
+void metrics_command_line(char *args[], int argc)
+{
+    static char buffer[16384];
+
+    if (argc == 1)
+    {
+        int len = metrics_render(buffer, sizeof(buffer));
+        if (len > 0)
+        {
+            write(STDOUT_FILENO, buffer, len);
+        }
+        return;
+    }
+    if (argc != 2)
+    {
+        log_metrics(NULL, -1);
+        return;
+    }
+    if (strcmp(args[1], "off") == 0)
+    {
+        metrics_stop();
+        log_metrics(NULL, 0);
+        return;
+    }
+    log_metrics(args[1], (metrics_serve(args[1]) == 0) ? 0 : errno);
+}
+
+/*
+ * The trace built-in: "trace on" starts recording task lifecycles and command
+ * handling, "trace off" stops, "trace dump <FILE>" writes what was recorded as
+ * Chrome Trace Event JSON, and "trace" shows whether tracing is on.
+ */
+void trace_command_line(char *args[], int argc)
+{
+    if (argc == 1)
+    {
+        log_trace_status(trace_on, trace_count());
+    }
+    else if (argc == 2 && strcmp(args[1], "on") == 0)
+    {
+        if (trace_start() == -1)
+        {
+            log_trace_error(NULL);
+            return;
+        }
+        log_trace_status(trace_on, trace_count());
+    }
+    else if (argc == 2 && strcmp(args[1], "off") == 0)
+    {
+        trace_stop();
+        log_trace_status(trace_on, trace_count());
+    }
+    else if (argc == 3 && strcmp(args[1], "dump") == 0)
+    {
+        long events = trace_dump(args[2]);
+        if (events < 0)
+        {
+            log_trace_error(args[2]);
+            return;
+        }
+        log_trace_dump(args[2], events);
+    }
+    else
+    {
+        log_trace_error(NULL);
+    }
+}
+
+/*
+ * Returns the seconds elapsed since start (on the monotonic clock).
+ */
+double seconds_since(struct timespec *start)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (now.tv_sec - start->tv_sec) + (now.tv_nsec - start->tv_nsec) / 1e9;
+}
+
+/*
+ * Appends a task that has just been reaped to the list of finished tasks.
+ */
+void done_list_add(Tasks_t *tasks, Node_t *node)
+{
+    done_list_remove(tasks, node);
+    clock_gettime(CLOCK_MONOTONIC, &node->finished);
+    node->done_prev = tasks->done_tail;
+    node->done_next = NULL;
+    if (tasks->done_tail)
+    {
+        tasks->done_tail->done_next = node;
+    }
+    else
+    {
+        tasks->done_head = node;
+    }
+    tasks->done_tail = node;
+    node->done_listed = 1;
+    tasks->done_count++;
+}
+
+/*
+ * Takes a task out of the list of finished tasks, if it is there.
+ */
+void done_list_remove(Tasks_t *tasks, Node_t *node)
+{
+    if (!node->done_listed)
+    {
+        return;
+    }
+    if (node->done_prev)
+    {
+        node->done_prev->done_next = node->done_next;
+    }
+    else
+    {
+        tasks->done_head = node->done_next;
+    }
+    if (node->done_next)
+    {
+        node->done_next->done_prev = node->done_prev;
+    }
+    else
+    {
+        tasks->done_tail = node->done_prev;
+    }
+    node->done_prev = node->done_next = NULL;
+    node->done_listed = 0;
+    tasks->done_count--;
+}
+
+/*
+ * Returns 1 if a retention policy is set and there are finished tasks it may remove.
+ */
+int retention_due(Tasks_t *tasks)
+{
+    return tasks && tasks->done_count > 0 && (config_get(CFG_KEEP_DONE) > 0 || config_get(CFG_KEEP_SECS) > 0);
+}
+
+/*
+ * Returns 1 if load shedding is on, or tasks it suspended are still to be resumed.
+ */
+int shed_due(Tasks_t *tasks)
+{
+    return tasks && (config_get(CFG_SHED_PSI) > 0 || config_get(CFG_SHED_AVAIL_MB) > 0 || tasks->shed_count > 0);
+}
+
+/*
+ * Suspends the least important background task while memory is under pressure,
+ * and resumes the tasks it suspended, most important first, once the pressure
+ * has subsided. shed_decide() spaces the steps and provides the hysteresis.
+ * The transitions are reported like manual ones, with the reason on top.
+ */
+void shed_run(Tasks_t *tasks)
+{
+    double pressure[3];
+    long avail_kb = shed_mem_available();
+    int suspended = 0;
+
+    admit_pressure(pressure);
+    for (Node_t *current = tasks->head; current; current = current->next)
+    {
+        current->shed = current->shed && current->state == LOG_STATE_SUSPENDED; // it may have ended meanwhile
+        suspended += current->shed;
+    }
+    tasks->shed_count = suspended;
+
+    int step = shed_decide(pressure[ADMIT_PSI_MEMORY], avail_kb, config_get(CFG_SHED_PSI),
+                           config_get(CFG_SHED_AVAIL_MB), config_get(CFG_SHED_SECS), suspended);
+    Node_t *node = (step == SHED_NONE) ? NULL : shed_pick(tasks, step);
+    if (!node)
+    {
+        return;
+    }
+    log_shed(node->taskID, node->command, step == SHED_SUSPEND, pressure[ADMIT_PSI_MEMORY],
+             avail_kb < 0 ? -1 : avail_kb / 1024);
+    if (step == SHED_SUSPEND)
+    {
+        suspend(node);
+        node->shed = 1;
+        tasks->shed_count++;
+    }
+    else
+    {
+        resume(node);
+        tasks->shed_count--;
+    }
+    shed_stepped();
+}
+
+/*
+ * Picks the task for a load shedding step. To suspend: the Working background
+ * task with the lowest priority class, the largest resident set among equals.
+ * To resume: the task suspended by load shedding with the highest priority
+ * class, the smallest resident set among equals.
+ */
+Node_t *shed_pick(Tasks_t *tasks, int step)
+{
+    Node_t *best = NULL;
+    long best_rss = 0;
+
+    for (Node_t *current = tasks->head; current; current = current->next)
+    {
+        if (step == SHED_SUSPEND ? (current->state != LOG_STATE_WORKING || !current->is_background_task ||
+                                    !current->run || current->run->pidfd == -1)
+                                 : !current->shed)
+        {
+            continue;
+        }
+        long rss = task_rss_kb(current);
+        int better;
+        if (!best)
+        {
+            better = 1;
+        }
+        else if (current->prio_class != best->prio_class)
+        {
+            better = (step == SHED_SUSPEND) == (current->prio_class > best->prio_class);
+        }
+        else
+        {
+            better = (step == SHED_SUSPEND) ? rss > best_rss : rss < best_rss;
+        }
+        if (better)
+        {
+            best = current;
+            best_rss = rss;
+        }
+    }
+    return best;
+}
+
+/*
+ * Current resident set size of a task's process in KiB, 0 if unknown. The
+ * /proc files stay open for the next sample, as for top.
+ */
+long task_rss_kb(Node_t *node)
+{
+    if (!node->run)
+    {
+        return 0;
+    }
+    if (node->run->stats.pid == node->pid ? procstat_sample(&node->run->stats) == -1
+                                          : procstat_open(&node->run->stats, node->pid) == -1)
+    {
+        return 0;
+    }
+    return node->run->stats.rss_kb;
+}
+
+/*
+ * Removes finished tasks beyond the newest keep_done ones, and those finished
+ * more than keep_secs ago. At most RETENTION_BATCH tasks go per run (the event
+ * loop runs it about once a second), so a large backlog is worked off in steps.
+ * Tasks whose output is still being captured, or that follow is showing, stay.
+ * The logs of evicted tasks are deleted with them.
+ */
+void retention_run(Tasks_t *tasks)
+{
+    long keep = config_get(CFG_KEEP_DONE);
+    long secs = config_get(CFG_KEEP_SECS);
+    int picked = 0;
+    int remaining = tasks->done_count;
+
+    for (Node_t *node = tasks->done_head; node && picked < RETENTION_BATCH; node = node->done_next, remaining--)
+    {
+        int too_many = keep > 0 && remaining > keep;
+        int too_old = secs > 0 && seconds_since(&node->finished) >= secs;
+        if (!too_many && !too_old)
+        {
+            break; // the rest finished later
+        }
+        if (is_busy(node) || run_open(node) || node == follow_node || node->watched || node->waited)
+        {
+            continue;
+        }
+        node->evict = 1;
+        picked++;
+    }
+    if (!picked)
+    {
+        return;
+    }
+
+    /* one pass over the task list unlinks everything picked */
+    Node_t **link = &tasks->head;
+    while (*link)
+    {
+        Node_t *node = *link;
+        if (!node->evict)
+        {
+            link = &node->next;
+            continue;
+        }
+        *link = node->next;
+        tasks->count--;
+        done_list_remove(tasks, node);
+        metrics_task_state(node->state, -1);
+        tasks->evicted++;
+        if (node->state == LOG_STATE_KILLED)
+        {
+            tasks->evicted_killed++;
+        }
+        else if (node->exit_status == 0)
+        {
+            tasks->evicted_complete++;
+        }
+        else
+        {
+            tasks->evicted_failed++;
+        }
+        remove_logs(node);
+        free_node(node);
+    }
+}
+
+/*
+ * Deletes the log of an evicted task: logN.txt, its line index and its rotated
+ * segments. IDs are reused, so a new task with the same ID would otherwise show
+ * and search them as its own output.
+ */
+void remove_logs(Node_t *node)
+{
+    char filename[100];
+
+    snprintf(filename, sizeof(filename), "log%d.idx", node->taskID);
+    unlink(filename);
+    snprintf(filename, sizeof(filename), "log%d.txt", node->taskID);
+    if (unlink(filename) == 0 || node->logged)
+    {
+        logrotate_forget(node->taskID); // rotation always leaves a logN.txt behind, so there are none otherwise
+    }
+}
+
+/*
+ * Handles task events for interval seconds. Returns 1 if control-c cut it short.
+ */
+int top_sleep(double interval)
+{
+    struct timespec now, end;
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    end.tv_sec += (time_t)interval;
+    end.tv_nsec += (long)((interval - (time_t)interval) * 1e9);
+
+    want_stdin(0);
+    while (!command_interrupted)
+    {
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        long remaining = (end.tv_sec - now.tv_sec) * 1000 + (end.tv_nsec - now.tv_nsec) / 1000000;
+        if (remaining <= 0)
+        {
+            break;
+        }
+        handle_events((int)remaining);
+    }
+    want_stdin(1);
+    return command_interrupted;
+}
+
+/*
+ * Changes the priority class of a task. A Working or Suspended task has the new
+ * class applied to its whole process group right away, otherwise it is used from
+ * the next launch on.
+ */
+void renice(Node_t *node, int prio_class)
+{
+    if (is_busy(node) && node->run && node->run->pidfd != -1 ? prio_apply_group(node->pid, prio_class) == -1
+                                                             : !prio_allowed(prio_class))
+    {
+        log_prio_error(node->taskID, prio_name(prio_class));
+        return;
+    }
+    node->prio_class = prio_class;
+    log_renice(node->taskID, is_busy(node) ? node->pid : 0, prio_name(prio_class));
+}
+
+/*
+ * Waits up to timeout_ms (-1 for ever) for events and handles them: task exits
+ * come from each task's pidfd, stops and continues are looked up when SIGCHLD
+ * arrives. Returns 1 if the command line has input ready.
+ */
+int handle_events(int timeout_ms)
+{
+    EvWatch *ready[64];
+
+    if (!stdin_pollable && stdin_wanted)
+    {
+        timeout_ms = 0; // regular file on stdin: always readable
+    }
+    if ((retention_due(global_tasks) || shed_due(global_tasks)) && (timeout_ms < 0 || timeout_ms > 1000))
+    {
+        timeout_ms = 1000; // wake up to let the retention policy and load shedding run
+    }
+    free_retired_runs();
+    int count = ev_wait(ready, 64, timeout_ms);
+    clock_gettime(CLOCK_MONOTONIC, &events_woke);
+    int stdin_ready = !stdin_pollable && stdin_wanted;
+
+    for (int i = 0; i < count; i++)
+    {
+        if (ready[i]->fd == -1)
+        {
+            continue; // removed while handling an earlier event of this wait
+        }
+        if (ready[i]->kind == EV_STDIN)
+        {
+            stdin_ready = 1;
+        }
+        else if (ready[i]->kind == EV_TASK)
+        {
+            task_exit_event(ready[i]->owner);
+        }
+        else if (ready[i]->kind == EV_OUTPUT)
+        {
+            Node_t *node = ready[i]->owner;
+            capture_event(node, (ready[i] == &node->run->err_watch) ? CACHE_STDERR : CACHE_STDOUT, 0);
+        }
+        else if (ready[i]->kind == EV_WATCH)
+        {
+            watch_changes();
+        }
+        else if (ready[i]->kind == EV_DEBOUNCE)
+        {
+            watch_settle(watched_changed);
+        }
+        else if (ready[i]->kind == EV_ADMIT)
+        {
+            admission_event(global_tasks);
+        }
+        else if (ready[i]->kind == EV_BENCH)
+        {
+            bench_event(ready[i]);
+        }
+        else if (ready[i]->kind == EV_MAP)
+        {
+            map_event(ready[i]);
+        }
+        else if (ready[i]->kind == EV_HELPER)
+        {
+            helper_exit_event(ready[i]);
+        }
+        else if (ready[i]->kind == EV_SIGCHLD)
+        {
+            struct signalfd_siginfo info;
+            while (read(ready[i]->fd, &info, sizeof(info)) == sizeof(info))
+                ; // several SIGCHLDs may have been merged into one, so only the wakeup matters
+            task_stop_scan(global_tasks);
+        }
+    }
+    if (retention_due(global_tasks))
+    {
+        struct timespec *last = &global_tasks->last_retention;
+        if (seconds_since(last) >= 1.0)
+        {
+            retention_run(global_tasks);
+            clock_gettime(CLOCK_MONOTONIC, last);
+        }
+    }
+    if (shed_due(global_tasks) && seconds_since(&global_tasks->last_shed) >= 1.0)
+    {
+        shed_run(global_tasks);
+        clock_gettime(CLOCK_MONOTONIC, &global_tasks->last_shed);
+    }
+    return stdin_ready;
+}
+
+/*
+ * Starts tracking a freshly forked task process through a pidfd. The pid cannot
+ * have been recycled yet because nothing reaps children except through pidfds.
+ * Returns -1 if no pidfd can be opened (usually for lack of file descriptors):
+ * the process could then never be reaped or signalled, so its group is killed
+ * and it is reaped right away, leaving the task as it was.
+ */
+int track_child(Node_t *node, pid_t pid)
+{
+    int pidfd = pidfd_open_pid(pid);
+    if (pidfd != -1 && reaper_claim(pid) == -1)
+    {
+        close(pidfd);
+        pidfd = -1;
+        errno = ENOMEM;
+    }
+    if (pidfd == -1)
+    {
+        int error = errno;
+        kill(-pid, SIGKILL);
+        while (waitpid(pid, NULL, 0) == -1 && errno == EINTR)
+            ;
+        errno = error;
+        return -1;
+    }
+    abandon_run(node); // the previous run was cancelled but may not have exited yet
+    node->run->tree_wait = 0;
+    node->run->tree_cpu_ms = 0;
+    node->run->tree_rss_kb = 0;
+    node->run->adopted = 0;
+    node->shed = 0;
+    done_list_remove(global_tasks, node); // running again
+    history_begin(&node->history, pid, history_mode(node));
+    node->pid = pid;
+    node->run->pidfd = pidfd;
+    metrics_spawn();
+    TRACE(trace_launch(node->taskID, pid));
+    ev_add(&node->run->watch, node->run->pidfd, EV_TASK, node);
+    return 0;
+}
+
+/*
+ * Hands the process of a cancelled run that has not exited yet, and descendants
+ * of it that are still around, over to the reaper on behalf of nobody, so that
+ * their exits no longer report on the task, which runs again.
+ */
+void abandon_run(Node_t *node)
+{
+    if (node->run->pidfd != -1)
+    {
+        ev_del(&node->run->watch);
+        reaper_track(node->run->pidfd, node->pid, NULL);
+        node->run->pidfd = -1;
+    }
+    reaper_detach(node);
+    node->run->tree_wait = 0;
+}
+
+/*
+ * Reports a launch whose process could not be started or tracked, and puts the
+ * task back in Standby so that it can be launched again. error is the errno of
+ * the failure.
+ */
+void launch_failed(Node_t *node, int error)
+{
+    log_launch_error(node->taskID, node->command, strerror(error));
+    cache_abandon(&node->run->cache);
+    done_list_remove(global_tasks, node);
+    set_state(node, LOG_STATE_STANDBY);
+    run_end(node);
+}
+
+/*
+ * Reaps a child no task tracks itself (a task's abandoned previous run or an
+ * adopted orphan) once it exits. The last adopted descendant of a task whose
+ * process is gone finishes the task.
+ */
+void helper_exit_event(EvWatch *watch)
+{
+    void *owner;
+    struct rusage usage;
+    if (reaper_exit(watch, &owner, &usage) == -1 || !owner)
+    {
+        return;
+    }
+    Node_t *node = (Node_t *)owner;
+    node->run->tree_cpu_ms += cpu_ms_of(&usage);
+    if (usage.ru_maxrss > node->run->tree_rss_kb)
+    {
+        node->run->tree_rss_kb = usage.ru_maxrss;
+    }
+    node->run->adopted++;
+    if (node->run->tree_wait && !tree_alive(node))
+    {
+        finish_task(node);
+    }
+}
+
+/*
+ * Adopts the orphans re-parented to taskman so far (in subreaper mode) and
+ * returns 1 if any of them belongs to the task. Only called once the task's
+ * process is gone: orphans that turn up while it runs wait for that scan.
+ */
+int tree_alive(Node_t *node)
+{
+    reaper_scan(task_of_group);
+    return reaper_count(node) > 0;
+}
+
+/*
+ * Returns the task whose current run leads process group pgid, or NULL. Every
+ * task process leads its own group, and descendants stay in it unless they leave.
+ */
+void *task_of_group(pid_t pgid)
+{
+    for (Node_t *current = global_tasks->head; current; current = current->next)
+    {
+        if (current->run && (current->run->pidfd != -1 || current->run->tree_wait) && current->pid == pgid)
+        {
+            return current;
+        }
+    }
+    return NULL;
+}
+
+/*
+ * User and system CPU time in a resource usage, in ms.
+ */
+unsigned long cpu_ms_of(const struct rusage *usage)
+{
+    return (usage->ru_utime.tv_sec + usage->ru_stime.tv_sec) * 1000UL +
+           (usage->ru_utime.tv_usec + usage->ru_stime.tv_usec) / 1000;
+}
+
+/*
+ * Stops watching a task's process once it has been reaped.
+ */
+void release_pidfd(Node_t *node)
+{
+    reaper_unclaim(node->pid);
+    ev_del(&node->run->watch);
+    close(node->run->pidfd);
+    node->run->pidfd = -1;
+}
+
+/*
+ * Handles the exit of a task's process, reported by its pidfd. In subreaper
+ * mode the task only finishes once the descendants it left behind are gone too.
+ */
+void task_exit_event(Node_t *node)
+{
+    siginfo_t info;
+    struct rusage usage;
+    if (pidfd_reap(node->run->pidfd, &info, &usage) == -1 || info.si_pid == 0)
+    {
+        return;
+    }
+    node->run->tree_cpu_ms += cpu_ms_of(&usage);
+    if (usage.ru_maxrss > node->run->tree_rss_kb)
+    {
+        node->run->tree_rss_kb = usage.ru_maxrss;
+    }
+    if (node->run->err_fd != -1)
+    {
+        capture_event(node, CACHE_STDERR, 1); // take in whatever the task wrote before exiting
+    }
+    if (node->run->out_fd != -1)
+    {
+        capture_event(node, CACHE_STDOUT, 1);
+    }
+    node->term_signal = (info.si_code == CLD_EXITED) ? 0 : info.si_status;
+    node->exit_status = (info.si_code == CLD_EXITED) ? info.si_status : 0;
+    release_pidfd(node);
+    metrics_exit_handling(seconds_since(&events_woke));
+
+    node->run->tree_wait = 1; // its orphans are re-parented by now, so the scan finds them
+    if (!tree_alive(node))
+    {
+        finish_task(node);
+    }
+}
+
+/*
+ * Reports a task whose process (and, in subreaper mode, every descendant) has
+ * been reaped as Complete or Killed, by how the process ended.
+ */
+void finish_task(Node_t *node)
+{
+    int code = node->term_signal ? node->term_signal : node->exit_status;
+    node->run->tree_wait = 0;
+    history_end(&node->history, node->term_signal ? HISTORY_SIGNALED : HISTORY_EXITED, code, node->run->tree_cpu_ms,
+                (unsigned long)node->run->tree_rss_kb, (unsigned long)node->run->adopted);
+
+    TRACE(trace_exit(node->taskID, code, node->term_signal != 0));
+    if (!node->term_signal)
+    {
+        log_status_change(node->taskID, node->pid, node->is_background_task, node->command, LOG_CANCEL);
+        set_state(node, LOG_STATE_COMPLETE);
+        metrics_exit(node->exit_status == 0 ? METRICS_EXIT_SUCCESS : METRICS_EXIT_FAILURE);
+        cache_commit(&node->run->cache, node->exit_status, (unsigned long long)config_get(CFG_CACHE_MB) * 1024 * 1024);
+    }
+    else
+    {
+        cache_abandon(&node->run->cache); // an interrupted run is no result
+        log_status_change(node->taskID, node->pid, node->is_background_task, node->command, LOG_CANCEL_SIG);
+        set_state(node, LOG_STATE_KILLED);
+        metrics_exit(METRICS_EXIT_SIGNALED);
+    }
+    done_list_add(global_tasks, node);
+    run_end(node);
+}
+
+/*
+ * Collects stop and continue notifications of every running task. Exits are
+ * left alone (no WEXITED) so that they are only ever reaped through the pidfd.
+ */
+void task_stop_scan(Tasks_t *tasks)
+{
+    siginfo_t info;
+
+    for (Node_t *current = tasks->head; current; current = current->next)
+    {
+        if (!current->run || current->run->pidfd == -1)
+        {
+            continue;
+        }
+        if (pidfd_wait(current->run->pidfd, &info, WSTOPPED | WCONTINUED) == -1 || info.si_pid == 0)
+        {
+            continue;
+        }
+        if (info.si_code == CLD_STOPPED)
+        {
+            log_status_change(current->taskID, current->pid, current->is_background_task, current->command, LOG_SUSPEND);
+            if (current->state == LOG_STATE_WORKING)
+            {
+                set_state(current, LOG_STATE_SUSPENDED);
+            }
+        }
+        else if (info.si_code == CLD_CONTINUED)
+        {
+            log_status_change(current->taskID, current->pid, current->is_background_task, current->command, LOG_RESUME);
+            if (current->state == LOG_STATE_SUSPENDED)
+            {
+                set_state(current, LOG_STATE_WORKING);
+            }
+        }
+    }
+}
+
+/*
+ * Sends a signal to a task's process group through its pidfd, or to what is left
+ * of the group once its process was reaped in subreaper mode. Returns -1 without
+ * sending anything if the whole group is gone, so a recycled pid is never signalled.
+ */
+int task_signal(Node_t *node, int sig)
+{
+    int rc;
+    if (!node->run)
+    {
+        return -1;
+    }
+    if (node->run->pidfd != -1)
+    {
+        rc = pidfd_signal_group(node->run->pidfd, node->pid, sig);
+    }
+    else if (node->run->tree_wait && reaper_count(node) > 0)
+    {
+        rc = killpg(node->pid, sig); // the group id stays reserved while its adopted members are unreaped
+    }
+    else
+    {
+        return -1;
+    }
+    if (rc == 0)
+    {
+        metrics_signal(sig);
+    }
+    return rc;
+}
+
+/*
+ * Handles events while a foreground task runs, until it exits, is stopped, or
+ * is interrupted with control-c.
+ */
+void fg_reaper(Node_t *node)
+{
+    want_stdin(0); // the command line belongs to the task for now
+    while (node->state == LOG_STATE_WORKING && node->run && node->run->pidfd != -1)
+    {
+        handle_events(-1);
+    }
+    want_stdin(1);
+}
+
+/*
+ * Turns reporting of command line input by handle_events off or on.
+ */
+void want_stdin(int wanted)
+{
+    stdin_wanted = wanted;
+    ev_enable(&stdin_watch, wanted);
+}
@@ -0,0 +1,258 @@
+/* Task lifecycle tracing and its export as Chrome Trace Event JSON. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdatomic.h>
+
+#include "trace.h"
+#include "logging.h"
+
+#define TRACE_CAPACITY 32768 /* records kept; older ones are overwritten */
+#define TRACE_TEXT 48        /* bytes of command text kept per record */
+#define NUM_STATES (LOG_STATE_PENDING + 1)
+
+/* Kinds of records */
+#define REC_CREATE  0
+#define REC_STATE   1
+#define REC_LAUNCH  2
+#define REC_EXIT    3
+#define REC_COMMAND 4
+
+typedef struct TraceRecord
+{
+    long long ts;          // microseconds on the monotonic clock
+    int kind;              // REC_* kind
+    int task_id;           // task the record is about (0 for commands)
+    long a;                // REC_STATE: old state, REC_LAUNCH: pid, REC_EXIT: status, REC_COMMAND: duration in us
+    long b;                // REC_STATE: new state, REC_EXIT: 1 if ended by a signal
+    char text[TRACE_TEXT]; // REC_CREATE and REC_COMMAND: the command
+} TraceRecord;
+
+int trace_on = 0;
+static TraceRecord *records = NULL;
+static atomic_ulong next_record; // records ever taken; slot is next_record % TRACE_CAPACITY
+
+static const char *state_names[NUM_STATES] = {"standby", "working", "suspended", "complete", "killed", "pending"};
+
+static long long now_us(void)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (long long)now.tv_sec * 1000000 + now.tv_nsec / 1000;
+}
+
+/* Claims the next slot; lock-free so that signal handlers can record too. */
+static TraceRecord *take(int kind, int task_id)
+{
+    unsigned long slot = atomic_fetch_add_explicit(&next_record, 1, memory_order_relaxed);
+    TraceRecord *rec = &records[slot % TRACE_CAPACITY];
+    rec->ts = now_us();
+    rec->kind = kind;
+    rec->task_id = task_id;
+    rec->a = rec->b = 0;
+    rec->text[0] = '\0';
+    return rec;
+}
+
+int trace_start(void)
+{
+    if (!records)
+    {
+        records = (TraceRecord *)malloc(TRACE_CAPACITY * sizeof(TraceRecord));
+        if (!records)
+        {
+            return -1;
+        }
+    }
+    atomic_store(&next_record, 0);
+    trace_on = 1;
+    return 0;
+}
+
+void trace_stop(void)
+{
+    trace_on = 0;
+}
+
+unsigned long trace_count(void)
+{
+    unsigned long taken = atomic_load(&next_record);
+    return (taken < TRACE_CAPACITY) ? taken : TRACE_CAPACITY;
+}
+
+void trace_create(int task_id, const char *command)
+{
+    TraceRecord *rec = take(REC_CREATE, task_id);
+    snprintf(rec->text, TRACE_TEXT, "%s", command);
+}
+
+void trace_state(int task_id, int old_state, int new_state)
+{
+    TraceRecord *rec = take(REC_STATE, task_id);
+    rec->a = old_state;
+    rec->b = new_state;
+}
+
+void trace_launch(int task_id, pid_t pid)
+{
+    take(REC_LAUNCH, task_id)->a = pid;
+}
+
+void trace_exit(int task_id, int status, int signaled)
+{
+    TraceRecord *rec = take(REC_EXIT, task_id);
+    rec->a = status;
+    rec->b = signaled;
+}
+
+void trace_command(const struct timespec *start, double seconds, const char *line)
+{
+    TraceRecord *rec = take(REC_COMMAND, 0);
+    rec->ts = (long long)start->tv_sec * 1000000 + start->tv_nsec / 1000;
+    rec->a = (long)(seconds * 1e6);
+    snprintf(rec->text, TRACE_TEXT, "%s", line);
+}
+
+/* Writes s as the inside of a JSON string. */
+static void json_text(FILE *out, const char *s)
+{
+    for (; *s; s++)
+    {
+        if (*s == '"' || *s == '\\')
+        {
+            fprintf(out, "\\%c", *s);
+        }
+        else if ((unsigned char)*s < 0x20)
+        {
+            fprintf(out, "\\u%04x", (unsigned char)*s);
+        }
+        else
+        {
+            fputc(*s, out);
+        }
+    }
+}
+
+/* A task's current span while the records are replayed */
+typedef struct OpenSpan
+{
+    int task_id;
+    int state;     // state the task is in, -1 if none known
+    long long ts;  // when it entered it
+} OpenSpan;
+
+static OpenSpan *find_span(OpenSpan *spans, int *count, int task_id)
+{
+    for (int i = 0; i < *count; i++)
+    {
+        if (spans[i].task_id == task_id)
+        {
+            return &spans[i];
+        }
+    }
+    spans[*count].task_id = task_id;
+    spans[*count].state = -1;
+    return &spans[(*count)++];
+}
+
+/* Emits the span of a task's state from its start until end (complete and killed have no span). */
+static long close_span(FILE *out, OpenSpan *span, long long end, long long base)
+{
+    if (span->state < 0 || span->state >= NUM_STATES || span->state == LOG_STATE_COMPLETE ||
+        span->state == LOG_STATE_KILLED)
+    {
+        return 0;
+    }
+    fprintf(out, ",\n{\"name\":\"%s\",\"cat\":\"task\",\"ph\":\"X\",\"pid\":2,\"tid\":%d,\"ts\":%lld,\"dur\":%lld}",
+            state_names[span->state], span->task_id, span->ts - base, end - span->ts);
+    return 1;
+}
+
+long trace_dump(const char *path)
+{
+    unsigned long taken = atomic_load(&next_record);
+    unsigned long count = trace_count();
+    unsigned long first = taken - count;
+    long events = 0;
+
+    if (!records)
+    {
+        count = 0;
+    }
+    FILE *out = fopen(path, "w");
+    if (!out)
+    {
+        return -1;
+    }
+    OpenSpan *spans = (OpenSpan *)calloc(count + 1, sizeof(OpenSpan));
+    int num_spans = 0;
+    long long base = count ? records[first % TRACE_CAPACITY].ts : 0;
+    long long end = now_us();
+
+    fprintf(out, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+    fprintf(out, "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":1,\"args\":{\"name\":\"taskman\"}},\n");
+    fprintf(out, "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":0,\"args\":{\"name\":\"commands\"}},\n");
+    fprintf(out, "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":2,\"args\":{\"name\":\"tasks\"}}");
+    for (unsigned long i = first; spans && i < taken; i++)
+    {
+        TraceRecord *rec = &records[i % TRACE_CAPACITY];
+        long long ts = rec->ts - base;
+        OpenSpan *span;
+
+        switch (rec->kind)
+        {
+        case REC_CREATE:
+            fprintf(out, ",\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":2,\"tid\":%d,\"args\":{\"name\":\"Task %d: ",
+                    rec->task_id, rec->task_id);
+            json_text(out, rec->text);
+            fprintf(out, "\"}}");
+            fprintf(out, ",\n{\"name\":\"created\",\"cat\":\"task\",\"ph\":\"i\",\"s\":\"t\",\"pid\":2,\"tid\":%d,\"ts\":%lld}",
+                    rec->task_id, ts);
+            span = find_span(spans, &num_spans, rec->task_id);
+            span->state = 0;
+            span->ts = rec->ts;
+            events += 2;
+            break;
+        case REC_STATE:
+            span = find_span(spans, &num_spans, rec->task_id);
+            if (span->state == -1)
+            {
+                span->state = (int)rec->a; // its earlier records were overwritten
+                span->ts = base;
+            }
+            events += close_span(out, span, rec->ts, base);
+            span->state = (int)rec->b;
+            span->ts = rec->ts;
+            break;
+        case REC_LAUNCH:
+            fprintf(out, ",\n{\"name\":\"launched\",\"cat\":\"task\",\"ph\":\"i\",\"s\":\"t\",\"pid\":2,\"tid\":%d,\"ts\":%lld,"
+                    "\"args\":{\"pid\":%ld}}", rec->task_id, ts, rec->a);
+            events++;
+            break;
+        case REC_EXIT:
+            fprintf(out, ",\n{\"name\":\"exited\",\"cat\":\"task\",\"ph\":\"i\",\"s\":\"t\",\"pid\":2,\"tid\":%d,\"ts\":%lld,"
+                    "\"args\":{\"%s\":%ld}}", rec->task_id, ts, rec->b ? "signal" : "code", rec->a);
+            events++;
+            break;
+        case REC_COMMAND:
+            fprintf(out, ",\n{\"name\":\"");
+            json_text(out, rec->text);
+            fprintf(out, "\",\"cat\":\"command\",\"ph\":\"X\",\"pid\":1,\"tid\":0,\"ts\":%lld,\"dur\":%ld}",
+                    (ts < 0) ? 0 : ts, rec->a);
+            events++;
+            break;
+        }
+    }
+    for (int i = 0; i < num_spans; i++)
+    {
+        events += close_span(out, &spans[i], end, base); // still in that state
+    }
+    fprintf(out, "\n]}\n");
+    free(spans);
+    if (fclose(out) != 0)
+    {
+        return -1;
+    }
+    return events;
+}
@@ -0,0 +1,52 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <time.h>
+#include <sys/types.h>
+
+/* Task lifecycle tracing. While tracing is on, task state changes, launches,
+ * exits and command handling are recorded in a fixed in-memory buffer (the
+ * oldest records are overwritten), which trace_dump() writes out in Chrome
+ * Trace Event format for chrome://tracing or Perfetto. When tracing is off each
+ * call site costs one test of trace_on. */
+
+extern int trace_on; // 1 while records are taken
+
+/* Runs call only while tracing is on. */
+#define TRACE(call)      \
+    do                   \
+    {                    \
+        if (trace_on)    \
+        {                \
+            call;        \
+        }                \
+    } while (0)
+
+/* Starts tracing with an empty buffer. Returns 0 on success, -1 if out of memory. */
+int trace_start(void);
+
+/* Stops tracing; the records are kept for trace_dump(). */
+void trace_stop(void);
+
+/* Returns the number of records held. */
+unsigned long trace_count(void);
+
+/* Records a new task. */
+void trace_create(int task_id, const char *command);
+
+/* Records a task moving from one state (LOG_STATE_*) to another. Safe in signal handlers. */
+void trace_state(int task_id, int old_state, int new_state);
+
+/* Records a task's process being started. */
+void trace_launch(int task_id, pid_t pid);
+
+/* Records a task's process ending, with its exit code or the signal that ended it. */
+void trace_exit(int task_id, int status, int signaled);
+
+/* Records the handling of a command line that started at start and took seconds. */
+void trace_command(const struct timespec *start, double seconds, const char *line);
+
+/* Writes the records as Chrome Trace Event JSON. Returns the number of events written, or -1. */
+long trace_dump(const char *path);
+
+#endif /*TRACE_H*/
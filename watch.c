@@ -0,0 +1,255 @@
+/* File change notification with debouncing, over inotify and a timerfd. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <limits.h>
+#include <stdint.h>
+#include <sys/inotify.h>
+#include <sys/timerfd.h>
+
+#include "watch.h"
+
+/* changes that complete a new version of a file: a write, a rename into place, touch or chmod */
+#define WATCH_EVENTS (IN_CLOSE_WRITE | IN_MOVED_TO | IN_ATTRIB)
+
+typedef struct WatchedDir
+{
+    int wd;   // inotify watch descriptor, shared by every file in the directory
+    int refs; // files watched in it
+} WatchedDir;
+
+typedef struct Watcher
+{
+    struct Watcher *next;
+    void *owner;
+    int wd[WATCH_MAX_FILES];          // directory of each file, -1 if unused
+    char name[WATCH_MAX_FILES][NAME_MAX + 1]; // file name within the directory
+    int changed;                      // 1 once a file changed, until settled
+} Watcher;
+
+static int inotify_fd = -1;
+static int timer_fd = -1;
+static Watcher *watchers = NULL;
+static WatchedDir *dirs = NULL;
+static int num_dirs = 0, cap_dirs = 0;
+
+int watch_init(void)
+{
+    if (inotify_fd != -1)
+    {
+        return 0;
+    }
+    inotify_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    timer_fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    if (inotify_fd == -1 || timer_fd == -1)
+    {
+        if (inotify_fd != -1)
+        {
+            close(inotify_fd);
+        }
+        if (timer_fd != -1)
+        {
+            close(timer_fd);
+        }
+        inotify_fd = timer_fd = -1;
+        return -1;
+    }
+    return 0;
+}
+
+int watch_fd(void)
+{
+    return inotify_fd;
+}
+
+int watch_timer_fd(void)
+{
+    return timer_fd;
+}
+
+/* Adds a reference to the watch of the directory holding path and stores the
+ * file name. Returns the watch descriptor, or -1. */
+static int dir_ref(const char *path, char *name)
+{
+    char dir[PATH_MAX];
+    const char *slash = strrchr(path, '/');
+
+    if (slash)
+    {
+        snprintf(dir, sizeof(dir), "%.*s", (int)(slash - path) + (slash == path), path);
+        snprintf(name, NAME_MAX + 1, "%s", slash + 1);
+    }
+    else
+    {
+        snprintf(dir, sizeof(dir), ".");
+        snprintf(name, NAME_MAX + 1, "%s", path);
+    }
+    int wd = inotify_add_watch(inotify_fd, dir, WATCH_EVENTS | IN_ONLYDIR);
+    if (wd == -1)
+    {
+        return -1;
+    }
+    for (int i = 0; i < num_dirs; i++)
+    {
+        if (dirs[i].wd == wd)
+        {
+            dirs[i].refs++; // the kernel hands out the same wd for the same directory
+            return wd;
+        }
+    }
+    if (num_dirs == cap_dirs)
+    {
+        int cap = cap_dirs ? cap_dirs * 2 : 8;
+        WatchedDir *grown = (WatchedDir *)realloc(dirs, cap * sizeof(WatchedDir));
+        if (!grown)
+        {
+            inotify_rm_watch(inotify_fd, wd);
+            return -1;
+        }
+        dirs = grown;
+        cap_dirs = cap;
+    }
+    dirs[num_dirs].wd = wd;
+    dirs[num_dirs].refs = 1;
+    num_dirs++;
+    return wd;
+}
+
+static void dir_unref(int wd)
+{
+    for (int i = 0; i < num_dirs; i++)
+    {
+        if (dirs[i].wd == wd && --dirs[i].refs == 0)
+        {
+            inotify_rm_watch(inotify_fd, wd);
+            dirs[i] = dirs[--num_dirs];
+            return;
+        }
+    }
+}
+
+int watch_add(void *owner, const char *paths[], int count)
+{
+    if (inotify_fd == -1)
+    {
+        return -1;
+    }
+    watch_remove(owner);
+    Watcher *w = (Watcher *)calloc(1, sizeof(Watcher));
+    if (!w)
+    {
+        return -1;
+    }
+    w->owner = owner;
+    for (int i = 0; i < WATCH_MAX_FILES; i++)
+    {
+        w->wd[i] = -1;
+    }
+    for (int i = 0, n = 0; i < count && n < WATCH_MAX_FILES; i++)
+    {
+        if (!paths[i])
+        {
+            continue;
+        }
+        if ((w->wd[n] = dir_ref(paths[i], w->name[n])) == -1)
+        {
+            for (int j = 0; j < n; j++)
+            {
+                dir_unref(w->wd[j]);
+            }
+            free(w);
+            return -1;
+        }
+        n++;
+    }
+    w->next = watchers;
+    watchers = w;
+    return 0;
+}
+
+void watch_remove(void *owner)
+{
+    for (Watcher **link = &watchers; *link; link = &(*link)->next)
+    {
+        Watcher *w = *link;
+        if (w->owner != owner)
+        {
+            continue;
+        }
+        for (int i = 0; i < WATCH_MAX_FILES; i++)
+        {
+            if (w->wd[i] != -1)
+            {
+                dir_unref(w->wd[i]);
+            }
+        }
+        *link = w->next;
+        free(w);
+        return;
+    }
+}
+
+void watch_changes(void)
+{
+    char buffer[4096] __attribute__((aligned(__alignof__(struct inotify_event))));
+    int matched = 0;
+    ssize_t n;
+
+    while ((n = read(inotify_fd, buffer, sizeof(buffer))) > 0)
+    {
+        for (char *p = buffer; p < buffer + n; p += sizeof(struct inotify_event) + ((struct inotify_event *)p)->len)
+        {
+            struct inotify_event *event = (struct inotify_event *)p;
+            if (!event->len)
+            {
+                continue; // about the directory itself
+            }
+            for (Watcher *w = watchers; w; w = w->next)
+            {
+                for (int i = 0; i < WATCH_MAX_FILES; i++)
+                {
+                    if (w->wd[i] == event->wd && strcmp(w->name[i], event->name) == 0)
+                    {
+                        w->changed = 1;
+                        matched = 1;
+                    }
+                }
+            }
+        }
+    }
+    if (matched)
+    { // trailing edge: every change pushes the report back
+        struct itimerspec when;
+        memset(&when, 0, sizeof(when));
+        when.it_value.tv_sec = WATCH_DEBOUNCE_MS / 1000;
+        when.it_value.tv_nsec = (WATCH_DEBOUNCE_MS % 1000) * 1000000L;
+        timerfd_settime(timer_fd, 0, &when, NULL);
+    }
+}
+
+void watch_settle(void (*changed)(void *owner))
+{
+    uint64_t expirations;
+
+    if (read(timer_fd, &expirations, sizeof(expirations)) != sizeof(expirations))
+    {
+        return;
+    }
+    /* the callback may remove or re-add watchers, so restart after each one */
+    for (int found = 1; found;)
+    {
+        found = 0;
+        for (Watcher *w = watchers; w; w = w->next)
+        {
+            if (w->changed)
+            {
+                w->changed = 0;
+                found = 1;
+                changed(w->owner);
+                break;
+            }
+        }
+    }
+}
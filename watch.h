@@ -0,0 +1,38 @@
+#ifndef WATCH_H
+#define WATCH_H
+
+/* Change notification for files, through inotify. Each file is watched via
+ * its directory, so that files replaced by a rename (as editors and linkers
+ * do) keep being followed. A burst of changes is reported once, when no new
+ * change has come for WATCH_DEBOUNCE_MS. Nothing runs while nothing changes. */
+
+#define WATCH_DEBOUNCE_MS 250
+#define WATCH_MAX_FILES 2 /* files per owner */
+
+/* Creates the inotify descriptor and the debounce timer, once. Returns 0 on
+ * success, -1 on failure. */
+int watch_init(void);
+
+/* Descriptor that becomes readable when a watched directory changes. */
+int watch_fd(void);
+
+/* Descriptor (a timerfd) that becomes readable when a burst of changes is over. */
+int watch_timer_fd(void);
+
+/* Watches up to WATCH_MAX_FILES files (NULL entries are skipped) on behalf of
+ * owner, replacing what it watched before. Returns 0, or -1 if a directory
+ * cannot be watched. */
+int watch_add(void *owner, const char *paths[], int count);
+
+/* Stops watching owner's files. */
+void watch_remove(void *owner);
+
+/* Reads pending notifications and restarts the debounce timer if one of them
+ * is about a watched file. Call when watch_fd() is readable. */
+void watch_changes(void);
+
+/* Calls changed(owner) for every owner with a changed file since the last
+ * call. Call when watch_timer_fd() is readable. */
+void watch_settle(void (*changed)(void *owner));
+
+#endif /*WATCH_H*/
@@ -0,0 +1,344 @@
+/* A synthetic workload provided as local executable, for benchmarking taskman
+ * with production-like tasks instead of the fixed demos (my_echo, slow_cooker,
+ * my_pause). Every flag is optional; without any it exits at once with 0.
+ *
+ *   --cpu MS              burn MS milliseconds of CPU time, spread evenly over the run
+ *   --mem MB              allocate and touch MB MiB, held until the end
+ *   --duration SECONDS    run this long (default: until the --cpu time is used;
+ *                         -1 to run until a signal ends it)
+ *   --rate BYTES          write BYTES bytes per second to stdout
+ *   --line BYTES          in lines of this size, newline included (default 80)
+ *   --exit CODE[:W],...   exit code, or a weighted choice such as 0:90,1:9,2:1
+ *   --fork-depth N        start a chain of N descendants that do the same work;
+ *                         each process waits for its child before exiting
+ *   --ignore SIG,...      ignore these signals (INT, TERM, TSTP, HUP, QUIT, USR1, USR2 or numbers)
+ *   --handle SIG[:N],...  report these signals on stdout; exit normally after N of them
+ *   --seed S              seed of the exit code choice (default: time and pid)
+ *
+ * For example "workload --exit 3" is my_echo 3, "workload --duration 10
+ * --rate 40 --line 40" is slow_cooker, and "workload --duration -1 --handle
+ * INT:3" is my_pause.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <signal.h>
+#include <time.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+
+#define MAX_CODES 32
+#define SLICE_MS  10 /* work is paced in slices of this length */
+#define SIGNALS   65 /* signal numbers are below this on Linux */
+
+typedef struct SignalName
+{
+    const char *name;
+    int sig;
+} SignalName;
+
+static const SignalName signal_names[] = {
+    {"INT", SIGINT},   {"TERM", SIGTERM}, {"TSTP", SIGTSTP}, {"HUP", SIGHUP},
+    {"QUIT", SIGQUIT}, {"USR1", SIGUSR1}, {"USR2", SIGUSR2}, {"CONT", SIGCONT},
+};
+
+static volatile sig_atomic_t received[SIGNALS]; // deliveries of each handled signal
+static long handle_limit[SIGNALS];              // deliveries that end the run, 0 for none
+static int handled[SIGNALS];                    // 1 for signals given to --handle
+
+static void usage(void)
+{
+    fprintf(stderr, "usage: workload [--cpu MS] [--mem MB] [--duration SECONDS] [--rate BYTES] [--line BYTES]\n"
+                    "                [--exit CODE[:WEIGHT],...] [--fork-depth N] [--ignore SIG,...]\n"
+                    "                [--handle SIG[:N],...] [--seed S]\n");
+    exit(2);
+}
+
+static double now(clockid_t clock)
+{
+    struct timespec ts;
+    clock_gettime(clock, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static int parse_signal(const char *text)
+{
+    char *end;
+    long number = strtol(text, &end, 10);
+    if (end != text && (*end == '\0' || *end == ':'))
+    {
+        return (number > 0 && number < SIGNALS) ? (int)number : -1;
+    }
+    if (strncmp(text, "SIG", 3) == 0)
+    {
+        text += 3;
+    }
+    for (size_t i = 0; i < sizeof(signal_names) / sizeof(signal_names[0]); i++)
+    {
+        size_t len = strlen(signal_names[i].name);
+        if (strncmp(text, signal_names[i].name, len) == 0 && (text[len] == '\0' || text[len] == ':'))
+        {
+            return signal_names[i].sig;
+        }
+    }
+    return -1;
+}
+
+static void on_signal(int sig)
+{
+    received[sig]++;
+}
+
+/*
+ * Applies a comma separated signal list of --ignore (handle = 0) or --handle.
+ */
+static void set_signals(char *list, int handle)
+{
+    for (char *item = strtok(list, ","); item; item = strtok(NULL, ","))
+    {
+        int sig = parse_signal(item);
+        if (sig == -1 || sig == SIGKILL || sig == SIGSTOP)
+        {
+            usage();
+        }
+        struct sigaction act;
+        memset(&act, 0, sizeof(act));
+        act.sa_handler = handle ? on_signal : SIG_IGN;
+        sigaction(sig, &act, NULL);
+        if (handle)
+        {
+            char *limit = strchr(item, ':');
+            handled[sig] = 1;
+            handle_limit[sig] = limit ? atol(limit + 1) : 0;
+        }
+    }
+}
+
+/*
+ * Picks an exit code from "CODE[:WEIGHT],...".
+ */
+static int choose_exit(char *spec, unsigned int seed)
+{
+    int codes[MAX_CODES];
+    long weights[MAX_CODES], total = 0;
+    int count = 0;
+
+    for (char *item = strtok(spec, ","); item && count < MAX_CODES; item = strtok(NULL, ","))
+    {
+        char *weight = strchr(item, ':');
+        codes[count] = atoi(item);
+        weights[count] = weight ? atol(weight + 1) : 1;
+        if (weights[count] < 0)
+        {
+            usage();
+        }
+        total += weights[count++];
+    }
+    if (count == 0 || total == 0)
+    {
+        return 0;
+    }
+    srand(seed);
+    long pick = rand() % total;
+    for (int i = 0; i < count; i++)
+    {
+        if (pick < weights[i])
+        {
+            return codes[i];
+        }
+        pick -= weights[i];
+    }
+    return codes[count - 1];
+}
+
+/*
+ * Reports handled signals. Returns 1 once one of them reached its limit.
+ */
+static int check_signals(long *reported)
+{
+    int quit = 0;
+    for (int sig = 1; sig < SIGNALS; sig++)
+    {
+        if (!handled[sig])
+        {
+            continue;
+        }
+        long count = received[sig];
+        for (; reported[sig] < count; reported[sig]++)
+        {
+            printf("workload %d: received signal %d (%ld)\n", (int)getpid(), sig, reported[sig] + 1);
+        }
+        fflush(stdout);
+        quit |= handle_limit[sig] > 0 && count >= handle_limit[sig];
+    }
+    return quit;
+}
+
+int main(int argc, char *argv[])
+{
+    double cpu_ms = 0, duration = -2, rate = 0;
+    long mem_mb = 0, line = 80, depth = 0;
+    char *exit_spec = NULL;
+    unsigned int seed = (unsigned int)time(NULL);
+    int seeded = 0;
+
+    for (int i = 1; i < argc; i++)
+    {
+        if (i + 1 >= argc)
+        {
+            usage();
+        }
+        const char *flag = argv[i];
+        char *value = argv[++i];
+        if (strcmp(flag, "--cpu") == 0)
+        {
+            cpu_ms = atof(value);
+        }
+        else if (strcmp(flag, "--mem") == 0)
+        {
+            mem_mb = atol(value);
+        }
+        else if (strcmp(flag, "--duration") == 0)
+        {
+            duration = atof(value);
+        }
+        else if (strcmp(flag, "--rate") == 0)
+        {
+            rate = atof(value);
+        }
+        else if (strcmp(flag, "--line") == 0)
+        {
+            line = atol(value);
+        }
+        else if (strcmp(flag, "--exit") == 0)
+        {
+            exit_spec = value;
+        }
+        else if (strcmp(flag, "--fork-depth") == 0)
+        {
+            depth = atol(value);
+        }
+        else if (strcmp(flag, "--ignore") == 0)
+        {
+            set_signals(value, 0);
+        }
+        else if (strcmp(flag, "--handle") == 0)
+        {
+            set_signals(value, 1);
+        }
+        else if (strcmp(flag, "--seed") == 0)
+        {
+            seed = (unsigned int)strtoul(value, NULL, 10);
+            seeded = 1;
+        }
+        else
+        {
+            usage();
+        }
+    }
+    if (line < 1 || cpu_ms < 0 || mem_mb < 0 || rate < 0 || depth < 0)
+    {
+        usage();
+    }
+    int until_burned = (duration == -2); // no --duration: run until the CPU time is used, however long it takes
+
+    /* the chain of descendants; each does the same work, with its own exit code */
+    pid_t child = -1;
+    for (; depth > 0; depth--)
+    {
+        fflush(stdout);
+        child = fork();
+        if (child != 0)
+        {
+            break;
+        }
+        seed = seed * 31 + 7; // a different draw in every generation
+    }
+    if (!seeded)
+    {
+        seed ^= (unsigned int)getpid() << 16;
+    }
+
+    char *memory = NULL;
+    if (mem_mb > 0)
+    {
+        size_t size = (size_t)mem_mb * 1024 * 1024;
+        memory = malloc(size);
+        if (!memory)
+        {
+            perror("workload");
+            return 1;
+        }
+        long page = sysconf(_SC_PAGESIZE);
+        for (size_t off = 0; off < size; off += page)
+        {
+            memory[off] = (char)off; // resident, not just reserved
+        }
+    }
+
+    char *text = malloc(line);
+    if (!text)
+    {
+        perror("workload");
+        return 1;
+    }
+    memset(text, 'x', line - 1);
+    text[line - 1] = '\n';
+
+    long reported[SIGNALS] = {0};
+    double start = now(CLOCK_MONOTONIC), cpu_start = now(CLOCK_PROCESS_CPUTIME_ID);
+    double written = 0;
+    volatile double sink = 0;
+
+    for (;;)
+    {
+        double elapsed = now(CLOCK_MONOTONIC) - start;
+        double used_ms = (now(CLOCK_PROCESS_CPUTIME_ID) - cpu_start) * 1000;
+        if (check_signals(reported) || (until_burned ? used_ms >= cpu_ms : duration >= 0 && elapsed >= duration))
+        {
+            break;
+        }
+
+        /* burn the share of CPU time due by the end of this slice */
+        double slice_end = elapsed + SLICE_MS / 1000.0;
+        double due_ms = (!until_burned && duration > 0 && slice_end < duration) ? cpu_ms * slice_end / duration
+                                                                                : cpu_ms;
+        while ((now(CLOCK_PROCESS_CPUTIME_ID) - cpu_start) * 1000 < due_ms &&
+               now(CLOCK_MONOTONIC) - start < slice_end)
+        {
+            for (int k = 0; k < 1000; k++)
+            {
+                sink = sink * 1.0000001 + k;
+            }
+        }
+
+        /* write the lines due by now */
+        while (rate > 0 && written + line <= rate * (now(CLOCK_MONOTONIC) - start))
+        {
+            if (write(STDOUT_FILENO, text, line) != line)
+            {
+                break; // reader gone or interrupted, keep to the schedule anyway
+            }
+            written += line;
+        }
+
+        double left = slice_end - (now(CLOCK_MONOTONIC) - start);
+        if (left > 0)
+        {
+            struct timespec pause = {0, (long)(left * 1e9)};
+            nanosleep(&pause, NULL); // a handled signal ends it early
+        }
+    }
+
+    if (child > 0)
+    {
+        while (waitpid(child, NULL, 0) == -1 && errno == EINTR && !check_signals(reported))
+            ; // a handled signal interrupts the wait
+    }
+    free(memory);
+    free(text);
+    return exit_spec ? choose_exit(exit_spec, seed) : 0;
+}